@@ -0,0 +1,342 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * microbenchmark harness.
+ *
+ * Each kernel is run on synthetic data derived from a size x size bitmap of
+ * overlapping graduated discs. The kernel brackets the region of interest
+ * with bench_start() and bench_stop() and records how many operations it
+ * performed and how many bytes those operations allocated or wrote. The
+ * best of several iterations is reported as ns/op and bytes/op.
+ *
+ * With -p the hardware performance counters are collected over the same
+ * timed region and reported per operation alongside the timing.
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "option.h"
+#include "bitmap.h"
+#include "mesh.h"
+#include "mesh_gen.h"
+#include "mesh_index.h"
+#include "bench.h"
+
+static const struct {
+    const char *name;
+    benchfn *fn;
+} kernels[] = {
+    { "mesh_bloom_hash", bench_mesh_bloom_hash },
+    { "mesh_bloom_insert", bench_mesh_bloom_insert },
+    { "mesh_bloom_query", bench_mesh_bloom_query },
+    { "find_pnt", bench_find_pnt },
+    { "remove_facet_from_vertex", bench_remove_facet_from_vertex },
+    { "mesh_gen_get_face", bench_mesh_gen_get_face },
+    { "mesh_add_facet", bench_mesh_add_facet },
+    { "mesh_gen_slab_mc", bench_mesh_gen_slab_mc },
+    { "mesh_gen_slab_faces", bench_mesh_gen_slab_faces },
+    { "same_normal", bench_same_normal },
+    { "out_stl", bench_out_stl },
+    { "out_astl", bench_out_astl },
+    { "out_pscad", bench_out_pscad },
+    { "out_3mf", bench_out_3mf },
+    { "out_rscad", bench_out_rscad },
+    { "out_pgm", bench_out_pgm },
+    { "out_bpgm", bench_out_bpgm },
+    { "out_png", bench_out_png },
+    { "stage_decode", bench_stage_decode },
+    { "stage_decode_pgm", bench_stage_decode_pgm },
+    { "stage_generate", bench_stage_generate },
+    { "stage_outline", bench_stage_outline },
+    { "stage_distance", bench_stage_distance },
+    { "stage_index", bench_stage_index },
+    { "stage_simplify", bench_stage_simplify },
+};
+
+static uint32_t bench_seed;
+
+static char bench_infile[] = "bench";
+
+/* simple deterministic LCG so every run sees identical data */
+static uint32_t bench_rand(void)
+{
+    bench_seed = (bench_seed * 1103515245) + 12345;
+    return (bench_seed >> 8) & 0xffffff;
+}
+
+/* exported interface documented in bench.h */
+void bench_start(struct bench *b)
+{
+    if (b->perf) {
+        bench_perf_start(b);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b->start);
+}
+
+/* exported interface documented in bench.h */
+void bench_stop(struct bench *b)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (b->perf) {
+        bench_perf_stop(b);
+    }
+
+    b->elapsed += ((end.tv_sec - b->start.tv_sec) * 1000000000LL) +
+                  (end.tv_nsec - b->start.tv_nsec);
+}
+
+/* exported interface documented in bench.h */
+bitmap *bench_bitmap(struct bench *b)
+{
+    bitmap *bm;
+    unsigned int discs;
+    unsigned int dloop;
+    unsigned int x;
+    unsigned int y;
+    int cx;
+    int cy;
+    int r;
+    float dist;
+    uint8_t val;
+
+    bm = new_bitmap(b->size, b->size);
+    if (bm == NULL) {
+        return NULL;
+    }
+
+    /* start fully transparent */
+    for (y = 0; y < b->size; y++) {
+        memset(bitmap_pixel(bm, 0, y), 255, b->size);
+    }
+    bitmap_border(bm, 255);
+
+    bench_seed = 1;
+    discs = (b->size / 8) + 1;
+
+    for (dloop = 0; dloop < discs; dloop++) {
+        cx = bench_rand() % b->size;
+        cy = bench_rand() % b->size;
+        r = (b->size / 16) + (bench_rand() % ((b->size / 8) + 1)) + 1;
+
+        for (y = 0; y < b->size; y++) {
+            for (x = 0; x < b->size; x++) {
+                dist = sqrtf(((x - cx) * (x - cx)) + ((y - cy) * (y - cy)));
+                if (dist < r) {
+                    /* graduated so multi level meshes have structure */
+                    val = 254 - (uint8_t)((dist * 254) / r);
+                    if ((*bitmap_pixel(bm, x, y) == 255) ||
+                        (*bitmap_pixel(bm, x, y) < val)) {
+                        *bitmap_pixel(bm, x, y) = val;
+                    }
+                }
+            }
+        }
+    }
+
+    return bm;
+}
+
+/* exported interface documented in bench.h */
+options *bench_options(struct bench *b)
+{
+    options *options;
+
+    options = calloc(1, sizeof(struct options));
+    if (options == NULL) {
+        return NULL;
+    }
+
+    options->type = OUTPUT_STL;
+    if (b->levels == 1) {
+        options->finish = FINISH_SMOOTH;
+    } else {
+        options->finish = FINISH_CUBE;
+    }
+    options->optimise = 1;
+    options->transparent = 255;
+    options->levels = b->levels;
+    options->width = b->size;
+    options->height = b->size;
+    options->depth = b->levels;
+    options->bloom_complexity = 2;
+    options->vertex_complexity = 16;
+    options->infile = bench_infile;
+
+    return options;
+}
+
+/* exported interface documented in bench.h */
+struct mesh *bench_mesh(struct bench *b, bool indexed)
+{
+    bitmap *bm;
+    options *options;
+    struct mesh *mesh;
+
+    bm = bench_bitmap(b);
+    options = bench_options(b);
+    mesh = new_mesh();
+
+    if ((bm == NULL) || (options == NULL) || (mesh == NULL)) {
+        fprintf(stderr, "unable to create synthetic mesh\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mesh_from_bitmap(mesh, bm, options);
+
+    if (indexed) {
+        index_mesh(mesh, options->bloom_complexity, options->vertex_complexity);
+    }
+
+    free(options);
+    free_bitmap(bm);
+
+    return mesh;
+}
+
+static bool
+bench_selected(int argc, char **argv, const char *name)
+{
+    int aloop;
+
+    if (optind >= argc) {
+        return true;
+    }
+
+    for (aloop = optind; aloop < argc; aloop++) {
+        if (strstr(name, argv[aloop]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    unsigned int kloop;
+    unsigned int iloop;
+    unsigned int iterations = 5;
+    struct bench b;
+    struct bench best;
+    unsigned int cloop;
+    double ns_per_op;
+
+    memset(&b, 0, sizeof(b));
+    b.size = 256;
+    b.levels = 1;
+
+    while ((opt = getopt(argc, argv, "n:i:l:p")) != -1) {
+        switch (opt) {
+        case 'n': /* synthetic bitmap size */
+            b.size = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'i': /* iterations */
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'l': /* quantisation levels */
+            b.levels = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'p': /* hardware performance counters */
+            b.perf = true;
+            break;
+
+        default:
+            fprintf(stderr,
+                    "Usage: png23d-bench [-n size] [-i iterations] [-l levels] [-p] [kernel...]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((b.size < 8) || (iterations < 1) ||
+        (b.levels < 1) || (b.levels > 256)) {
+        fprintf(stderr, "size must be at least 8, iterations at least 1 and levels 1 to 256\n");
+        return EXIT_FAILURE;
+    }
+
+    if (b.perf && !bench_perf_init()) {
+        fprintf(stderr, "hardware performance counters unavailable\n");
+        b.perf = false;
+    }
+
+    printf("%-26s %6s %10s %12s %10s",
+           "kernel", "size", "ops", "ns/op", "bytes/op");
+    if (b.perf) {
+        for (cloop = 0; cloop < BENCH_COUNTERS; cloop++) {
+            if (bench_perf_name(cloop) != NULL) {
+                printf(" %10s", bench_perf_name(cloop));
+            }
+        }
+    }
+    printf("\n");
+
+    for (kloop = 0; kloop < sizeof(kernels) / sizeof(*kernels); kloop++) {
+        if (!bench_selected(argc, argv, kernels[kloop].name)) {
+            continue;
+        }
+
+        memset(&best, 0, sizeof(best));
+
+        for (iloop = 0; iloop < iterations; iloop++) {
+            b.ops = 0;
+            b.bytes = 0;
+            b.elapsed = 0;
+            memset(b.counters, 0, sizeof(b.counters));
+
+            kernels[kloop].fn(&b);
+
+            if ((b.ops > 0) &&
+                ((best.ops == 0) ||
+                 ((b.elapsed * best.ops) < (best.elapsed * b.ops)))) {
+                best = b;
+            }
+        }
+
+        if (best.ops == 0) {
+            printf("%-26s %6u %10s\n", kernels[kloop].name, b.size, "-");
+            continue;
+        }
+
+        ns_per_op = (double)best.elapsed / best.ops;
+
+        printf("%-26s %6u %10" PRIu64 " %12.2f %10.2f",
+               kernels[kloop].name,
+               b.size,
+               best.ops,
+               ns_per_op,
+               (double)best.bytes / best.ops);
+
+        /* counters are reported per operation */
+        if (b.perf) {
+            for (cloop = 0; cloop < BENCH_COUNTERS; cloop++) {
+                if (bench_perf_name(cloop) != NULL) {
+                    printf(" %10.2f", (double)best.counters[cloop] / best.ops);
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    if (b.perf) {
+        bench_perf_fini();
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * microbenchmark harness header.
+ */
+
+#ifndef PNG23D_BENCH_H
+#define PNG23D_BENCH_H 1
+
+#include <time.h>
+
+/** number of hardware counters collected when enabled */
+#define BENCH_COUNTERS 5
+
+/** state of a single benchmark run */
+struct bench {
+    unsigned int size; /**< edge length of the synthetic bitmap */
+    unsigned int levels; /**< quantisation levels of the synthetic bitmap */
+    uint64_t ops; /**< operations performed in the timed region */
+    uint64_t bytes; /**< bytes allocated or written in the timed region */
+    uint64_t elapsed; /**< nanoseconds spent in the timed region */
+    struct timespec start; /**< start of the current timed region */
+    bool perf; /**< collect hardware performance counters */
+    uint64_t counters[BENCH_COUNTERS]; /**< counts in the timed region */
+};
+
+/** a benchmark kernel */
+typedef void (benchfn)(struct bench *b);
+
+/** start (or resume) the timed region */
+void bench_start(struct bench *b);
+
+/** stop the timed region and accumulate the elapsed time */
+void bench_stop(struct bench *b);
+
+/** open the hardware performance counters
+ *
+ * @return true if at least one counter is available.
+ */
+bool bench_perf_init(void);
+
+/** close the hardware performance counters */
+void bench_perf_fini(void);
+
+/** short name of a counter or NULL if it could not be opened */
+const char *bench_perf_name(unsigned int counter);
+
+/** reset and enable the counters */
+void bench_perf_start(struct bench *b);
+
+/** disable the counters and accumulate their values */
+void bench_perf_stop(struct bench *b);
+
+/** create a synthetic bitmap of size x size pixels */
+bitmap *bench_bitmap(struct bench *b);
+
+/** create options suitable for the synthetic bitmap */
+options *bench_options(struct bench *b);
+
+/** create a synthetic mesh, indexed if requested */
+struct mesh *bench_mesh(struct bench *b, bool indexed);
+
+/* kernels */
+void bench_mesh_bloom_hash(struct bench *b);
+void bench_mesh_bloom_insert(struct bench *b);
+void bench_mesh_bloom_query(struct bench *b);
+void bench_find_pnt(struct bench *b);
+void bench_remove_facet_from_vertex(struct bench *b);
+void bench_mesh_gen_get_face(struct bench *b);
+void bench_mesh_add_facet(struct bench *b);
+void bench_mesh_gen_slab_mc(struct bench *b);
+void bench_mesh_gen_slab_faces(struct bench *b);
+void bench_same_normal(struct bench *b);
+void bench_out_stl(struct bench *b);
+void bench_out_astl(struct bench *b);
+void bench_out_pscad(struct bench *b);
+void bench_out_3mf(struct bench *b);
+void bench_out_rscad(struct bench *b);
+void bench_out_pgm(struct bench *b);
+void bench_out_bpgm(struct bench *b);
+void bench_out_png(struct bench *b);
+void bench_stage_decode(struct bench *b);
+void bench_stage_decode_pgm(struct bench *b);
+void bench_stage_generate(struct bench *b);
+void bench_stage_outline(struct bench *b);
+void bench_stage_distance(struct bench *b);
+void bench_stage_index(struct bench *b);
+void bench_stage_simplify(struct bench *b);
+
+#endif
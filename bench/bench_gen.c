@@ -0,0 +1,163 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * mesh generation microbenchmarks.
+ *
+ * The module is included directly so its static kernels can be exercised.
+ */
+
+#include "mesh_gen.c"
+
+#include "bench.h"
+
+void bench_mesh_gen_get_face(struct bench *b)
+{
+    bitmap *bm;
+    options *options;
+    unsigned int xloop;
+    unsigned int yloop;
+    unsigned int zloop;
+    uint32_t sink = 0;
+
+    bm = bench_bitmap(b);
+    options = bench_options(b);
+    bitmap_border(bm, options->transparent);
+
+    bench_start(b);
+    for (zloop = 0; zloop < options->levels; zloop++) {
+        for (yloop = 0; yloop < bm->height; yloop++) {
+            for (xloop = 0; xloop < bm->width; xloop++) {
+                sink += mesh_gen_get_face(bm, xloop, yloop, zloop, options);
+            }
+        }
+    }
+    bench_stop(b);
+
+    b->ops = bm->width * bm->height * options->levels;
+
+    if (sink == 0) {
+        b->bytes++;
+    }
+
+    free(options);
+    free_bitmap(bm);
+}
+
+void bench_mesh_add_facet(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int xloop;
+    unsigned int yloop;
+
+    mesh = new_mesh();
+
+    bench_start(b);
+    for (yloop = 0; yloop < b->size; yloop++) {
+        for (xloop = 0; xloop < b->size; xloop++) {
+            mesh_add_facet(mesh,
+                           xloop, yloop, 0,
+                           xloop + 1, yloop, 0,
+                           xloop, yloop + 1, 0);
+        }
+    }
+    bench_stop(b);
+
+    b->ops = b->size * b->size;
+    b->bytes = mesh->falloc * sizeof(struct facet);
+
+    free_mesh(mesh);
+}
+
+void bench_same_normal(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int floop;
+    unsigned int same = 0;
+
+    mesh = bench_mesh(b, false);
+
+    bench_start(b);
+    for (floop = 1; floop < mesh->fcount; floop++) {
+        same += same_normal(&mesh->f[floop - 1].n, &mesh->f[floop].n);
+    }
+    bench_stop(b);
+
+    b->ops = mesh->fcount - 1;
+
+    if (same == 0) {
+        b->bytes++;
+    }
+
+    free_mesh(mesh);
+}
+
+/* mesh the synthetic bitmap as a stack of slices at successive levels */
+static void bench_mesh_gen_slab(struct bench *b, slabgenerator *slabgen)
+{
+    bitmap *bm;
+    struct mesh *mesh;
+    size_t size;
+    uint8_t *below;
+    uint8_t *above;
+    uint8_t *swap;
+    unsigned int slice;
+    unsigned int slices = 8;
+    unsigned int xloop;
+    unsigned int yloop;
+    const uint8_t *pxl;
+    uint8_t *row;
+
+    bm = bench_bitmap(b);
+    mesh = new_mesh();
+    size = (size_t)(bm->width + 2) * (bm->height + 2);
+    below = calloc(1, size);
+    above = calloc(1, size);
+
+    mesh_gen_mc_table();
+
+    for (slice = 0; slice <= slices; slice++) {
+        /* each slice keeps the opaque pixels above a rising grey level */
+        memset(above, 0, size);
+        if (slice < slices) {
+            for (yloop = 0; yloop < bm->height; yloop++) {
+                pxl = bitmap_pixel(bm, 0, yloop);
+                row = above + ((yloop + 1) * (bm->width + 2)) + 1;
+                for (xloop = 0; xloop < bm->width; xloop++) {
+                    row[xloop] = ((pxl[xloop] != 255) &&
+                                  (pxl[xloop] >= ((slice * 255) / slices)));
+                }
+            }
+        }
+
+        bench_start(b);
+        slabgen(mesh, below, above, bm->width, bm->height, slice);
+        bench_stop(b);
+
+        swap = below;
+        below = above;
+        above = swap;
+    }
+
+    b->ops = (uint64_t)(bm->width + 1) * (bm->height + 1) * (slices + 1);
+    b->bytes = mesh->falloc * sizeof(struct facet);
+
+    free(below);
+    free(above);
+    free_mesh(mesh);
+    free_bitmap(bm);
+}
+
+void bench_mesh_gen_slab_mc(struct bench *b)
+{
+    bench_mesh_gen_slab(b, mesh_gen_slab_mc);
+}
+
+void bench_mesh_gen_slab_faces(struct bench *b)
+{
+    bench_mesh_gen_slab(b, mesh_gen_slab_faces);
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * mesh indexing microbenchmarks.
+ *
+ * The module is included directly so its static kernels can be exercised.
+ */
+
+#include "mesh_index.c"
+
+#include "bench.h"
+
+/* maximum number of vertex searches performed by the find_pnt benchmark */
+#define FIND_PNT_SAMPLES 4096
+
+void bench_mesh_bloom_hash(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int floop;
+    uint64_t sink = 0;
+
+    mesh = bench_mesh(b, false);
+
+    bench_start(b);
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        sink ^= mesh_bloom_hash(&mesh->f[floop].v[0]);
+        sink ^= mesh_bloom_hash(&mesh->f[floop].v[1]);
+        sink ^= mesh_bloom_hash(&mesh->f[floop].v[2]);
+    }
+    bench_stop(b);
+
+    b->ops = mesh->fcount * 3;
+
+    /* ensure the hashing is not optimised away */
+    if (sink == 0) {
+        b->bytes++;
+    }
+
+    free_mesh(mesh);
+}
+
+void bench_mesh_bloom_insert(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int floop;
+
+    mesh = bench_mesh(b, false);
+
+    bench_start(b);
+    mesh_bloom_init(mesh, mesh->fcount * 2 * 3, 2 * 2);
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        mesh_bloom_insert(mesh, mesh_bloom_hash(&mesh->f[floop].v[0]));
+        mesh_bloom_insert(mesh, mesh_bloom_hash(&mesh->f[floop].v[1]));
+        mesh_bloom_insert(mesh, mesh_bloom_hash(&mesh->f[floop].v[2]));
+    }
+    bench_stop(b);
+
+    b->ops = mesh->fcount * 3;
+    b->bytes = (mesh->bloom_table_entries + 7) / 8;
+
+    free_mesh(mesh);
+}
+
+void bench_mesh_bloom_query(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int floop;
+    unsigned int hits = 0;
+
+    mesh = bench_mesh(b, false);
+
+    /* only the first vertex of each facet is present so queries are a mix
+     * of hits and misses
+     */
+    mesh_bloom_init(mesh, mesh->fcount * 2 * 3, 2 * 2);
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        mesh_bloom_insert(mesh, mesh_bloom_hash(&mesh->f[floop].v[0]));
+    }
+
+    bench_start(b);
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        hits += mesh_bloom_query(mesh, mesh_bloom_hash(&mesh->f[floop].v[0]));
+        hits += mesh_bloom_query(mesh, mesh_bloom_hash(&mesh->f[floop].v[1]));
+        hits += mesh_bloom_query(mesh, mesh_bloom_hash(&mesh->f[floop].v[2]));
+    }
+    bench_stop(b);
+
+    b->ops = mesh->fcount * 3;
+
+    if (hits == 0) {
+        b->bytes++;
+    }
+
+    free_mesh(mesh);
+}
+
+void bench_find_pnt(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int samples;
+    unsigned int sloop;
+    unsigned int stride;
+    uint32_t sink = 0;
+
+    mesh = bench_mesh(b, true);
+
+    samples = mesh->fcount;
+    if (samples > FIND_PNT_SAMPLES) {
+        samples = FIND_PNT_SAMPLES;
+    }
+    stride = mesh->fcount / samples;
+
+    bench_start(b);
+    for (sloop = 0; sloop < samples; sloop++) {
+        sink += find_pnt(mesh, &mesh->f[sloop * stride].v[sloop % 3]);
+    }
+    bench_stop(b);
+
+    b->ops = samples;
+
+    if (sink == 0) {
+        b->bytes++;
+    }
+
+    free_mesh(mesh);
+}
+
+void bench_remove_facet_from_vertex(struct bench *b)
+{
+    struct mesh *mesh;
+    unsigned int floop;
+
+    mesh = bench_mesh(b, true);
+
+    bench_start(b);
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        remove_facet_from_vertex(mesh, &mesh->f[floop], mesh->f[floop].i[0]);
+        remove_facet_from_vertex(mesh, &mesh->f[floop], mesh->f[floop].i[1]);
+        remove_facet_from_vertex(mesh, &mesh->f[floop], mesh->f[floop].i[2]);
+    }
+    bench_stop(b);
+
+    b->ops = mesh->fcount * 3;
+
+    free_mesh(mesh);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * output writer microbenchmarks.
+ *
+ * The mesh writers are included directly so the per facet output cost can be
+ * measured without the generation and indexing which precedes it. Output
+ * goes to an anonymous temporary file whose final size gives bytes/op.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "out_stl.c"
+#include "out_pscad.c"
+#include "out_3mf.c"
+#include "out_rscad.h"
+#include "out_pgm.h"
+
+#include "bench.h"
+
+typedef bool (meshwriter)(struct mesh *mesh, int fd, options *options);
+typedef bool (bitmapwriter)(bitmap *bm, int fd, options *options);
+
+/* size of the output written to a temporary file */
+static uint64_t bench_out_size(FILE *tmpf)
+{
+    struct stat st;
+
+    if (fstat(fileno(tmpf), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+static void
+bench_out_mesh(struct bench *b, meshwriter *writer, bool indexed)
+{
+    struct mesh *mesh;
+    options *options;
+    FILE *tmpf;
+
+    mesh = bench_mesh(b, indexed);
+    options = bench_options(b);
+    tmpf = tmpfile();
+    if (tmpf == NULL) {
+        free(options);
+        free_mesh(mesh);
+        return;
+    }
+
+    bench_start(b);
+    writer(mesh, fileno(tmpf), options);
+    bench_stop(b);
+
+    b->ops = mesh->fcount;
+    b->bytes = bench_out_size(tmpf);
+
+    fclose(tmpf);
+    free(options);
+    free_mesh(mesh);
+}
+
+static void
+bench_out_bitmap(struct bench *b, bitmapwriter *writer)
+{
+    bitmap *bm;
+    options *options;
+    FILE *tmpf;
+
+    bm = bench_bitmap(b);
+    options = bench_options(b);
+    tmpf = tmpfile();
+    if (tmpf == NULL) {
+        free(options);
+        free_bitmap(bm);
+        return;
+    }
+
+    bench_start(b);
+    writer(bm, fileno(tmpf), options);
+    bench_stop(b);
+
+    b->ops = bm->width * bm->height;
+    b->bytes = bench_out_size(tmpf);
+
+    fclose(tmpf);
+    free(options);
+    free_bitmap(bm);
+}
+
+void bench_out_stl(struct bench *b)
+{
+    bench_out_mesh(b, stl_write_binary, false);
+}
+
+void bench_out_astl(struct bench *b)
+{
+    bench_out_mesh(b, stl_write_ascii, false);
+}
+
+void bench_out_pscad(struct bench *b)
+{
+    bench_out_mesh(b, pscad_write_mesh, true);
+}
+
+void bench_out_3mf(struct bench *b)
+{
+    bench_out_mesh(b, tmf_write_mesh, true);
+}
+
+/* the bitmap writers are reported per pixel rather than per facet */
+void bench_out_rscad(struct bench *b)
+{
+    bench_out_bitmap(b, output_flat_scad_cubes);
+}
+
+void bench_out_pgm(struct bench *b)
+{
+    bench_out_bitmap(b, output_pgm);
+}
+
+void bench_out_bpgm(struct bench *b)
+{
+    bench_out_bitmap(b, output_pgm_binary);
+}
+
+void bench_out_png(struct bench *b)
+{
+    bench_out_bitmap(b, output_png);
+}
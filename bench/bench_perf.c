@@ -0,0 +1,168 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * hardware performance counter collection for the microbenchmarks.
+ *
+ * Uses the Linux perf_event_open interface counting user space events of
+ * the benchmark process only. Each counter is opened independently so an
+ * event the processor or kernel does not support (or which the
+ * perf_event_paranoid setting forbids) simply goes unreported. Values are
+ * scaled if the kernel had to multiplex the counters.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "option.h"
+#include "bitmap.h"
+#include "bench.h"
+
+#ifdef __linux__
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} counter_desc[BENCH_COUNTERS] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "insns", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "llc-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "br-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dtlb-miss", PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+                  PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+};
+
+static int counter_fd[BENCH_COUNTERS] = { -1, -1, -1, -1, -1 };
+
+/* exported interface documented in bench.h */
+bool bench_perf_init(void)
+{
+    struct perf_event_attr attr;
+    unsigned int cloop;
+    bool available = false;
+
+    for (cloop = 0; cloop < BENCH_COUNTERS; cloop++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_desc[cloop].type;
+        attr.config = counter_desc[cloop].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counter_fd[cloop] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counter_fd[cloop] >= 0) {
+            available = true;
+        }
+    }
+
+    return available;
+}
+
+/* exported interface documented in bench.h */
+void bench_perf_fini(void)
+{
+    unsigned int cloop;
+
+    for (cloop = 0; cloop < BENCH_COUNTERS; cloop++) {
+        if (counter_fd[cloop] >= 0) {
+            close(counter_fd[cloop]);
+            counter_fd[cloop] = -1;
+        }
+    }
+}
+
+/* exported interface documented in bench.h */
+const char *bench_perf_name(unsigned int counter)
+{
+    if (counter_fd[counter] < 0) {
+        return NULL;
+    }
+    return counter_desc[counter].name;
+}
+
+/* exported interface documented in bench.h */
+void bench_perf_start(struct bench *b)
+{
+    unsigned int cloop;
+
+    for (cloop = 0; cloop < BENCH_COUNTERS; cloop++) {
+        if (counter_fd[cloop] >= 0) {
+            ioctl(counter_fd[cloop], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter_fd[cloop], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/* exported interface documented in bench.h */
+void bench_perf_stop(struct bench *b)
+{
+    unsigned int cloop;
+    uint64_t val[3]; /* value, time enabled, time running */
+
+    for (cloop = 0; cloop < BENCH_COUNTERS; cloop++) {
+        if (counter_fd[cloop] < 0) {
+            continue;
+        }
+
+        ioctl(counter_fd[cloop], PERF_EVENT_IOC_DISABLE, 0);
+
+        if (read(counter_fd[cloop], val, sizeof(val)) != sizeof(val)) {
+            continue;
+        }
+
+        /* scale for multiplexing */
+        if ((val[2] != 0) && (val[2] < val[1])) {
+            val[0] = (uint64_t)((double)val[0] * val[1] / val[2]);
+        }
+
+        b->counters[cloop] += val[0];
+    }
+}
+
+#else
+
+bool bench_perf_init(void)
+{
+    return false;
+}
+
+void bench_perf_fini(void)
+{
+}
+
+const char *bench_perf_name(unsigned int counter)
+{
+    return NULL;
+}
+
+void bench_perf_start(struct bench *b)
+{
+}
+
+void bench_perf_stop(struct bench *b)
+{
+}
+
+#endif
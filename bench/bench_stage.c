@@ -0,0 +1,248 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * pipeline stage benchmarks.
+ *
+ * Each stage of the conversion is timed as a whole on the synthetic bitmap
+ * so that hardware counters can be attributed to a stage. Operations are
+ * pixels for decode, from png or pgm, generation, outline fitting and the
+ * distance transform and facets for indexing and simplification.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <png.h>
+
+#include "option.h"
+#include "bitmap.h"
+#include "mesh.h"
+#include "mesh_gen.h"
+#include "mesh_index.h"
+#include "mesh_simplify.h"
+#include "outline.h"
+#include "distance.h"
+#include "bench.h"
+
+/* write a bitmap as an 8 bit greyscale png with libpng's default filter
+ * selection so every filter type is exercised
+ */
+static bool bench_write_png(bitmap *bm, const char *filename)
+{
+    FILE *fp;
+    png_structp png_ptr;
+    png_infop info_ptr;
+    uint32_t row_loop;
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = png_create_info_struct(png_ptr);
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_set_IHDR(png_ptr, info_ptr, bm->width, bm->height, 8,
+                 PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        png_write_row(png_ptr, bitmap_pixel(bm, 0, row_loop));
+    }
+    png_write_end(png_ptr, info_ptr);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    fclose(fp);
+
+    return true;
+}
+
+/* write a bitmap as a binary pgm */
+static bool bench_write_pgm(bitmap *bm, const char *filename)
+{
+    FILE *fp;
+    uint32_t row_loop;
+    bool ret = true;
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    fprintf(fp, "P5\n%u %u\n255\n", bm->width, bm->height);
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        if (fwrite(bitmap_pixel(bm, 0, row_loop), 1, bm->width, fp) != bm->width) {
+            ret = false;
+        }
+    }
+
+    fclose(fp);
+
+    return ret;
+}
+
+/* time reading the synthetic bitmap back from a file in a given format */
+static void
+bench_decode(struct bench *b, bool (*writer)(bitmap *bm, const char *filename))
+{
+    bitmap *bm;
+    char filename[] = "/tmp/png23d-benchXXXXXX";
+    int fd;
+
+    fd = mkstemp(filename);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+
+    bm = bench_bitmap(b);
+    if (writer(bm, filename)) {
+        free_bitmap(bm);
+
+        bench_start(b);
+        bm = create_bitmap(filename);
+        bench_stop(b);
+
+        if (bm != NULL) {
+            b->ops = bm->width * bm->height;
+            b->bytes = (size_t)bm->stride * (bm->height + 2);
+        }
+    }
+
+    if (bm != NULL) {
+        free_bitmap(bm);
+    }
+    unlink(filename);
+}
+
+void bench_stage_decode(struct bench *b)
+{
+    bench_decode(b, bench_write_png);
+}
+
+void bench_stage_decode_pgm(struct bench *b)
+{
+    bench_decode(b, bench_write_pgm);
+}
+
+void bench_stage_generate(struct bench *b)
+{
+    bitmap *bm;
+    options *options;
+    struct mesh *mesh;
+
+    bm = bench_bitmap(b);
+    options = bench_options(b);
+    mesh = new_mesh();
+
+    bench_start(b);
+    mesh_from_bitmap(mesh, bm, options);
+    bench_stop(b);
+
+    b->ops = bm->width * bm->height * options->levels;
+    b->bytes = mesh->falloc * sizeof(struct facet);
+
+    free_mesh(mesh);
+    free(options);
+    free_bitmap(bm);
+}
+
+void bench_stage_outline(struct bench *b)
+{
+    bitmap *bm;
+    options *options;
+    struct outline *ol;
+
+    bm = bench_bitmap(b);
+    options = bench_options(b);
+
+    bench_start(b);
+    ol = outline_from_bitmap(bm, options->transparent, 1.0);
+    bench_stop(b);
+
+    b->ops = bm->width * bm->height;
+    if (ol != NULL) {
+        b->bytes = (ol->lalloc * sizeof(struct outline_loop)) +
+                (ol->salloc * sizeof(struct outline_seg));
+        free_outline(ol);
+    }
+
+    free(options);
+    free_bitmap(bm);
+}
+
+void bench_stage_distance(struct bench *b)
+{
+    bitmap *bm;
+    options *options;
+    struct distance *dist;
+
+    bm = bench_bitmap(b);
+    options = bench_options(b);
+
+    bench_start(b);
+    dist = distance_from_bitmap(bm, options->transparent);
+    bench_stop(b);
+
+    b->ops = bm->width * bm->height;
+    if (dist != NULL) {
+        b->bytes = sizeof(float) * dist->width * dist->height;
+        free_distance(dist);
+    }
+
+    free(options);
+    free_bitmap(bm);
+}
+
+void bench_stage_index(struct bench *b)
+{
+    struct mesh *mesh;
+    options *options;
+
+    mesh = bench_mesh(b, false);
+    options = bench_options(b);
+
+    bench_start(b);
+    index_mesh(mesh, options->bloom_complexity, options->vertex_complexity);
+    bench_stop(b);
+
+    b->ops = mesh->fcount;
+    b->bytes = (mesh->valloc *
+                (sizeof(struct vertex) +
+                 (sizeof(struct facet *) * mesh->vertex_fcount))) +
+               ((mesh->bloom_table_entries + 7) / 8);
+
+    free(options);
+    free_mesh(mesh);
+}
+
+void bench_stage_simplify(struct bench *b)
+{
+    struct mesh *mesh;
+    uint32_t start_fcount;
+
+    mesh = bench_mesh(b, true);
+    start_fcount = mesh->fcount;
+
+    bench_start(b);
+    simplify_mesh(mesh, 0, 0);
+    bench_stop(b);
+
+    b->ops = start_fcount;
+
+    free_mesh(mesh);
+}
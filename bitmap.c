@@ -7,7 +7,7 @@
  *
  * This file is part of png23d. 
  * 
- * png to bitmap conversion
+ * png and pnm to bitmap conversion
  */
 
 #include <stdbool.h>
@@ -15,17 +15,361 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <png.h>
+#include <zlib.h>
 
 #include "bitmap.h"
 
+/* exported method documented in bitmap.h */
 bitmap *
-create_bitmap(const char *filename)
+new_bitmap(uint32_t width, uint32_t height)
+{
+    bitmap *bm;
+    size_t len;
+
+    bm = calloc(1, sizeof(bitmap));
+    if (bm == NULL) {
+        return NULL;
+    }
+
+    /* at least one byte of padding per row for the right border */
+    bm->stride = (width + 1 + (BITMAP_ALIGN - 1)) & ~(BITMAP_ALIGN - 1);
+    bm->width = width;
+    bm->height = height;
+
+    /* a row above and below the image and an aligned block in front of the
+     * top row to hold the top left corner
+     */
+    len = BITMAP_ALIGN + ((size_t)bm->stride * (height + 2));
+
+    if (posix_memalign((void **)&bm->alloc, BITMAP_ALIGN, len) != 0) {
+        free(bm);
+        return NULL;
+    }
+
+    bm->data = bm->alloc + BITMAP_ALIGN + bm->stride;
+
+    return bm;
+}
+
+/* exported method documented in bitmap.h */
+void
+bitmap_border(bitmap *bm, uint8_t value)
+{
+    uint32_t row_loop;
+
+    /* everything before the first row, including the row above */
+    memset(bm->alloc, value, bm->data - bm->alloc);
+
+    /* padding after each row, which is also left of the following row */
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        memset(bitmap_pixel(bm, bm->width, row_loop),
+               value,
+               bm->stride - bm->width);
+    }
+
+    /* the row below the image */
+    memset(bitmap_pixel(bm, 0, bm->height), value, bm->stride);
+}
+
+/* exported method documented in bitmap.h */
+bitmap *
+bitmap_pad(bitmap *bm, uint32_t margin, uint8_t value)
+{
+    bitmap *padded;
+    uint32_t row_loop;
+
+    padded = new_bitmap(bm->width + (2 * margin), bm->height + (2 * margin));
+    if (padded == NULL) {
+        return NULL;
+    }
+
+    for (row_loop = 0; row_loop < padded->height; row_loop++) {
+        memset(bitmap_pixel(padded, 0, row_loop), value, padded->width);
+    }
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        memcpy(bitmap_pixel(padded, margin, row_loop + margin),
+               bitmap_pixel(bm, 0, row_loop),
+               bm->width);
+    }
+
+    padded->palette = bm->palette;
+    bm->palette = NULL;
+    free_bitmap(bm);
+
+    return padded;
+}
+
+/** png signature and IHDR chunk, enough to select a decoder */
+#define PNG_HEAD_LEN (8 + 8 + 13 + 4)
+
+/** size of the compressed data buffer used by the fast decoder */
+#define PNG_FAST_INBUF (64 * 1024)
+
+/** png data source which replays the bytes read to select a decoder */
+struct png_src {
+    FILE *fp; /**< input file */
+    const uint8_t *replay; /**< bytes already read from the file */
+    size_t replay_len; /**< number of bytes left to replay */
+};
+
+/** libpng read callback which replays the header before reading the file */
+static void
+png_src_read(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    struct png_src *src = png_get_io_ptr(png_ptr);
+    size_t len;
+
+    len = src->replay_len;
+    if (len > length) {
+        len = length;
+    }
+    memcpy(data, src->replay, len);
+    src->replay += len;
+    src->replay_len -= len;
+
+    if ((len < length) &&
+        (fread(data + len, 1, length - len, src->fp) != (length - len))) {
+        png_error(png_ptr, "Read Error");
+    }
+}
+
+static inline uint32_t
+png_get32(const uint8_t *buf)
+{
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+           ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+/** reverse the png filter on a row of 8 bit greyscale pixels
+ *
+ * With one byte per pixel the Sub, Average and Paeth filters depend on the
+ * previous pixel of the same row so only Up can be vectorised, the others
+ * are kept free of branches.
+ *
+ * @param filter The filter type.
+ * @param row The row to unfilter in place.
+ * @param prev The previous (already unfiltered) row, zero for the first row.
+ * @param width The number of pixels in the row.
+ * @return true on success or false if the filter type is invalid.
+ */
+static bool
+png_unfilter(uint8_t filter, uint8_t *restrict row, const uint8_t *restrict prev, uint32_t width)
+{
+    uint32_t x;
+    int a, b, c; /* left, above and upper left */
+    int p, pa, pb, pc;
+
+    switch (filter) {
+    case 0: /* None */
+        break;
+
+    case 1: /* Sub */
+        for (x = 1; x < width; x++) {
+            row[x] += row[x - 1];
+        }
+        break;
+
+    case 2: /* Up */
+        for (x = 0; x < width; x++) {
+            row[x] += prev[x];
+        }
+        break;
+
+    case 3: /* Average */
+        row[0] += prev[0] >> 1;
+        for (x = 1; x < width; x++) {
+            row[x] += (row[x - 1] + prev[x]) >> 1;
+        }
+        break;
+
+    case 4: /* Paeth */
+        row[0] += prev[0];
+        for (x = 1; x < width; x++) {
+            a = row[x - 1];
+            b = prev[x];
+            c = prev[x - 1];
+
+            p = b - c;
+            pc = a - c;
+            pa = abs(p);
+            pb = abs(pc);
+            pc = abs(p + pc);
+
+            /* nearest of a, b and c with ties in that order */
+            p = (pb < pa) ? b : a;
+            pa = (pb < pa) ? pb : pa;
+            row[x] += (pc < pa) ? c : p;
+        }
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+/** decode the image data of an 8 bit greyscale non interlaced png
+ *
+ * The compressed data is inflated a row at a time directly into the bitmap
+ * with each row's filter type byte landing in the padding at the end of the
+ * row above, so the data is never copied. The file must be positioned after
+ * the IHDR chunk.
+ */
+static bitmap *
+create_bitmap_grey8(FILE *fp, uint32_t width, uint32_t height)
+{
+    bitmap *bm;
+    z_stream strm;
+    uint8_t *inbuf;
+    uint8_t chdr[8]; /* chunk length and type */
+    uint8_t ccrc[4];
+    uint32_t chunk_left = 0; /* image data left in current chunk */
+    uint32_t crc = 0;
+    uint32_t row = 0;
+    size_t len;
+    bool idat_seen = false;
+    int ret;
+
+    bm = new_bitmap(width, height);
+    if (bm == NULL) {
+        return NULL;
+    }
+
+    inbuf = malloc(PNG_FAST_INBUF);
+    if (inbuf == NULL) {
+        free_bitmap(bm);
+        return NULL;
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit(&strm) != Z_OK) {
+        free(inbuf);
+        free_bitmap(bm);
+        return NULL;
+    }
+
+    /* the row above the first is all zero for unfiltering */
+    memset(bitmap_pixel(bm, 0, -1), 0, width);
+
+    strm.next_out = bitmap_pixel(bm, -1, 0);
+    strm.avail_out = width + 1;
+
+    while (row < height) {
+        if (strm.avail_in == 0) {
+            /* move to the next chunk of image data */
+            while (chunk_left == 0) {
+                if (idat_seen) {
+                    if ((fread(ccrc, 1, 4, fp) != 4) ||
+                        (png_get32(ccrc) != crc)) {
+                        goto create_bitmap_grey8_error;
+                    }
+                }
+
+                if (fread(chdr, 1, 8, fp) != 8) {
+                    goto create_bitmap_grey8_error;
+                }
+                chunk_left = png_get32(chdr);
+                crc = crc32(0, chdr + 4, 4);
+
+                if (memcmp(chdr + 4, "IDAT", 4) == 0) {
+                    idat_seen = true;
+                } else if (idat_seen || ((chdr[4] & 0x20) == 0)) {
+                    /* image data ended early or unknown critical chunk */
+                    goto create_bitmap_grey8_error;
+                } else {
+                    /* skip ancillary chunk and its crc */
+                    chunk_left += 4;
+                    while (chunk_left > 0) {
+                        len = (chunk_left < PNG_FAST_INBUF) ? chunk_left : PNG_FAST_INBUF;
+                        if (fread(inbuf, 1, len, fp) != len) {
+                            goto create_bitmap_grey8_error;
+                        }
+                        chunk_left -= len;
+                    }
+                }
+            }
+
+            len = (chunk_left < PNG_FAST_INBUF) ? chunk_left : PNG_FAST_INBUF;
+            if (fread(inbuf, 1, len, fp) != len) {
+                goto create_bitmap_grey8_error;
+            }
+            crc = crc32(crc, inbuf, len);
+            chunk_left -= len;
+
+            strm.next_in = inbuf;
+            strm.avail_in = len;
+        }
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+
+        if (strm.avail_out == 0) {
+            /* row complete */
+            if (!png_unfilter(*bitmap_pixel(bm, -1, row),
+                              bitmap_pixel(bm, 0, row),
+                              bitmap_pixel(bm, 0, row - 1),
+                              width)) {
+                goto create_bitmap_grey8_error;
+            }
+            row++;
+            strm.next_out = bitmap_pixel(bm, -1, row);
+            strm.avail_out = width + 1;
+        } else if (ret == Z_STREAM_END) {
+            /* compressed data ended before the image */
+            goto create_bitmap_grey8_error;
+        } else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+            goto create_bitmap_grey8_error;
+        }
+    }
+
+    inflateEnd(&strm);
+    free(inbuf);
+
+    return bm;
+
+create_bitmap_grey8_error:
+    inflateEnd(&strm);
+    free(inbuf);
+    free_bitmap(bm);
+
+    return NULL;
+}
+
+/** palette colours of a png, unused indexes are black */
+static uint32_t *bitmap_png_palette(png_structp png_ptr, png_infop info_ptr)
+{
+    png_colorp plte;
+    int count = 0;
+    int idx;
+    uint32_t *palette;
+
+    palette = calloc(256, sizeof(uint32_t));
+    if (palette == NULL) {
+        return NULL;
+    }
+
+    png_get_PLTE(png_ptr, info_ptr, &plte, &count);
+    for (idx = 0; (idx < count) && (idx < 256); idx++) {
+        palette[idx] = ((uint32_t)plte[idx].red << 16) |
+                       ((uint32_t)plte[idx].green << 8) |
+                       plte[idx].blue;
+    }
+
+    return palette;
+}
+
+/** decode a png with libpng converting it to 8 bit greyscale
+ *
+ * When indexed is set palette images keep their palette indices.
+ */
+static bitmap *
+create_bitmap_libpng(struct png_src *src, bool indexed)
 {
-    unsigned int hdr_len = 8;
-    FILE *fp; /* input file pointer */
-    png_byte header[hdr_len]; /* input firl header bytes to check it is a png */
     int bit_depth;
     int color_type;
     int interlace_method;
@@ -39,55 +383,37 @@ create_bitmap(const char *filename)
     png_infop end_info; /* png info after decode */
     png_bytep *row_pointers; /* storage for row pointers */
     unsigned int row_loop; /* loop to initialise row pointers */
-    bitmap *bm = NULL;
-
-
-    if (strcmp(filename, "-") == 0) {
-        fp = fdopen(dup(STDIN_FILENO), "rb");
-    } else {
-        fp = fopen(filename, "rb");
-    }
-    if (!fp) {
-        return bm;
-    }
-
-    if (fread(header, 1, hdr_len, fp) != hdr_len) {
-        fclose(fp);
-        return bm;
-    }
-
-    if (png_sig_cmp(header, 0, hdr_len) != 0) {
-        fclose(fp);
-        return bm;
-    }
+    bitmap * volatile bm = NULL; /* volatile as it is set after setjmp */
 
     png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png_ptr) {
-        fclose(fp);
         return bm;
     }
 
     info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr)  {
         png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
-        fclose(fp);
         return bm;
     }
 
     end_info = png_create_info_struct(png_ptr);
     if (!end_info) {
         png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-        fclose(fp);
         return bm;
     }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
+        /* do not return a partially decoded image */
+        if (bm != NULL) {
+            free_bitmap(bm);
+            bm = NULL;
+        }
         goto create_bitmap_error;
     }
 
-    png_init_io(png_ptr, fp);
+    png_set_read_fn(png_ptr, src, png_src_read);
 
-    png_set_sig_bytes(png_ptr, hdr_len);
+    png_set_sig_bytes(png_ptr, 8);
 
     png_read_info(png_ptr, info_ptr);
 
@@ -97,8 +423,13 @@ create_bitmap(const char *filename)
                  &compression_method, &filter_method);
 
     /* set up input filtering */
-    if (color_type == PNG_COLOR_TYPE_PALETTE)
-        png_set_palette_to_rgb(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        if (indexed) {
+            png_set_packing(png_ptr);
+        } else {
+            png_set_palette_to_rgb(png_ptr);
+        }
+    }
 
     if (color_type == PNG_COLOR_TYPE_GRAY &&
         bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png_ptr);
@@ -111,7 +442,7 @@ create_bitmap(const char *filename)
 
     if (color_type == PNG_COLOR_TYPE_RGB ||
         color_type == PNG_COLOR_TYPE_RGB_ALPHA ||
-        color_type == PNG_COLOR_TYPE_PALETTE)
+        (color_type == PNG_COLOR_TYPE_PALETTE && !indexed))
         png_set_rgb_to_gray_fixed(png_ptr, 1, -1, -1);
 
     png_read_update_info(png_ptr, info_ptr);
@@ -122,47 +453,369 @@ create_bitmap(const char *filename)
     if (channels != 1) {
         goto create_bitmap_error;
     }
-    
-    bm = calloc(1, sizeof(bitmap));
+
+    bm = new_bitmap(width, height);
     if (bm == NULL) {
         goto create_bitmap_error;
     }
 
-    bm->data = malloc(width *height);
-    if (bm->data != NULL) {
-        row_pointers = malloc(sizeof(png_bytep) * height);
-        if (row_pointers != NULL) {
-            bm->width = width;
-            bm->height = height;
+    if (indexed && (color_type == PNG_COLOR_TYPE_PALETTE)) {
+        bm->palette = bitmap_png_palette(png_ptr, info_ptr);
+    }
 
-            for (row_loop = 0; row_loop < height; row_loop++) {
-                *(row_pointers + row_loop) = bm->data + (row_loop * width);
+    row_pointers = malloc(sizeof(png_bytep) * height);
+    if (row_pointers != NULL) {
+        for (row_loop = 0; row_loop < height; row_loop++) {
+            *(row_pointers + row_loop) = bitmap_pixel(bm, 0, row_loop);
+        }
+
+        png_read_image(png_ptr, row_pointers);
+
+        png_read_end(png_ptr, end_info);
+
+        free(row_pointers);
+    } else {
+        free_bitmap(bm);
+        bm = NULL;
+    }
+
+create_bitmap_error:
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+
+    return bm;
+}
+
+/** whole input file contents */
+struct input_map {
+    uint8_t *data; /**< file contents */
+    size_t len; /**< length of file contents */
+    bool mapped; /**< contents are mapped rather than allocated */
+};
+
+/** get the whole contents of an input file
+ *
+ * Regular files are mapped so the data is used straight from the page
+ * cache. Anything else, such as a pipe on stdin, is read into memory.
+ *
+ * @param fp The input file.
+ * @param head Bytes already read from the start of the file.
+ * @param head_len The number of bytes already read.
+ * @param map Updated with the file contents.
+ * @return true on success else false.
+ */
+static bool
+map_input(FILE *fp, bool seekable, const uint8_t *head, size_t head_len, struct input_map *map)
+{
+    struct stat st;
+    size_t alloc;
+    size_t rd;
+    uint8_t *ndata;
+
+    if (seekable &&
+        (fstat(fileno(fp), &st) == 0) &&
+        S_ISREG(st.st_mode) &&
+        (st.st_size > 0)) {
+        map->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if (map->data != MAP_FAILED) {
+            madvise(map->data, st.st_size, MADV_SEQUENTIAL);
+            map->len = st.st_size;
+            map->mapped = true;
+            return true;
+        }
+    }
+
+    alloc = 64 * 1024;
+    map->data = malloc(alloc);
+    if (map->data == NULL) {
+        return false;
+    }
+    memcpy(map->data, head, head_len);
+    map->len = head_len;
+    map->mapped = false;
+
+    while ((rd = fread(map->data + map->len, 1, alloc - map->len, fp)) > 0) {
+        map->len += rd;
+        if (map->len == alloc) {
+            alloc *= 2;
+            ndata = realloc(map->data, alloc);
+            if (ndata == NULL) {
+                free(map->data);
+                return false;
             }
+            map->data = ndata;
+        }
+    }
 
-            png_read_image(png_ptr, row_pointers);
-    
-            png_read_end(png_ptr, end_info);
+    return true;
+}
+
+static void
+unmap_input(struct input_map *map)
+{
+    if (map->mapped) {
+        munmap(map->data, map->len);
+    } else {
+        free(map->data);
+    }
+}
+
+/** open an input file, - is stdin */
+static FILE *
+open_input(const char *filename, bool *seekable)
+{
+    if (strcmp(filename, "-") == 0) {
+        *seekable = false;
+        return fdopen(dup(STDIN_FILENO), "rb");
+    }
+    *seekable = true;
+    return fopen(filename, "rb");
+}
+
+/** parse a pnm header field skipping whitespace and comments */
+static const uint8_t *
+pnm_field(const uint8_t *p, const uint8_t *end, uint32_t *val)
+{
+    uint64_t value = 0;
 
-            free(row_pointers);
+    while (p < end) {
+        if (*p == '#') {
+            while ((p < end) && (*p != '\n')) {
+                p++;
+            }
+        } else if ((*p == ' ') || (*p == '\t') ||
+                   (*p == '\r') || (*p == '\n')) {
+            p++;
         } else {
-            free(bm->data);
-            free(bm);
-            bm = NULL;
+            break;
         }
     }
 
-create_bitmap_error:
+    if ((p == end) || (*p < '0') || (*p > '9')) {
+        return NULL;
+    }
 
-    png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+    while ((p < end) && (*p >= '0') && (*p <= '9')) {
+        value = (value * 10) + (*p - '0');
+        if (value > 0xffffffff) {
+            return NULL;
+        }
+        p++;
+    }
+
+    *val = value;
+
+    return p;
+}
+
+/** create a bitmap from a binary pgm (P5) or ppm (P6) image
+ *
+ * Samples are scaled to 8 bits and colour is converted to grey with the
+ * same weights libpng uses for png input.
+ */
+static bitmap *
+create_bitmap_pnm(const struct input_map *map)
+{
+    const uint8_t *p;
+    const uint8_t *end = map->data + map->len;
+    uint32_t width;
+    uint32_t height;
+    uint32_t maxval;
+    unsigned int channels;
+    unsigned int bps; /* bytes per sample */
+    uint32_t row_loop;
+    uint32_t col_loop;
+    uint32_t sample[3];
+    unsigned int cloop;
+    uint8_t *row;
+    bitmap *bm;
+
+    channels = (map->data[1] == '6') ? 3 : 1;
+
+    p = pnm_field(map->data + 2, end, &width);
+    if (p != NULL) {
+        p = pnm_field(p, end, &height);
+    }
+    if (p != NULL) {
+        p = pnm_field(p, end, &maxval);
+    }
+    /* a single whitespace character separates the header from the data */
+    if ((p == NULL) || (p == end) ||
+        ((*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n')) ||
+        (width == 0) || (width >= 0x10000000) ||
+        (height == 0) || (height >= 0x10000000) ||
+        (maxval == 0) || (maxval > 65535)) {
+        return NULL;
+    }
+    p++;
+
+    bps = (maxval > 255) ? 2 : 1;
+
+    if ((size_t)(end - p) < ((size_t)width * height * channels * bps)) {
+        return NULL;
+    }
+
+    bm = new_bitmap(width, height);
+    if (bm == NULL) {
+        return NULL;
+    }
+
+    for (row_loop = 0; row_loop < height; row_loop++) {
+        row = bitmap_pixel(bm, 0, row_loop);
+
+        if ((channels == 1) && (maxval == 255)) {
+            /* native layout needs only copying */
+            memcpy(row, p, width);
+            p += width;
+            continue;
+        }
+
+        for (col_loop = 0; col_loop < width; col_loop++) {
+            for (cloop = 0; cloop < channels; cloop++) {
+                if (bps == 2) {
+                    sample[cloop] = (p[0] << 8) | p[1];
+                } else {
+                    sample[cloop] = p[0];
+                }
+                p += bps;
+                if (sample[cloop] > maxval) {
+                    /* cannot be scaled to 8 bits */
+                    free_bitmap(bm);
+                    return NULL;
+                }
+                sample[cloop] = ((sample[cloop] * 255) + (maxval / 2)) / maxval;
+            }
+
+            if (channels == 3) {
+                /* ITU-R BT.709 weights scaled by 32768 */
+                row[col_loop] = ((6968 * sample[0]) +
+                                 (23434 * sample[1]) +
+                                 (2366 * sample[2]) + 16384) >> 15;
+            } else {
+                row[col_loop] = sample[0];
+            }
+        }
+    }
+
+    return bm;
+}
+
+/* exported method documented in bitmap.h */
+bitmap *
+create_bitmap_raw(const char *filename, uint32_t width, uint32_t height)
+{
+    FILE *fp;
+    bool seekable;
+    struct input_map map;
+    uint32_t row_loop;
+    bitmap *bm = NULL;
+
+    fp = open_input(filename, &seekable);
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    if (map_input(fp, seekable, NULL, 0, &map)) {
+        if (map.len >= ((size_t)width * height)) {
+            bm = new_bitmap(width, height);
+        }
+        if (bm != NULL) {
+            for (row_loop = 0; row_loop < height; row_loop++) {
+                memcpy(bitmap_pixel(bm, 0, row_loop),
+                       map.data + ((size_t)row_loop * width),
+                       width);
+            }
+        }
+        unmap_input(&map);
+    }
+
+    fclose(fp);
+
+    return bm;
+}
+
+/* read a bitmap from a file
+ *
+ * 8 bit greyscale non interlaced images, which need no conversion, are
+ * decoded directly with zlib. Every other png goes through libpng.
+ */
+static bitmap *
+read_bitmap(const char *filename, bool indexed)
+{
+    FILE *fp; /* input file pointer */
+    bool seekable;
+    uint8_t head[PNG_HEAD_LEN]; /* signature and IHDR chunk */
+    size_t head_len;
+    struct png_src src;
+    struct input_map map;
+    bitmap *bm;
+
+    fp = open_input(filename, &seekable);
+    if (!fp) {
+        return NULL;
+    }
+
+    head_len = fread(head, 1, PNG_HEAD_LEN, fp);
+
+    if ((head_len >= 3) && (head[0] == 'P') &&
+        ((head[1] == '5') || (head[1] == '6'))) {
+        /* binary pgm or ppm */
+        bm = NULL;
+        if (map_input(fp, seekable, head, head_len, &map)) {
+            bm = create_bitmap_pnm(&map);
+            unmap_input(&map);
+        }
+        fclose(fp);
+        return bm;
+    }
+
+    if ((head_len < 8) || (png_sig_cmp(head, 0, 8) != 0)) {
+        fclose(fp);
+        return NULL;
+    }
+
+    if ((head_len == PNG_HEAD_LEN) &&
+        (png_get32(head + 8) == 13) &&
+        (memcmp(head + 12, "IHDR", 4) == 0) &&
+        (png_get32(head + 29) == crc32(0, head + 12, 17)) &&
+        (png_get32(head + 16) > 0) && (png_get32(head + 16) < 0x10000000) &&
+        (png_get32(head + 20) > 0) && (png_get32(head + 20) < 0x10000000) &&
+        (head[24] == 8) && /* bit depth */
+        (head[25] == PNG_COLOR_TYPE_GRAY) &&
+        (head[26] == 0) && /* compression method */
+        (head[27] == 0) && /* filter method */
+        (head[28] == PNG_INTERLACE_NONE)) {
+        bm = create_bitmap_grey8(fp, png_get32(head + 16), png_get32(head + 20));
+    } else {
+        src.fp = fp;
+        src.replay = head + 8;
+        src.replay_len = head_len - 8;
+        bm = create_bitmap_libpng(&src, indexed);
+    }
 
     fclose(fp);
 
     return bm;
 }
 
+/* exported method documented in bitmap.h */
+bitmap *
+create_bitmap(const char *filename)
+{
+    return read_bitmap(filename, false);
+}
+
+/* exported method documented in bitmap.h */
+bitmap *
+create_bitmap_indexed(const char *filename)
+{
+    return read_bitmap(filename, true);
+}
+
 void
 free_bitmap(bitmap *bm)
 {
-    free(bm->data);
+    free(bm->palette);
+    free(bm->alloc);
     free(bm);
 }
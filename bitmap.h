@@ -12,15 +12,81 @@
 #ifndef PNG23D_BITMAP_H
 #define PNG23D_BITMAP_H 1
 
-/** 8bpp greyscale bitmap representation of image */
+#include <stddef.h>
+
+/** Alignment in bytes of each bitmap row */
+#define BITMAP_ALIGN 32
+
+/** 8bpp greyscale bitmap representation of image
+ *
+ * The image is surrounded by a border at least one pixel wide so the
+ * neighbours of every pixel, including diagonals, may be read without
+ * bounds checks. Each row starts on a BITMAP_ALIGN boundary, the pixel left
+ * of a row's first pixel is the last padding byte of the row above.
+ */
 typedef struct bitmap {
-    uint8_t *data; /**< bitmap data */
+    uint8_t *data; /**< bitmap data, the first pixel of the first row */
     uint32_t width; /**< width of data */
     uint32_t height; /**< height of data */
+    uint32_t stride; /**< bytes between the start of each row */
+    uint8_t *alloc; /**< allocation holding data and its border */
+    uint32_t *palette; /**< 0xRRGGBB colour of each index or NULL if not indexed */
 } bitmap;
 
+/** pointer to a pixel, x and y may be -1 or one past the last pixel */
+static inline uint8_t *
+bitmap_pixel(bitmap *bm, int x, int y)
+{
+    return bm->data + ((ptrdiff_t)y * bm->stride) + x;
+}
+
+/** create an empty bitmap
+ *
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @return The new bitmap with image and border undefined or NULL on error.
+ */
+bitmap *new_bitmap(uint32_t width, uint32_t height);
+
+/** create a bitmap from a png, binary pgm (P5) or binary ppm (P6) file
+ *
+ * @param filename The file to read or - for stdin.
+ * @return The new bitmap or NULL on error.
+ */
 bitmap *create_bitmap(const char *filename);
 
+/** create a bitmap holding palette indices
+ *
+ * Palette pngs keep the palette index of each pixel instead of being
+ * converted to grey and the palette colours are kept with the bitmap.
+ * Other images are read as for create_bitmap.
+ *
+ * @param filename The file to read or - for stdin.
+ * @return The new bitmap or NULL on error.
+ */
+bitmap *create_bitmap_indexed(const char *filename);
+
+/** create a bitmap from a headerless 8 bit greyscale file
+ *
+ * @param filename The file to read or - for stdin.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @return The new bitmap or NULL on error.
+ */
+bitmap *create_bitmap_raw(const char *filename, uint32_t width, uint32_t height);
+
+/** set every pixel of the border around the image to a value */
+void bitmap_border(bitmap *bm, uint8_t value);
+
+/** surround the image with a margin of pixels
+ *
+ * @param bm The bitmap, which is freed on success.
+ * @param margin The number of pixels to add on each side.
+ * @param value The value of the added pixels.
+ * @return The larger bitmap or NULL on memory exhaustion.
+ */
+bitmap *bitmap_pad(bitmap *bm, uint32_t margin, uint8_t value);
+
 void free_bitmap(bitmap *bm);
 
 #endif
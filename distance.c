@@ -0,0 +1,341 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Euclidean distance transform of the opaque area of a bitmap.
+ *
+ * The separable transform of Felzenszwalb and Huttenlocher is used. A pass
+ * down the image and one back up find, for every pixel, the vertical
+ * distance to the nearest pixel of the other kind in its column. Each row
+ * is then transformed on its own: the squared distance at a pixel is the
+ * lowest of the parabolas rooted at every pixel of the row and raised by
+ * that pixel's squared vertical distance, and the lower envelope of those
+ * parabolas is built and read back in a single sweep. Both passes touch
+ * rows in order and rows of the second pass are independent of each other,
+ * so runs of rows are transformed on separate threads.
+ *
+ * Distances to transparent pixels, for opaque pixels, and to opaque
+ * pixels, for transparent ones, are found together. The vertical distances
+ * are held in the output as the same signed values, so a pixel holds the
+ * one distance it needs until the row pass replaces it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "bitmap.h"
+#include "distance.h"
+#include "trace.h"
+
+/** workspace for the transform of one row */
+struct distance_row {
+    unsigned int n; /**< number of sites, the row and a border pixel each side */
+    double *f; /**< height of the parabola at each site, negative for none */
+    double *d; /**< squared distance at each site */
+    unsigned int *v; /**< sites of the parabolas in the lower envelope */
+    double *z; /**< boundaries between the envelope parabolas */
+};
+
+/* squared distance at each site to the lower envelope of the parabolas */
+static void distance_envelope(struct distance_row *row)
+{
+    const double *f = row->f;
+    unsigned int *v = row->v;
+    double *z = row->z;
+    unsigned int q;
+    int k = -1; /* last parabola of the envelope */
+    double s;
+
+    for (q = 0; q < row->n; q++) {
+        if (f[q] < 0) {
+            continue;
+        }
+
+        /* drop parabolas hidden by the new one */
+        while (k >= 0) {
+            s = ((f[q] + ((double)q * q)) -
+                 (f[v[k]] + ((double)v[k] * v[k]))) /
+                (2.0 * ((double)q - v[k]));
+            if (s > z[k]) {
+                break;
+            }
+            k--;
+        }
+
+        k++;
+        v[k] = q;
+        z[k] = (k == 0) ? -HUGE_VAL : s;
+        z[k + 1] = HUGE_VAL;
+    }
+
+    if (k < 0) {
+        /* no sites */
+        for (q = 0; q < row->n; q++) {
+            row->d[q] = HUGE_VAL;
+        }
+        return;
+    }
+
+    k = 0;
+    for (q = 0; q < row->n; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        row->d[q] = (((double)q - v[k]) * ((double)q - v[k])) + f[v[k]];
+    }
+}
+
+/* vertical distances down the image and then back up */
+static void distance_columns(struct distance *dist, bitmap *bm, unsigned int transparent)
+{
+    float big = dist->width + dist->height + 2; /* beyond any pixel */
+    float *out;
+    const float *prev;
+    const uint8_t *pxl;
+    unsigned int x;
+    unsigned int y;
+    float g;
+    float p;
+
+    /* opaque pixels hold the distance to a transparent pixel, transparent
+     * ones its negative to an opaque pixel. The border is transparent and
+     * has no opaque pixel above or below.
+     */
+    for (y = 0; y < dist->height; y++) {
+        out = distance_row(dist, y);
+        prev = (y > 0) ? distance_row(dist, y - 1) : NULL;
+        pxl = bitmap_pixel(bm, 0, y);
+        for (x = 0; x < dist->width; x++) {
+            p = (prev != NULL) ? prev[x] : -big;
+            if (pxl[x] != transparent) {
+                out[x] = ((p > 0) ? p : 0) + 1;
+            } else {
+                g = (p < 0) ? (-p + 1) : 1;
+                out[x] = -((g < big) ? g : big);
+            }
+        }
+    }
+
+    for (y = dist->height; y-- > 0;) {
+        out = distance_row(dist, y);
+        prev = (y < (dist->height - 1)) ? distance_row(dist, y + 1) : NULL;
+        for (x = 0; x < dist->width; x++) {
+            p = (prev != NULL) ? prev[x] : -big;
+            if (out[x] > 0) {
+                g = ((p > 0) ? p : 0) + 1;
+                if (g < out[x]) {
+                    out[x] = g;
+                }
+            } else {
+                g = (p < 0) ? (-p + 1) : 1;
+                if (-g > out[x]) {
+                    out[x] = -g;
+                }
+            }
+        }
+    }
+}
+
+/* replace the vertical distances of a row with signed distances */
+static void distance_row_transform(struct distance_row *row, float *out, float big)
+{
+    unsigned int width = row->n - 2;
+    unsigned int x;
+    float g;
+
+    /* distance of opaque pixels to the transparent pixels, which include
+     * the border each side
+     */
+    row->f[0] = 0;
+    row->f[width + 1] = 0;
+    for (x = 0; x < width; x++) {
+        g = out[x];
+        row->f[x + 1] = (g > 0) ? ((double)g * g) : 0;
+    }
+    distance_envelope(row);
+    for (x = 0; x < width; x++) {
+        if (out[x] > 0) {
+            out[x] = sqrt(row->d[x + 1]) - 0.5;
+        }
+    }
+
+    /* distance of transparent pixels to the opaque pixels, columns without
+     * an opaque pixel are not sites
+     */
+    row->f[0] = -1;
+    row->f[width + 1] = -1;
+    for (x = 0; x < width; x++) {
+        g = out[x];
+        if (g > 0) {
+            row->f[x + 1] = 0;
+        } else if (g > -big) {
+            row->f[x + 1] = (double)g * g;
+        } else {
+            row->f[x + 1] = -1;
+        }
+    }
+    distance_envelope(row);
+    for (x = 0; x < width; x++) {
+        if (out[x] < 0) {
+            if (row->d[x + 1] < ((double)big * big)) {
+                out[x] = 0.5 - sqrt(row->d[x + 1]);
+            } else {
+                out[x] = -big;
+            }
+        }
+    }
+}
+
+/** most threads transforming rows at the same time */
+#define DISTANCE_THREADS_MAX 16
+
+/** fewest rows worth giving a thread of its own */
+#define DISTANCE_THREAD_ROWS 32
+
+/** a run of rows transformed by one thread with its own workspace */
+struct distance_job {
+    pthread_t thread;
+    bool started; /**< a thread was created for the job */
+    struct distance *dist;
+    struct distance_row row; /**< workspace of the job */
+    unsigned int first; /**< first row of the run */
+    unsigned int last; /**< row after the run */
+};
+
+static bool distance_row_init(struct distance_row *row, unsigned int width)
+{
+    row->n = width + 2;
+    row->f = malloc(sizeof(double) * row->n);
+    row->d = malloc(sizeof(double) * row->n);
+    row->v = malloc(sizeof(unsigned int) * row->n);
+    row->z = malloc(sizeof(double) * (row->n + 1));
+
+    return ((row->f != NULL) && (row->d != NULL) &&
+            (row->v != NULL) && (row->z != NULL));
+}
+
+static void distance_row_fini(struct distance_row *row)
+{
+    free(row->f);
+    free(row->d);
+    free(row->v);
+    free(row->z);
+}
+
+static void *distance_rows_thread(void *ctx)
+{
+    struct distance_job *job = ctx;
+    struct distance *dist = job->dist;
+    unsigned int y;
+
+    trace_begin("distance rows %u-%u", job->first, job->last - 1);
+    for (y = job->first; y < job->last; y++) {
+        distance_row_transform(&job->row, distance_row(dist, y),
+                               dist->width + dist->height + 2);
+    }
+    trace_end();
+
+    return NULL;
+}
+
+/** number of threads to transform the rows with */
+static unsigned int distance_threads(unsigned int height)
+{
+    long cpus;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > DISTANCE_THREADS_MAX) {
+        cpus = DISTANCE_THREADS_MAX;
+    }
+    if (cpus > (long)(height / DISTANCE_THREAD_ROWS)) {
+        cpus = height / DISTANCE_THREAD_ROWS;
+    }
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    return cpus;
+}
+
+/* exported method documented in distance.h
+ *
+ * The rows are split into runs, one for each thread, which are transformed
+ * concurrently. The last run is transformed on the calling thread and a run
+ * whose thread cannot be created is transformed serially.
+ */
+struct distance *distance_from_bitmap(bitmap *bm, unsigned int transparent)
+{
+    struct distance *dist;
+    struct distance_job job[DISTANCE_THREADS_MAX];
+    unsigned int threads;
+    unsigned int jloop;
+    bool ok = true;
+
+    dist = calloc(1, sizeof(struct distance));
+    if (dist == NULL) {
+        return NULL;
+    }
+    dist->width = bm->width;
+    dist->height = bm->height;
+
+    threads = distance_threads(bm->height);
+    memset(job, 0, sizeof(job));
+    for (jloop = 0; jloop < threads; jloop++) {
+        job[jloop].dist = dist;
+        job[jloop].first = (bm->height * jloop) / threads;
+        job[jloop].last = (bm->height * (jloop + 1)) / threads;
+        if (!distance_row_init(&job[jloop].row, bm->width)) {
+            ok = false;
+        }
+    }
+
+    dist->d = malloc(sizeof(float) * bm->width * bm->height);
+    if ((dist->d == NULL) || !ok) {
+        for (jloop = 0; jloop < threads; jloop++) {
+            distance_row_fini(&job[jloop].row);
+        }
+        free(dist->d);
+        free(dist);
+        return NULL;
+    }
+
+    trace_begin("distance columns");
+    distance_columns(dist, bm, transparent);
+    trace_end();
+
+    trace_begin("distance rows");
+    for (jloop = 0; jloop < (threads - 1); jloop++) {
+        job[jloop].started = (pthread_create(&job[jloop].thread, NULL,
+                                             distance_rows_thread,
+                                             &job[jloop]) == 0);
+    }
+    for (jloop = 0; jloop < threads; jloop++) {
+        if (!job[jloop].started) {
+            distance_rows_thread(&job[jloop]);
+        }
+    }
+    for (jloop = 0; jloop < threads; jloop++) {
+        if (job[jloop].started) {
+            pthread_join(job[jloop].thread, NULL);
+        }
+        distance_row_fini(&job[jloop].row);
+    }
+    trace_end();
+
+    return dist;
+}
+
+/* exported method documented in distance.h */
+void free_distance(struct distance *dist)
+{
+    free(dist->d);
+    free(dist);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * bitmap distance field header.
+ */
+
+#ifndef PNG23D_DISTANCE_H
+#define PNG23D_DISTANCE_H 1
+
+/** signed euclidean distance field of the opaque area of a bitmap
+ *
+ * Each value is the distance in pixels from a pixel centre to the outline
+ * following the pixel edges, positive within the opaque area and negative
+ * outside it. The value is measured to the centre of the nearest pixel of
+ * the other kind less half a pixel, so the outline lies where the field
+ * crosses zero between neighbouring pixels. Everything beyond the image is
+ * transparent.
+ */
+struct distance {
+    uint32_t width; /**< width of the field */
+    uint32_t height; /**< height of the field */
+    float *d; /**< distance at each pixel, row by row */
+};
+
+/** pointer to the first value of a row of a distance field */
+static inline float *
+distance_row(struct distance *dist, uint32_t y)
+{
+    return dist->d + ((size_t)y * dist->width);
+}
+
+/** smallest magnitude of a grown field value */
+#define DISTANCE_OFFSET_MIN (1.0f / 1024)
+
+/** value of a distance field grown by an offset
+ *
+ * Beyond the image the field falls away by a pixel for each pixel
+ * outside. Values closer to zero than DISTANCE_OFFSET_MIN are moved out
+ * to it, zero becoming negative, so contours never pass through or
+ * within rounding of a pixel centre.
+ *
+ * @param dist The distance field.
+ * @param x The column, which may be outside the image.
+ * @param y The row, which may be outside the image.
+ * @param offset The distance in pixels to grow by, negative to shrink.
+ * @return The grown value, positive within the grown area.
+ */
+static inline float
+distance_offset_at(struct distance *dist, int x, int y, float offset)
+{
+    float outside = 0;
+    float value;
+
+    if (x < 0) {
+        outside -= x;
+        x = 0;
+    } else if ((uint32_t)x >= dist->width) {
+        outside += x - (int)dist->width + 1;
+        x = dist->width - 1;
+    }
+    if (y < 0) {
+        outside -= y;
+        y = 0;
+    } else if ((uint32_t)y >= dist->height) {
+        outside += y - (int)dist->height + 1;
+        y = dist->height - 1;
+    }
+
+    value = distance_row(dist, y)[x] + offset - outside;
+    if (value > 0) {
+        if (value < DISTANCE_OFFSET_MIN) {
+            value = DISTANCE_OFFSET_MIN;
+        }
+    } else if (value > -DISTANCE_OFFSET_MIN) {
+        value = -DISTANCE_OFFSET_MIN;
+    }
+    return value;
+}
+
+/** compute the signed distance field of the opaque area of a bitmap
+ *
+ * The exact euclidean distance transform is computed in time linear in
+ * the number of pixels with a pass down the columns and a lower envelope
+ * of parabolas along each row.
+ *
+ * @param bm The bitmap.
+ * @param transparent The transparent pixel value, 256 for none.
+ * @return The distance field or NULL on memory exhaustion.
+ */
+struct distance *distance_from_bitmap(bitmap *bm, unsigned int transparent);
+
+/** free a distance field */
+void free_distance(struct distance *dist);
+
+#endif
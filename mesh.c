@@ -24,6 +24,7 @@
 #include "mesh_index.h"
 #include "mesh_simplify.h"
 #include "mesh_math.h"
+#include "meshlog.h"
 
 void
 debug_mesh_init(struct mesh *mesh, const char* filename)
@@ -31,58 +32,23 @@ debug_mesh_init(struct mesh *mesh, const char* filename)
     if (filename == NULL)
         return;
 
-    mesh->dumpfile = fopen(filename, "w");
-
-    if (mesh->dumpfile == NULL)
-        return;
-
-    fprintf(mesh->dumpfile,"<html>\n<body>");
-
+    /* the header is written with the first snapshot once the mesh
+     * dimensions are known
+     */
+    mesh->dumpfile = fopen(filename, "wb");
 }
 
 static void
-debug_mesh_fini(struct mesh *mesh, unsigned int start)
+debug_mesh_fini(struct mesh *mesh)
 {
-    unsigned int floop;
-    struct vertex *v0 = vertex_from_index(mesh, start);
-
     if (mesh->dumpfile == NULL)
         return;
 
-    fprintf(mesh->dumpfile, "<h2>Final mesh</h2>");
-
-    fprintf(mesh->dumpfile,
-            "<p>Final mesh had %d facets and %d vertexes.</p>\n",
-            mesh->fcount, mesh->vcount);
-
-    fprintf(mesh->dumpfile,"<p>Mesh of all facets with common normal</p>\n<svg width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n", DUMP_SVG_SIZE, DUMP_SVG_SIZE);
-
-    for (floop = 0; floop < mesh->fcount; floop++) {
-        if (same_normal(&mesh->f[floop].n, &v0->facets[0]->n)) {
-
-            fprintf(mesh->dumpfile,
-                    "<polygon points=\"%.1f,%.1f %.1f,%.1f %.1f,%.1f\" style=\"fill:lime;stroke:black;stroke-width=1\"/>\n",
-                    SVGPX(mesh->f[floop].v[0].x), SVGPY(mesh->f[floop].v[0].y),
-                    SVGPX(mesh->f[floop].v[1].x), SVGPY(mesh->f[floop].v[1].y),
-                    SVGPX(mesh->f[floop].v[2].x), SVGPY(mesh->f[floop].v[2].y));
-
-            /* label facet at centroid */
-            fprintf(mesh->dumpfile,
-                    "<text x=\"%.1f\" y=\"%.1f\" fill=\"blue\">%u</text>\n",
-                    (SVGPX(mesh->f[floop].v[0].x) +
-                     SVGPX(mesh->f[floop].v[1].x) +
-                     SVGPX(mesh->f[floop].v[2].x)) / 3,
-                    (SVGPY(mesh->f[floop].v[0].y) +
-                     SVGPY(mesh->f[floop].v[1].y) +
-                     SVGPY(mesh->f[floop].v[2].y)) / 3,
-                    floop);
-
-
-        }
+    /* ensure the log holds at least the final mesh */
+    if (!mesh->dumphdr) {
+        meshlog_snapshot(mesh);
     }
 
-    fprintf(mesh->dumpfile,"</body>\n</html>\n");
-
     fclose(mesh->dumpfile);
 
     mesh->dumpfile = NULL;
@@ -105,10 +71,41 @@ struct mesh *new_mesh(void)
 /* exported method documented in mesh.h */
 void free_mesh(struct mesh *mesh)
 {
-    debug_mesh_fini(mesh, 4);
+    debug_mesh_fini(mesh);
     free(mesh->bloom_table);
+    free(mesh->v);
     free(mesh->f);
+    free(mesh);
 }
 
+/* exported method documented in mesh.h */
+uint32_t *mesh_body_order(struct mesh *mesh, uint32_t bstart[257])
+{
+    uint32_t *order;
+    uint32_t next[256];
+    uint32_t floop;
+    unsigned int body;
+
+    order = malloc((mesh->fcount + 1) * sizeof(uint32_t));
+    if (order == NULL) {
+        return NULL;
+    }
 
+    /* counting sort on the body */
+    memset(next, 0, sizeof(next));
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        next[mesh->f[floop].body]++;
+    }
 
+    bstart[0] = 0;
+    for (body = 0; body < 256; body++) {
+        bstart[body + 1] = bstart[body] + next[body];
+        next[body] = bstart[body];
+    }
+
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        order[next[mesh->f[floop].body]++] = floop;
+    }
+
+    return order;
+}
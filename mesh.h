@@ -25,6 +25,52 @@ typedef struct pnt {
 } pnt;
 
 
+/** Number of bits in each bloom filter block, one cache line */
+#define BLOOM_BLOCK_BITS 512
+
+/** Number of 64 bit words in each bloom filter block */
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+
+/** Number of vertex valence histogram buckets, the last bucket includes all
+ * greater valencies.
+ */
+#define VALENCE_BUCKETS 33
+
+/** Number of simplification passes which have individual timing */
+#define SIMPLIFY_TIMED_PASSES 8
+
+/** reason mesh simplification stopped */
+enum simplify_stop {
+    SIMPLIFY_COMPLETE = 0, /**< every vertex was examined */
+    SIMPLIFY_DEADLINE, /**< the time limit was reached */
+    SIMPLIFY_TARGET, /**< the target facet count was reached */
+};
+
+/** mesh simplification statistics */
+struct simplify_stats {
+    enum simplify_stop stop; /**< why simplification stopped */
+    unsigned int examined; /**< vertices examined */
+    unsigned int passes; /**< number of passes over the vertex list */
+    unsigned int merges; /**< number of edges collapsed */
+    unsigned int crease_merges; /**< collapses removing a crease vertex */
+    unsigned int facets_removed; /**< facets removed by edge collapse */
+    unsigned int facets_moved; /**< facets moved to a new vertex */
+
+    /* reasons an adjacent vertex was rejected for merging */
+    unsigned int reject_candidate; /**< vertex not flat or straight crease */
+    unsigned int reject_complexity; /**< merge would exceed vertex_fcount */
+    unsigned int reject_degenerate; /**< move would create degenerate facet */
+    unsigned int reject_normal; /**< move would change a facet normal */
+    unsigned int reject_index; /**< facet index inconsistent with vertex */
+
+    uint64_t pass_time[SIMPLIFY_TIMED_PASSES]; /**< time per pass in ns */
+
+    /** vertex valence (facet count) before simplification */
+    unsigned int valence_before[VALENCE_BUCKETS];
+    /** vertex valence (facet count) after simplification */
+    unsigned int valence_after[VALENCE_BUCKETS];
+};
+
 /** A indexed vertex */
 typedef unsigned int idxvtx;
 
@@ -36,6 +82,7 @@ struct facet {
     pnt n; /**< surface normal */
     pnt v[3]; /**< triangle vertices */
     idxvtx i[3]; /** triangle indexed vertices */
+    uint8_t body; /**< body the facet belongs to */
 };
 
 /** An indexed vertex within the mesh. */
@@ -60,13 +107,17 @@ struct mesh {
     /* mesh parameters */
     uint32_t width; /**< conversion source width */
     uint32_t height; /**< conversion source height */
+    bool multibody; /**< facets belong to separate bodies */
+    uint8_t body; /**< body newly generated facets belong to */
+    uint32_t body_colour[256]; /**< 0xRRGGBB display colour of each body */
 
     /* indexing parameters */
     unsigned int vertex_fcount; /* number of facets a vertex can belong to */
 
     /* bloom filter */
-    uint8_t *bloom_table; /**< table for bloom filter */
+    uint64_t *bloom_table; /**< table of blocks for bloom filter */
     unsigned int bloom_table_entries; /**< Number of entries (bits) it bloom */
+    uint32_t bloom_block_mask; /**< number of blocks less one */
     /** number of times the hash is applied with a differnt salt value
      * (sometimes referred to as the number of functions)
      */
@@ -77,10 +128,13 @@ struct mesh {
     unsigned int bloom_miss; /**< number of times the bloom filter missed */
     unsigned int find_count; /**< number of vertex lookups */
     int64_t find_cost; /**< number of comparisons in vertex lookups */
+    struct simplify_stats simplify; /**< simplification statistics */
 
     /* debug */
-    int dumpno;
-    FILE *dumpfile;
+    int dumpno; /**< operation number in debug log */
+    FILE *dumpfile; /**< debug event log */
+    bool dumphdr; /**< debug log header has been written */
+    size_t dumpbytes; /**< debug log bytes since last snapshot */
 
 };
 
@@ -90,6 +144,19 @@ struct mesh *new_mesh(void);
 /** free mesh and all resources it holds */
 void free_mesh(struct mesh *mesh);
 
+/** order the facets of a mesh by body
+ *
+ * The mesh is not altered so the order may be taken while vertex facet
+ * lists are in use. Facets of each body keep their relative order.
+ *
+ * @param mesh The mesh to order.
+ * @param bstart Updated with the index in the order of the first facet of
+ *               each body, bstart[256] is the facet count.
+ * @return Facet indices ordered by body or NULL on memory exhaustion, the
+ *         caller must free it.
+ */
+uint32_t *mesh_body_order(struct mesh *mesh, uint32_t bstart[257]);
+
 /** initialise debugging on mesh */
 void debug_mesh_init(struct mesh *mesh, const char* filename);
 
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to simplify meshes by vertex clustering.
+ *
+ * Space is divided into a grid of cells and every vertex within a cell is
+ * replaced by the mean location of all the vertices in that cell. Facets
+ * which become degenerate are discarded. This is linear in the number of
+ * facets (one pass to accumulate the cells and one to rewrite the facets)
+ * and needs no vertex index, which makes it suitable for quick previews of
+ * very large meshes. Unlike edge removal it does not preserve the exact
+ * geometry.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "option.h"
+#include "mesh.h"
+#include "mesh_math.h"
+#include "mesh_cluster.h"
+#include "trace.h"
+
+/** a grid cell */
+struct cell {
+    int32_t x; /**< cell x index */
+    int32_t y; /**< cell y index */
+    int32_t z; /**< cell z index */
+    uint32_t count; /**< number of vertices in cell, 0 if unused */
+    pnt sum; /**< sum of vertex locations (becomes the mean) */
+};
+
+/** grid cell hash table */
+struct cluster {
+    struct cell *cells;
+    uint32_t mask; /**< table size - 1, table size is a power of two */
+    uint32_t used; /**< number of occupied cells */
+    float xycell;
+    float zcell;
+};
+
+/* find (or create) the cell a point lies within */
+static struct cell *
+cluster_cell(struct cluster *cluster, pnt *p)
+{
+    int32_t x = floorf(p->x / cluster->xycell);
+    int32_t y = floorf(p->y / cluster->xycell);
+    int32_t z = floorf(p->z / cluster->zcell);
+    uint32_t idx;
+    struct cell *cell;
+
+    idx = ((uint32_t)x * 73856093) ^
+          ((uint32_t)y * 19349663) ^
+          ((uint32_t)z * 83492791);
+
+    for (;;) {
+        cell = cluster->cells + (idx & cluster->mask);
+
+        if (cell->count == 0) {
+            /* new cell */
+            cell->x = x;
+            cell->y = y;
+            cell->z = z;
+            cluster->used++;
+            return cell;
+        }
+
+        if ((cell->x == x) && (cell->y == y) && (cell->z == z)) {
+            return cell;
+        }
+
+        idx++;
+    }
+}
+
+/* exported method documented in mesh_cluster.h */
+uint32_t
+cluster_mesh(struct mesh *mesh, float xycell, float zcell)
+{
+    struct cluster cluster;
+    uint32_t size;
+    uint32_t floop; /* facet loop */
+    uint32_t fout; /* facets retained */
+    unsigned int vloop; /* vertex within facet */
+    struct cell *cell;
+    struct facet *facet;
+
+    if ((xycell <= 0) || (zcell <= 0)) {
+        return 0;
+    }
+
+    /* table at most half full with every vertex in its own cell */
+    for (size = 1024; size < (mesh->fcount * 3 * 2); size = size << 1);
+
+    cluster.cells = calloc(size, sizeof(struct cell));
+    if (cluster.cells == NULL) {
+        return 0;
+    }
+    cluster.mask = size - 1;
+    cluster.used = 0;
+    cluster.xycell = xycell;
+    cluster.zcell = zcell;
+
+    /* accumulate every vertex into its cell */
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        for (vloop = 0; vloop < 3; vloop++) {
+            cell = cluster_cell(&cluster, &mesh->f[floop].v[vloop]);
+            cell->count++;
+            cell->sum.x += mesh->f[floop].v[vloop].x;
+            cell->sum.y += mesh->f[floop].v[vloop].y;
+            cell->sum.z += mesh->f[floop].v[vloop].z;
+        }
+    }
+
+    /* convert sums to mean locations */
+    for (floop = 0; floop < size; floop++) {
+        cell = cluster.cells + floop;
+        if (cell->count != 0) {
+            cell->sum.x = cell->sum.x / cell->count;
+            cell->sum.y = cell->sum.y / cell->count;
+            cell->sum.z = cell->sum.z / cell->count;
+        }
+    }
+
+    /* move vertices to their cell location and drop degenerate facets */
+    fout = 0;
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        facet = mesh->f + fout;
+        if (fout != floop) {
+            *facet = mesh->f[floop];
+        }
+
+        for (vloop = 0; vloop < 3; vloop++) {
+            facet->v[vloop] = cluster_cell(&cluster, &facet->v[vloop])->sum;
+        }
+
+        if (!pnt_normal(&facet->n, &facet->v[0], &facet->v[1], &facet->v[2])) {
+            fout++;
+        }
+    }
+    mesh->fcount = fout;
+
+    free(cluster.cells);
+
+    return cluster.used;
+}
+
+/* exported method documented in mesh_cluster.h */
+bool
+cluster_mesh_options(struct mesh *mesh, options *options)
+{
+    float xycell = 2;
+    float zcell = 1;
+    uint32_t start_fcount = mesh->fcount;
+    uint32_t cells;
+
+    if (mesh->fcount == 0) {
+        /* an empty mesh, such as an outline shrunk away, has no cells */
+        return true;
+    }
+
+    if (options->resolution > 0) {
+        /* convert from output units to mesh units */
+        xycell = options->resolution * mesh->width / options->width;
+        zcell = options->resolution * options->levels / options->depth;
+
+        /* merging vertices from different levels would flatten the model */
+        if (zcell > 1) {
+            zcell = 1;
+        }
+    }
+
+    INFO("Clustering vertices of mesh with %d facets on %fx%f grid\n",
+         mesh->fcount, xycell, zcell);
+
+    trace_begin("cluster %u facets", mesh->fcount);
+    cells = cluster_mesh(mesh, xycell, zcell);
+    trace_end();
+
+    if (cells == 0) {
+        fprintf(stderr, "unable to cluster mesh vertices\n");
+        return false;
+    }
+
+    INFO("Result mesh has %d facets (%d removed) using %d grid cells\n",
+         mesh->fcount, start_fcount - mesh->fcount, cells);
+
+    return true;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * mesh vertex clustering simplification header.
+ */
+
+#ifndef PNG23D_MESH_CLUSTER_H
+#define PNG23D_MESH_CLUSTER_H 1
+
+/** simplify mesh by clustering vertices onto a grid
+ *
+ * @param mesh The unindexed mesh to simplify.
+ * @param xycell The grid cell size in the x and y axis.
+ * @param zcell The grid cell size in the z axis.
+ * @return The number of occupied grid cells or 0 on error.
+ */
+uint32_t cluster_mesh(struct mesh *mesh, float xycell, float zcell);
+
+/** simplify mesh by clustering vertices onto the grid given by options
+ *
+ * The grid size is the resolution option in output units or if that is
+ * zero two source pixels in x and y and one level in z. The z cell is never
+ * larger than one level.
+ */
+bool cluster_mesh_options(struct mesh *mesh, options *options);
+
+#endif
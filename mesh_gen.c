@@ -16,12 +16,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "option.h"
 #include "bitmap.h"
 #include "mesh.h"
 #include "mesh_gen.h"
 #include "mesh_math.h"
+#include "distance.h"
+#include "trace.h"
 
 
 enum faces {
@@ -45,6 +49,7 @@ mesh_gen_get_face(bitmap *bm,
     uint32_t faces = 0;
     unsigned int transparent = options->transparent;
     unsigned int pxl_lvl;
+    uint8_t *pxl;
     uint8_t pxl_val;
 
 #define Z_LVL_VAL(val) ((val) * (256 / options->levels))
@@ -53,7 +58,8 @@ mesh_gen_get_face(bitmap *bm,
     pxl_lvl = Z_LVL_VAL(z);
 
     /* pixel value at sample point */
-    pxl_val = bm->data[(y * bm->width) + x];
+    pxl = bitmap_pixel(bm, x, y);
+    pxl_val = *pxl;
 
     if ((pxl_val == transparent) ||
         (pxl_val < pxl_lvl)) {
@@ -68,54 +74,45 @@ mesh_gen_get_face(bitmap *bm,
 
     /* z axis faces */
 
-    /* only the bottom layer has a front face */
-    if (z > 0) {
+    /* only the bottom layer has a front face unless each level is closed */
+    if ((z > 0) && !options->level_bodies) {
         faces = faces & ~FACE_FRONT;
     }
 
     if ((z < (options->levels - 1)) &&
-        (pxl_val >= Z_LVL_VAL(z + 1))) {
+        (pxl_val >= Z_LVL_VAL(z + 1)) &&
+        !options->level_bodies) {
         faces = faces & ~FACE_BACK;
     }
 
+    /* the bitmap border is transparent so neighbours are always present */
+
     /* x axis faces */
-    if (x > 0) {
-        /* pixel value left of sample point */
-        pxl_val = bm->data[(y * bm->width) + (x - 1)];
-        if ((pxl_val != transparent) &&
-            (pxl_val >= pxl_lvl)) {
-            faces = faces & ~FACE_LEFT;
-        }
+    pxl_val = pxl[-1]; /* pixel value left of sample point */
+    if ((pxl_val != transparent) &&
+        (pxl_val >= pxl_lvl)) {
+        faces = faces & ~FACE_LEFT;
     }
 
-    if (x < (bm->width - 1)) {
-        /* pixel value right of sample point */
-        pxl_val = bm->data[(y * bm->width) + (x + 1)];
-        if ((pxl_val != transparent) &&
-            (pxl_val >= pxl_lvl)) {
-            faces = faces & ~FACE_RIGHT;
-        }
+    pxl_val = pxl[1]; /* pixel value right of sample point */
+    if ((pxl_val != transparent) &&
+        (pxl_val >= pxl_lvl)) {
+        faces = faces & ~FACE_RIGHT;
     }
 
-    if (y > 0) {
-        pxl_val = bm->data[((y - 1) * bm->width) + x ];
-        if ((pxl_val != transparent) &&
-            (pxl_val >= pxl_lvl)) {
-            faces = faces & ~FACE_TOP;
-        }
+    /* y axis faces */
+    pxl_val = pxl[-(ptrdiff_t)bm->stride];
+    if ((pxl_val != transparent) &&
+        (pxl_val >= pxl_lvl)) {
+        faces = faces & ~FACE_TOP;
     }
 
-    if (y < (bm->height - 1)) {
-        pxl_val = bm->data[((y + 1) * bm->width) + x ];
-        if ((pxl_val != transparent) &&
-            (pxl_val >= pxl_lvl)) {
-            faces = faces & ~FACE_BOT;
-        }
+    pxl_val = pxl[bm->stride];
+    if ((pxl_val != transparent) &&
+        (pxl_val >= pxl_lvl)) {
+        faces = faces & ~FACE_BOT;
     }
 
-
-
-
     return faces;
 }
 
@@ -149,6 +146,8 @@ mesh_add_facet(struct mesh *mesh,
     newfacet->v[2].y = vy2;
     newfacet->v[2].z = vz2;
 
+    newfacet->body = mesh->body;
+
     degenerate = pnt_normal(&newfacet->n,
                             &newfacet->v[0],
                             &newfacet->v[1],
@@ -518,6 +517,8 @@ static bool mesh_gen_squares(struct mesh *mesh, bitmap *bm, options *options)
     unsigned int yloop;
     unsigned int xloop;
     unsigned int zloop;
+    unsigned int band; /* first row of band */
+    unsigned int bend; /* row after end of band */
     uint32_t faces;
     meshgenerator *meshgen;
 
@@ -528,11 +529,20 @@ static bool mesh_gen_squares(struct mesh *mesh, bitmap *bm, options *options)
     }
 
     for (zloop = 0; zloop < options->levels; zloop++) {
-        for (yloop = 0; yloop < bm->height; yloop++) {
-            for (xloop = 0; xloop < bm->width; xloop++) {
-                faces = mesh_gen_get_face(bm, xloop, yloop, zloop, options);
-                meshgen(mesh, xloop, -(float)yloop, zloop, 1, 1, 1, faces);
+        for (band = 0; band < bm->height; band = bend) {
+            bend = band + TRACE_GEN_BAND;
+            if (bend > bm->height) {
+                bend = bm->height;
             }
+
+            trace_begin("generate level %u rows %u-%u", zloop, band, bend - 1);
+            for (yloop = band; yloop < bend; yloop++) {
+                for (xloop = 0; xloop < bm->width; xloop++) {
+                    faces = mesh_gen_get_face(bm, xloop, yloop, zloop, options);
+                    meshgen(mesh, xloop, -(float)yloop, zloop, 1, 1, 1, faces);
+                }
+            }
+            trace_end();
         }
     }
     
@@ -546,6 +556,9 @@ static bool mesh_gen_squares(struct mesh *mesh, bitmap *bm, options *options)
  *     be covered to generate a convex manifold.
  *   - add triangle facets to list for each face present
  *
+ * When level bodies are requested every level is closed and is a body of
+ * its own.
+ *
  * @todo This could probably be better converted to a marching cubes solution
  *       instead  http://en.wikipedia.org/wiki/Marching_cubes
  */
@@ -554,14 +567,29 @@ static bool mesh_gen_cubes(struct mesh *mesh, bitmap *bm, options *options)
     unsigned int yloop;
     unsigned int xloop;
     unsigned int zloop;
+    unsigned int band; /* first row of band */
+    unsigned int bend; /* row after end of band */
     uint32_t faces;
 
+    mesh->multibody = options->level_bodies;
+
     for (zloop = 0; zloop < options->levels; zloop++) {
-        for (yloop = 0; yloop < bm->height; yloop++) {
-            for (xloop = 0; xloop < bm->width; xloop++) {
-                faces = mesh_gen_get_face(bm, xloop, yloop, zloop, options);
-                mesh_gen_cube(mesh, xloop, -(float)yloop, zloop, 1, 1, 1, faces);
+        mesh->body = zloop;
+        mesh->body_colour[zloop] = Z_LVL_VAL(zloop) * 0x010101;
+        for (band = 0; band < bm->height; band = bend) {
+            bend = band + TRACE_GEN_BAND;
+            if (bend > bm->height) {
+                bend = bm->height;
+            }
+
+            trace_begin("generate level %u rows %u-%u", zloop, band, bend - 1);
+            for (yloop = band; yloop < bend; yloop++) {
+                for (xloop = 0; xloop < bm->width; xloop++) {
+                    faces = mesh_gen_get_face(bm, xloop, yloop, zloop, options);
+                    mesh_gen_cube(mesh, xloop, -(float)yloop, zloop, 1, 1, 1, faces);
+                }
             }
+            trace_end();
         }
     }
     
@@ -579,15 +607,8 @@ surfacegen_calcp(bitmap *bm,
     uint8_t pxl_val;
     int res;
 
-    /* range check, casts are safe because value cannot be -ve from previous
-     * test.
-     */
-    if ((x < 0) || ((unsigned int)x >= bm->width) || 
-        (y < 0) || ((unsigned int)y >= bm->height)) {
-        return 0.0f;
-    }
-        
-    pxl_val = bm->data[(y * bm->width) + x];
+    /* points one outside the image are in the transparent border */
+    pxl_val = *bitmap_pixel(bm, x, y);
 
     if (pxl_val == options->transparent) {
         return 0.0f;
@@ -660,50 +681,1278 @@ static bool mesh_gen_surface(struct mesh *mesh, bitmap *bm, options *options)
 {
     unsigned int yloop;
     unsigned int xloop;
+    unsigned int band; /* first row of band */
+    unsigned int bend; /* row after end of band */
     float points[2][2];
 
-    for (yloop = 0; yloop <= bm->height; yloop++) {
-        for (xloop = 0; xloop <= bm->width; xloop++) {
+    /* surface has one more row of points than the bitmap has pixels */
+    for (band = 0; band <= bm->height; band = bend) {
+        bend = band + TRACE_GEN_BAND;
+        if (bend > (bm->height + 1)) {
+            bend = bm->height + 1;
+        }
+
+        trace_begin("generate surface rows %u-%u", band, bend - 1);
+        for (yloop = band; yloop < bend; yloop++) {
+            for (xloop = 0; xloop <= bm->width; xloop++) {
+
+                points[0][0] = surfacegen_calcp(bm, xloop - 1, yloop - 1, options);
+                points[1][0] = surfacegen_calcp(bm, xloop, yloop - 1, options);
+                points[0][1] = surfacegen_calcp(bm, xloop - 1, yloop, options);
+                points[1][1] = surfacegen_calcp(bm, xloop, yloop, options);
+
+                gen_surface(mesh,
+                            xloop, -(float)yloop,
+                            1, -1,
+                            (((xloop + yloop) & 1) == 0),
+                            points);
+
+            }
+        }
+        trace_end();
+    }
+    return true;
+}
+
+/* generate a body for each palette index in one pass
+ *
+ * Each pixel is a cube of its index's body and has side faces wherever its
+ * neighbour holds a different index, so bodies which touch each have a
+ * wall on their common boundary. The walls are coincident and, once the
+ * mesh is indexed, share their vertices. Cube faces are always used so
+ * neighbouring bodies meet without gaps.
+ */
+static bool mesh_gen_bodies(struct mesh *mesh, bitmap *bm, options *options)
+{
+    unsigned int yloop;
+    unsigned int xloop;
+    unsigned int band; /* first row of band */
+    unsigned int bend; /* row after end of band */
+    unsigned int bodies = 0;
+    unsigned int iloop;
+    uint32_t faces;
+    uint8_t *pxl;
+    uint8_t idx;
+    float height[256];
+    bool used[256];
+    int border;
+
+    memcpy(height, options->body_height, sizeof(height));
+    memset(used, 0, sizeof(used));
+
+    for (yloop = 0; yloop < bm->height; yloop++) {
+        pxl = bitmap_pixel(bm, 0, yloop);
+        for (xloop = 0; xloop < bm->width; xloop++) {
+            used[pxl[xloop]] = true;
+        }
+    }
+
+    /* the border must hold an index which is not a body */
+    if (options->transparent < 256) {
+        border = options->transparent;
+    } else {
+        for (border = 255; border >= 0; border--) {
+            if (!used[border]) {
+                break;
+            }
+        }
+        if (border < 0) {
+            fprintf(stderr, "every palette index is used, one must be transparent\n");
+            return false;
+        }
+    }
+    height[border] = 0;
+    bitmap_border(bm, border);
+
+    for (iloop = 0; iloop < 256; iloop++) {
+        if (bm->palette != NULL) {
+            mesh->body_colour[iloop] = bm->palette[iloop];
+        } else {
+            mesh->body_colour[iloop] = iloop * 0x010101;
+        }
+    }
+
+    for (iloop = 0; iloop < 256; iloop++) {
+        if (used[iloop] && (height[iloop] > 0)) {
+            bodies++;
+        }
+    }
+    INFO("Generating %u bodies\n", bodies);
+
+    mesh->multibody = true;
+
+    for (band = 0; band < bm->height; band = bend) {
+        bend = band + TRACE_GEN_BAND;
+        if (bend > bm->height) {
+            bend = bm->height;
+        }
+
+        trace_begin("generate bodies rows %u-%u", band, bend - 1);
+        for (yloop = band; yloop < bend; yloop++) {
+            pxl = bitmap_pixel(bm, 0, yloop);
+            for (xloop = 0; xloop < bm->width; xloop++, pxl++) {
+                idx = *pxl;
+                if (height[idx] <= 0) {
+                    continue;
+                }
+
+                faces = FACE_FRONT | FACE_BACK;
+                if (pxl[-1] != idx) {
+                    faces |= FACE_LEFT;
+                }
+                if (pxl[1] != idx) {
+                    faces |= FACE_RIGHT;
+                }
+                if (pxl[-(ptrdiff_t)bm->stride] != idx) {
+                    faces |= FACE_TOP;
+                }
+                if (pxl[bm->stride] != idx) {
+                    faces |= FACE_BOT;
+                }
+
+                mesh->body = idx;
+                mesh_gen_cube(mesh, xloop, -(float)yloop, 0,
+                              1, 1, height[idx], faces);
+            }
+        }
+        trace_end();
+    }
+
+    return true;
+}
+
+/** most levels of an edge profile */
+#define FIELD_PROFILE_MAX 9
+
+/** number of segments of a fillet profile */
+#define FIELD_FILLET_SEGMENTS 8
+
+/** top edge profile as heights at levels of the distance field
+ *
+ * The top is at each height where the field has the level's value and is
+ * interpolated between them. Beyond the last level the top is flat.
+ */
+struct field_profile {
+    unsigned int count; /**< number of levels, 0 for a flat top */
+    float level[FIELD_PROFILE_MAX]; /**< ascending field values from 0 */
+    float z[FIELD_PROFILE_MAX]; /**< height at each level */
+};
+
+/** a point of a contour cell, a sample or where the contour crosses an edge */
+struct field_pnt {
+    float x;
+    float y;
+    float f; /**< value of the field */
+    bool cross; /**< the point is on the contour */
+};
+
+/** mesh x coordinate of the centre of a pixel column */
+#define FIELD_X(col) ((float)(col) + 0.5f)
+
+/** mesh y coordinate of the centre of a pixel row */
+#define FIELD_Y(row) (0.5f - (float)(row))
+
+/* point where the field has a value between two points
+ *
+ * The points are taken in the same order whichever way round they are
+ * given so neighbouring polygons sharing the edge compute exactly the
+ * same point.
+ */
+static inline struct field_pnt
+field_level(const struct field_pnt *a, const struct field_pnt *b, float level)
+{
+    struct field_pnt pnt;
+    const struct field_pnt *swap;
+    float t;
+
+    if ((b->x < a->x) || ((b->x == a->x) && (b->y < a->y))) {
+        swap = a;
+        a = b;
+        b = swap;
+    }
+
+    t = (level - a->f) / (b->f - a->f);
+    pnt.x = a->x + (t * (b->x - a->x));
+    pnt.y = a->y + (t * (b->y - a->y));
+    pnt.f = level;
+    pnt.cross = (level == 0);
+
+    return pnt;
+}
+
+/* height of the top at a field value */
+static float
+field_height(const struct field_profile *profile, float f)
+{
+    unsigned int loop;
+    float t;
+
+    if ((profile->count == 0) || (f >= profile->level[profile->count - 1])) {
+        return 1;
+    }
+
+    for (loop = 1; f > profile->level[loop]; loop++) {
+    }
+    if (f == profile->level[loop]) {
+        return profile->z[loop];
+    }
+
+    t = (f - profile->level[loop - 1]) /
+        (profile->level[loop] - profile->level[loop - 1]);
+    return profile->z[loop - 1] + (t * (profile->z[loop] - profile->z[loop - 1]));
+}
+
+/* part of a triangle where the field is between two levels
+ *
+ * Points on the levels are always found from the triangle's own edges so
+ * triangles sharing an edge place them identically. A triangle lying
+ * wholly on the upper level is left to the band above so it is only
+ * generated once.
+ */
+static unsigned int
+field_band(const struct field_pnt *tri,
+           float low,
+           float high,
+           bool top,
+           struct field_pnt *out)
+{
+    const struct field_pnt *a;
+    const struct field_pnt *b;
+    unsigned int count = 0;
+    unsigned int loop;
+
+    if (!top &&
+        (tri[0].f == high) && (tri[1].f == high) && (tri[2].f == high)) {
+        return 0;
+    }
+
+    for (loop = 0; loop < 3; loop++) {
+        a = tri + loop;
+        b = tri + ((loop + 1) % 3);
+
+        if ((a->f >= low) && (top || (a->f <= high))) {
+            out[count++] = *a;
+        }
+
+        /* levels crossed between the corners, in order from a */
+        if (a->f < b->f) {
+            if ((a->f < low) && (low < b->f)) {
+                out[count++] = field_level(a, b, low);
+            }
+            if (!top && (a->f < high) && (high < b->f)) {
+                out[count++] = field_level(a, b, high);
+            }
+        } else {
+            if (!top && (b->f < high) && (high < a->f)) {
+                out[count++] = field_level(a, b, high);
+            }
+            if ((b->f < low) && (low < a->f)) {
+                out[count++] = field_level(a, b, low);
+            }
+        }
+    }
+
+    return count;
+}
+
+/* add the top of a triangle in a band between each level of the profile */
+static void
+field_profile_top(struct mesh *mesh,
+                  const struct field_profile *profile,
+                  const struct field_pnt *tri)
+{
+    struct field_pnt band[6];
+    unsigned int bcount;
+    unsigned int lloop;
+    unsigned int loop;
+    bool top;
+    float z[6];
+
+    for (lloop = 0; lloop < profile->count; lloop++) {
+        top = ((lloop + 1) == profile->count);
+        bcount = field_band(tri,
+                            profile->level[lloop],
+                            top ? 0 : profile->level[lloop + 1],
+                            top,
+                            band);
+
+        for (loop = 0; loop < bcount; loop++) {
+            z[loop] = field_height(profile, band[loop].f);
+        }
+        for (loop = 1; (loop + 1) < bcount; loop++) {
+            mesh_add_facet(mesh,
+                           band[0].x, band[0].y, z[0],
+                           band[loop].x, band[loop].y, z[loop],
+                           band[loop + 1].x, band[loop + 1].y, z[loop + 1]);
+        }
+    }
+}
+
+/* extrude a convex polygon of a contour cell
+ *
+ * The points are anticlockwise so the opaque area is left of each contour
+ * segment and its wall faces right.
+ */
+static void
+field_polygon(struct mesh *mesh,
+              const struct field_profile *profile,
+              const struct field_pnt *pnt,
+              unsigned int n)
+{
+    const struct field_pnt *a;
+    const struct field_pnt *b;
+    struct field_pnt tri[3];
+    unsigned int loop;
+    float wall;
+
+    for (loop = 1; (loop + 1) < n; loop++) {
+        a = pnt + loop;
+        b = pnt + loop + 1;
+        if (profile->count == 0) {
+            mesh_add_facet(mesh, pnt->x, pnt->y, 1, a->x, a->y, 1, b->x, b->y, 1);
+        } else {
+            tri[0] = *pnt;
+            tri[1] = *a;
+            tri[2] = *b;
+            field_profile_top(mesh, profile, tri);
+        }
+        mesh_add_facet(mesh, pnt->x, pnt->y, 0, b->x, b->y, 0, a->x, a->y, 0);
+    }
 
-            points[0][0] = surfacegen_calcp(bm, xloop - 1, yloop - 1, options);
-            points[1][0] = surfacegen_calcp(bm, xloop, yloop - 1, options);
-            points[0][1] = surfacegen_calcp(bm, xloop - 1, yloop, options);
-            points[1][1] = surfacegen_calcp(bm, xloop, yloop, options);
+    wall = field_height(profile, 0);
+    for (loop = 0; loop < n; loop++) {
+        a = pnt + loop;
+        b = pnt + ((loop + 1) % n);
+        if (a->cross && b->cross) {
+            mesh_add_facet(mesh, a->x, a->y, 0, b->x, b->y, 0, b->x, b->y, wall);
+            mesh_add_facet(mesh, a->x, a->y, 0, b->x, b->y, wall, a->x, a->y, wall);
+        }
+    }
+}
 
-            gen_surface(mesh,
-                             xloop, -(float)yloop,
-                             1, -1, 
-                             (((xloop + yloop) & 1) == 0), 
-                             points);
+/* mesh one cell of the contour between four pixel centres
+ *
+ * The samples are at the centres of pixels (x, y) to (x + 1, y + 1) and
+ * are taken anticlockwise in the mesh from the bottom left, the pixel at
+ * (x, y + 1). When opposite corners alone are inside, the average of the
+ * samples decides whether they are joined.
+ */
+static void
+field_cell(struct mesh *mesh,
+           const struct field_profile *profile,
+           int x,
+           int y,
+           const float *f)
+{
+    struct field_pnt corner[4];
+    struct field_pnt cross[4];
+    struct field_pnt pnt[6];
+    unsigned int n = 0;
+    unsigned int loop;
+    unsigned int inside = 0;
+
+    for (loop = 0; loop < 4; loop++) {
+        if (f[loop] > 0) {
+            inside |= 1 << loop;
+        }
+    }
+    if (inside == 0) {
+        return;
+    }
+    mesh->cubes++;
+
+    corner[0].x = FIELD_X(x);
+    corner[0].y = FIELD_Y(y + 1);
+    corner[1].x = FIELD_X(x + 1);
+    corner[1].y = FIELD_Y(y + 1);
+    corner[2].x = FIELD_X(x + 1);
+    corner[2].y = FIELD_Y(y);
+    corner[3].x = FIELD_X(x);
+    corner[3].y = FIELD_Y(y);
+    for (loop = 0; loop < 4; loop++) {
+        corner[loop].f = f[loop];
+        corner[loop].cross = false;
+    }
 
+    /* crossings of the edges leaving each corner anticlockwise */
+    for (loop = 0; loop < 4; loop++) {
+        if ((((inside >> loop) ^ (inside >> ((loop + 1) & 3))) & 1) != 0) {
+            cross[loop] = field_level(&corner[loop], &corner[(loop + 1) & 3], 0);
         }
     }
+
+    if (((inside == 5) || (inside == 10)) &&
+        ((f[0] + f[1] + f[2] + f[3]) <= 0)) {
+        /* separate corners */
+        for (loop = 0; loop < 4; loop++) {
+            if ((inside & (1 << loop)) != 0) {
+                pnt[0] = cross[(loop + 3) & 3];
+                pnt[1] = corner[loop];
+                pnt[2] = cross[loop];
+                field_polygon(mesh, profile, pnt, 3);
+            }
+        }
+        return;
+    }
+
+    for (loop = 0; loop < 4; loop++) {
+        if ((inside & (1 << loop)) != 0) {
+            pnt[n++] = corner[loop];
+        }
+        if ((((inside >> loop) ^ (inside >> ((loop + 1) & 3))) & 1) != 0) {
+            pnt[n++] = cross[loop];
+        }
+    }
+    field_polygon(mesh, profile, pnt, n);
+}
+
+/* levels and heights of the top edge profile
+ *
+ * A chamfer is a straight slope from the outline to the flat top. A fillet
+ * is a quarter ellipse, vertical at the outline and level with the top,
+ * made of straight segments.
+ */
+static void
+field_profile_init(struct field_profile *profile, bitmap *bm, options *options)
+{
+    unsigned int loop;
+    float width; /* horizontal size in pixels */
+    float drop; /* vertical size relative to the depth */
+    float angle;
+
+    profile->count = 0;
+    if (options->profile == PROFILE_NONE) {
+        return;
+    }
+
+    width = options->profile_size * bm->width / options->width;
+    drop = options->profile_size / options->depth;
+    if (drop > 1) {
+        drop = 1;
+    }
+
+    if (options->profile == PROFILE_CHAMFER) {
+        profile->count = 2;
+        profile->level[0] = 0;
+        profile->z[0] = 1 - drop;
+        profile->level[1] = width;
+        profile->z[1] = 1;
+        return;
+    }
+
+    profile->count = FIELD_FILLET_SEGMENTS + 1;
+    for (loop = 0; loop <= FIELD_FILLET_SEGMENTS; loop++) {
+        angle = (loop * (float)M_PI) / (2 * FIELD_FILLET_SEGMENTS);
+        profile->level[loop] = width * (1 - cosf(angle));
+        profile->z[loop] = 1 - (drop * (1 - sinf(angle)));
+    }
+    profile->level[0] = 0;
+    profile->level[FIELD_FILLET_SEGMENTS] = width;
+    profile->z[FIELD_FILLET_SEGMENTS] = 1;
+}
+
+/* generate a mesh from an offset outline
+ *
+ * The distance field of the opaque area, less the offset, is sampled at
+ * each pixel centre and marching squares finds where it crosses zero
+ * between them, which is the pixel edges when there is no offset. Cells
+ * extend one pixel beyond the image where the field keeps falling so the
+ * outline is always closed. An edge profile lowers the top where the
+ * field is below the profile's width.
+ */
+static bool mesh_gen_field(struct mesh *mesh, bitmap *bm, options *options)
+{
+    struct distance *dist;
+    struct field_profile profile;
+    float offset;
+    float *row[2];
+    float *swap;
+    float f[4];
+    int yloop;
+    int xloop;
+    int band; /* first row of band */
+    int bend; /* row after end of band */
+
+    offset = options->offset * bm->width / options->width;
+    field_profile_init(&profile, bm, options);
+
+    trace_begin("distance field");
+    dist = distance_from_bitmap(bm, options->transparent);
+    trace_end();
+    if (dist == NULL) {
+        return false;
+    }
+
+    row[0] = malloc(sizeof(float) * (bm->width + 2));
+    row[1] = malloc(sizeof(float) * (bm->width + 2));
+    if ((row[0] == NULL) || (row[1] == NULL)) {
+        free(row[0]);
+        free(row[1]);
+        free_distance(dist);
+        return false;
+    }
+
+    /* samples of the row below each cell, starting one pixel left */
+    for (xloop = -1; xloop <= (int)bm->width; xloop++) {
+        row[1][xloop + 1] = distance_offset_at(dist, xloop, -1, offset);
+    }
+
+    for (band = -1; band < (int)bm->height; band = bend) {
+        bend = band + TRACE_GEN_BAND;
+        if (bend > (int)bm->height) {
+            bend = bm->height;
+        }
+
+        trace_begin("generate contour rows %d-%d", band, bend - 1);
+        for (yloop = band; yloop < bend; yloop++) {
+            swap = row[0];
+            row[0] = row[1];
+            row[1] = swap;
+            for (xloop = -1; xloop <= (int)bm->width; xloop++) {
+                row[1][xloop + 1] = distance_offset_at(dist, xloop, yloop + 1,
+                                                       offset);
+            }
+
+            for (xloop = -1; xloop < (int)bm->width; xloop++) {
+                f[0] = row[1][xloop + 1];
+                f[1] = row[1][xloop + 2];
+                f[2] = row[0][xloop + 2];
+                f[3] = row[0][xloop + 1];
+                field_cell(mesh, &profile, xloop, yloop, f);
+            }
+        }
+        trace_end();
+    }
+
+    free(row[0]);
+    free(row[1]);
+    free_distance(dist);
+
     return true;
 }
 
+/** maximum number of triangles marching cubes generates in one cell */
+#define MC_TRI_MAX 12
+
+/** maximum number of surface loops within one cell */
+#define MC_LOOP_MAX 4
+
+/** marching cubes triangles for each cell configuration
+ *
+ * The first entry is the number of triangles followed by the vertex index
+ * of each triangle vertex. Vertices below 12 are on the cell edge of that
+ * index, the others are loop centres. Bit n of the configuration is set
+ * when corner n, at x = bit 0, y = bit 1 and z = bit 2 of n, is solid.
+ */
+static uint8_t mc_tri[256][(MC_TRI_MAX * 3) + 1];
+
+/** location within the cell of each edge's vertex */
+static float mc_edge_pnt[12][3];
+
+/** faces of the cell each edge lies on */
+static uint8_t mc_edge_face[12];
+
+/** location within the cell of the loop centres of each configuration */
+static float mc_centre[256][MC_LOOP_MAX][3];
+
+/** corners of each cell face, anticlockwise seen from outside the cell */
+static const uint8_t mc_face[6][4] = {
+    { 0, 4, 6, 2 }, /* x = 0 */
+    { 1, 3, 7, 5 }, /* x = 1 */
+    { 0, 1, 5, 4 }, /* y = 0 */
+    { 2, 6, 7, 3 }, /* y = 1 */
+    { 0, 2, 3, 1 }, /* z = 0 */
+    { 4, 5, 7, 6 }, /* z = 1 */
+};
+
+/* index of the cell edge between two adjacent corners */
+static unsigned int mc_edge(unsigned int a, unsigned int b)
+{
+    unsigned int common = a & b;
+
+    switch (a ^ b) {
+    case 1: /* along x, indexed by y and z */
+        return (common >> 1) & 3;
+
+    case 2: /* along y, indexed by x and z */
+        return 4 + ((common & 1) | ((common >> 1) & 2));
+
+    default: /* along z, indexed by x and y */
+        return 8 + (common & 3);
+    }
+}
+
+/* add a triangle to a marching cubes table entry */
+static inline void
+mc_add_tri(uint8_t *tri, unsigned int a, unsigned int b, unsigned int c)
+{
+    tri[(tri[0] * 3) + 1] = a;
+    tri[(tri[0] * 3) + 2] = b;
+    tri[(tri[0] * 3) + 3] = c;
+    tri[0]++;
+}
+
+/* triangulate a loop of edge vertices
+ *
+ * The loop winds around the solid corners so triangles are reversed to
+ * face out of the solid. A fan is used from a vertex whose diagonals do
+ * not lie on a cell face, such a diagonal would be shared with the
+ * neighbouring cell. Where there is no such vertex the loop is fanned
+ * around its centre instead.
+ *
+ * @return true if the loop centre was used.
+ */
+static bool
+mc_add_loop(unsigned int cfg, const uint8_t *loop, unsigned int lcount,
+            unsigned int centre)
+{
+    uint8_t *tri = mc_tri[cfg];
+    unsigned int apex;
+    unsigned int lidx;
+    unsigned int axis;
+
+    for (apex = 0; apex < lcount; apex++) {
+        for (lidx = 2; lidx < (lcount - 1); lidx++) {
+            if ((mc_edge_face[loop[apex]] &
+                 mc_edge_face[loop[(apex + lidx) % lcount]]) != 0) {
+                break;
+            }
+        }
+        if (lidx >= (lcount - 1)) {
+            break;
+        }
+    }
+
+    if (apex < lcount) {
+        for (lidx = 1; (lidx + 1) < lcount; lidx++) {
+            mc_add_tri(tri,
+                       loop[apex],
+                       loop[(apex + lidx + 1) % lcount],
+                       loop[(apex + lidx) % lcount]);
+        }
+        return false;
+    }
+
+    for (axis = 0; axis < 3; axis++) {
+        mc_centre[cfg][centre][axis] = 0;
+        for (lidx = 0; lidx < lcount; lidx++) {
+            mc_centre[cfg][centre][axis] += mc_edge_pnt[loop[lidx]][axis];
+        }
+        mc_centre[cfg][centre][axis] /= lcount;
+    }
+
+    for (lidx = 0; lidx < lcount; lidx++) {
+        mc_add_tri(tri,
+                   12 + centre,
+                   loop[(lidx + 1) % lcount],
+                   loop[lidx]);
+    }
+
+    return true;
+}
+
+/** build the marching cubes tables
+ *
+ * Rather than transcribing the usual 256 entry table the triangles are
+ * derived from the cell faces. On each face a segment separates every run
+ * of solid corners from the empty ones so diagonal solid corners on a face
+ * are never joined. Both cells sharing a face make the same choice so the
+ * surface has no cracks. Each edge vertex ends one segment and starts
+ * another which links the segments into closed loops.
+ */
+static void mesh_gen_mc_table(void)
+{
+    static bool built = false;
+    unsigned int cfg;
+    unsigned int face;
+    unsigned int corner;
+    unsigned int prev;
+    unsigned int edge;
+    unsigned int axis;
+    int next[12];
+    bool visited[12];
+    uint8_t loop[12];
+    unsigned int lcount;
+    unsigned int centres;
+
+    if (built) {
+        return;
+    }
+
+    for (corner = 0; corner < 8; corner++) {
+        for (axis = 0; axis < 3; axis++) {
+            if ((corner & (1 << axis)) == 0) {
+                edge = mc_edge(corner, corner | (1 << axis));
+                mc_edge_pnt[edge][0] = (corner & 1) ? 1.0 : 0.0;
+                mc_edge_pnt[edge][1] = (corner & 2) ? 1.0 : 0.0;
+                mc_edge_pnt[edge][2] = (corner & 4) ? 1.0 : 0.0;
+                mc_edge_pnt[edge][axis] = 0.5;
+            }
+        }
+    }
+
+    for (face = 0; face < 6; face++) {
+        for (corner = 0; corner < 4; corner++) {
+            edge = mc_edge(mc_face[face][corner],
+                           mc_face[face][(corner + 1) & 3]);
+            mc_edge_face[edge] |= 1 << face;
+        }
+    }
+
+#define MC_SOLID(c) ((cfg & (1 << (c))) != 0)
+
+    for (cfg = 0; cfg < 256; cfg++) {
+        for (edge = 0; edge < 12; edge++) {
+            next[edge] = -1;
+            visited[edge] = false;
+        }
+
+        /* segments run from where the face boundary leaves a run of solid
+         * corners back to where it entered the run, keeping the solid
+         * corners on the left seen from outside
+         */
+        for (face = 0; face < 6; face++) {
+            for (corner = 0; corner < 4; corner++) {
+                if (!MC_SOLID(mc_face[face][corner]) ||
+                    MC_SOLID(mc_face[face][(corner + 1) & 3])) {
+                    continue;
+                }
+
+                prev = corner;
+                while (MC_SOLID(mc_face[face][(prev + 3) & 3])) {
+                    prev = (prev + 3) & 3;
+                }
+
+                edge = mc_edge(mc_face[face][corner],
+                               mc_face[face][(corner + 1) & 3]);
+                next[edge] = mc_edge(mc_face[face][(prev + 3) & 3],
+                                     mc_face[face][prev]);
+            }
+        }
+
+        mc_tri[cfg][0] = 0;
+        centres = 0;
+        for (edge = 0; edge < 12; edge++) {
+            if ((next[edge] < 0) || visited[edge]) {
+                continue;
+            }
+
+            lcount = 0;
+            corner = edge;
+            do {
+                visited[corner] = true;
+                loop[lcount++] = corner;
+                corner = next[corner];
+            } while (corner != edge);
+
+            if (mc_add_loop(cfg, loop, lcount, centres)) {
+                centres++;
+            }
+        }
+    }
+
+#undef MC_SOLID
+
+    built = true;
+}
+
+/* location within a cell of a marching cubes vertex */
+static inline const float *mc_pnt(unsigned int cfg, unsigned int vtx)
+{
+    if (vtx < 12) {
+        return mc_edge_pnt[vtx];
+    }
+    return mc_centre[cfg][vtx - 12];
+}
+
+/* marching cubes over the cells between the voxel centres of two slices
+ *
+ * The solid masks hold a clear border of one voxel so cells extend half a
+ * voxel beyond the image and the surface is closed. Vertices are placed
+ * half way along cell edges, on the voxel boundaries.
+ */
+static void
+mesh_gen_slab_mc(struct mesh *mesh,
+                 const uint8_t *below,
+                 const uint8_t *above,
+                 unsigned int width,
+                 unsigned int height,
+                 unsigned int z)
+{
+    size_t stride = width + 2;
+    unsigned int cx;
+    unsigned int cy;
+    unsigned int cfg;
+    unsigned int tloop;
+    const uint8_t *b0; /* row above in the image, local y = 1 */
+    const uint8_t *b1; /* row below in the image, local y = 0 */
+    const uint8_t *a0;
+    const uint8_t *a1;
+    const uint8_t *tri;
+    const float *p0;
+    const float *p1;
+    const float *p2;
+    float x;
+    float y;
+    float zb = z - 0.5f;
+
+    for (cy = 0; cy <= height; cy++) {
+        b0 = below + (cy * stride);
+        b1 = b0 + stride;
+        a0 = above + (cy * stride);
+        a1 = a0 + stride;
+        y = 0.5f - cy;
+
+        for (cx = 0; cx <= width; cx++) {
+            cfg = b1[cx] | (b1[cx + 1] << 1) |
+                  (b0[cx] << 2) | (b0[cx + 1] << 3) |
+                  (a1[cx] << 4) | (a1[cx + 1] << 5) |
+                  (a0[cx] << 6) | (a0[cx + 1] << 7);
+
+            if ((cfg == 0) || (cfg == 255)) {
+                continue;
+            }
+
+            mesh->cubes++;
+
+            x = cx - 0.5f;
+            tri = mc_tri[cfg];
+            for (tloop = 0; tloop < tri[0]; tloop++) {
+                p0 = mc_pnt(cfg, tri[(tloop * 3) + 1]);
+                p1 = mc_pnt(cfg, tri[(tloop * 3) + 2]);
+                p2 = mc_pnt(cfg, tri[(tloop * 3) + 3]);
+                mesh_add_facet(mesh,
+                               x + p0[0], y + p0[1], zb + p0[2],
+                               x + p1[0], y + p1[1], zb + p1[2],
+                               x + p2[0], y + p2[1], zb + p2[2]);
+            }
+        }
+    }
+}
+
+/* cube faces between two slices and around the voxels of the upper slice
+ *
+ * The faces between the slices complete the voxels of the lower slice so
+ * every face is generated with only two slices available.
+ */
+static void
+mesh_gen_slab_faces(struct mesh *mesh,
+                    const uint8_t *below,
+                    const uint8_t *above,
+                    unsigned int width,
+                    unsigned int height,
+                    unsigned int z)
+{
+    ptrdiff_t stride = width + 2;
+    unsigned int xloop;
+    unsigned int yloop;
+    const uint8_t *brow;
+    const uint8_t *arow;
+    const uint8_t *vox;
+    uint32_t faces;
+    float x;
+    float y;
+
+    for (yloop = 0; yloop < height; yloop++) {
+        brow = below + ((yloop + 1) * stride) + 1;
+        arow = above + ((yloop + 1) * stride) + 1;
+        y = -(float)yloop;
+
+        for (xloop = 0; xloop < width; xloop++) {
+            x = xloop;
+
+            if (arow[xloop] == 0) {
+                if (brow[xloop] != 0) {
+                    /* back face of the voxel below */
+                    mesh_add_facet(mesh,
+                                   x, y, z,
+                                   x + 1, y, z,
+                                   x, y + 1, z);
+                    mesh_add_facet(mesh,
+                                   x, y + 1, z,
+                                   x + 1, y, z,
+                                   x + 1, y + 1, z);
+                }
+                continue;
+            }
+
+            vox = arow + xloop;
+            faces = 0;
+            if (vox[-1] == 0) {
+                faces |= FACE_LEFT;
+            }
+            if (vox[1] == 0) {
+                faces |= FACE_RIGHT;
+            }
+            if (vox[-stride] == 0) {
+                faces |= FACE_TOP;
+            }
+            if (vox[stride] == 0) {
+                faces |= FACE_BOT;
+            }
+            if (brow[xloop] == 0) {
+                faces |= FACE_FRONT;
+            }
+
+            mesh_gen_cube(mesh, x, y, z, 1, 1, 1, faces);
+        }
+    }
+}
+
+typedef void (slabgenerator)(struct mesh *mesh,
+                             const uint8_t *below,
+                             const uint8_t *above,
+                             unsigned int width,
+                             unsigned int height,
+                             unsigned int z);
+
+/* mark the solid voxels of a slice in a mask with a clear border */
+static void
+mesh_gen_solid(uint8_t *solid, bitmap *bm, unsigned int transparent)
+{
+    size_t stride = bm->width + 2;
+    unsigned int xloop;
+    unsigned int yloop;
+    const uint8_t *pxl;
+    uint8_t *row;
+
+    for (yloop = 0; yloop < bm->height; yloop++) {
+        pxl = bitmap_pixel(bm, 0, yloop);
+        row = solid + ((yloop + 1) * stride) + 1;
+        for (xloop = 0; xloop < bm->width; xloop++) {
+            row[xloop] = (pxl[xloop] != transparent);
+        }
+    }
+}
+
+/* read a slice after the first */
+static bitmap *mesh_gen_read_slice(options *options, unsigned int slice)
+{
+    if (options->raw_width != 0) {
+        return create_bitmap_raw(options->slices[slice],
+                                 options->raw_width,
+                                 options->raw_height);
+    }
+    return create_bitmap(options->slices[slice]);
+}
+
+/** most slabs meshed at the same time */
+#define SLAB_THREADS_MAX 16
+
+/** one slab meshed by a worker thread into its own facet list */
+struct slab_job {
+    pthread_t thread;
+    bool started; /**< a thread was created for the job */
+    slabgenerator *slabgen;
+    struct mesh mesh; /**< facets of the slab */
+    const uint8_t *below;
+    const uint8_t *above;
+    unsigned int width;
+    unsigned int height;
+    unsigned int z;
+};
+
+static void *mesh_gen_slab_thread(void *ctx)
+{
+    struct slab_job *job = ctx;
+
+    trace_begin("slab %u", job->z);
+    job->slabgen(&job->mesh,
+                 job->below, job->above,
+                 job->width, job->height,
+                 job->z);
+    trace_end();
+
+    return NULL;
+}
+
+/** number of slabs to mesh at the same time */
+static unsigned int mesh_gen_slab_threads(unsigned int slabs)
+{
+    long cpus;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    if (cpus > SLAB_THREADS_MAX) {
+        cpus = SLAB_THREADS_MAX;
+    }
+    if ((unsigned int)cpus > slabs) {
+        cpus = slabs;
+    }
+    return cpus;
+}
+
+/** move the facets of a slab onto the end of the mesh */
+static bool mesh_gen_slab_append(struct mesh *mesh, struct mesh *slab)
+{
+    struct facet *f;
+
+    if ((mesh->fcount + slab->fcount) > mesh->falloc) {
+        f = realloc(mesh->f,
+                    (mesh->fcount + slab->fcount + 1000) *
+                    sizeof(struct facet));
+        if (f == NULL) {
+            return false;
+        }
+        mesh->f = f;
+        mesh->falloc = mesh->fcount + slab->fcount + 1000;
+    }
+
+    memcpy(mesh->f + mesh->fcount, slab->f,
+           slab->fcount * sizeof(struct facet));
+    mesh->fcount += slab->fcount;
+    mesh->cubes += slab->cubes;
+
+    /* keep the allocation for the next slab of this job */
+    slab->fcount = 0;
+    slab->cubes = 0;
+
+    return true;
+}
+
+/* generate a mesh from a stack of slices
+ *
+ * Slices are read in batches of one per thread and only the solid masks of
+ * the batch and the slice before it are kept. The slabs of a batch are
+ * meshed concurrently into separate facet lists which are appended in
+ * slice order, so the mesh is the same whatever the thread count. Empty
+ * slices are assumed before the first and after the last so the mesh is
+ * closed.
+ */
+static bool mesh_gen_volume(struct mesh *mesh, bitmap *bm, options *options)
+{
+    size_t size = (size_t)(bm->width + 2) * (bm->height + 2);
+    uint8_t *solid[SLAB_THREADS_MAX + 1];
+    struct slab_job job[SLAB_THREADS_MAX];
+    uint8_t *swap;
+    bitmap *slice_bm;
+    unsigned int threads;
+    unsigned int slice = 0;
+    unsigned int count; /* slabs in this batch */
+    unsigned int jloop;
+    slabgenerator *slabgen;
+    bool res = true;
+
+    if (options->finish == FINISH_CUBE) {
+        slabgen = &mesh_gen_slab_faces;
+    } else {
+        mesh_gen_mc_table();
+        slabgen = &mesh_gen_slab_mc;
+    }
+
+    /* one more slab than slices closes the top of the stack */
+    threads = mesh_gen_slab_threads(options->slice_count + 1);
+    INFO("Meshing %u slabs at a time\n", threads);
+
+    memset(solid, 0, sizeof(solid));
+    memset(job, 0, sizeof(job));
+    for (jloop = 0; jloop <= threads; jloop++) {
+        solid[jloop] = calloc(1, size);
+        if (solid[jloop] == NULL) {
+            res = false;
+            goto volume_error;
+        }
+    }
+
+    while (res && (slice <= options->slice_count)) {
+        /* decode the slice above each slab of the batch */
+        count = 0;
+        while ((count < threads) && (slice <= options->slice_count)) {
+            if (slice == 0) {
+                mesh_gen_solid(solid[count + 1], bm, options->transparent);
+            } else if (slice < options->slice_count) {
+                INFO("Reading slice \"%s\"\n", options->slices[slice]);
+                trace_begin("decode slice %u", slice);
+                slice_bm = mesh_gen_read_slice(options, slice);
+                trace_end();
+                if (slice_bm == NULL) {
+                    res = false;
+                    break;
+                }
+                if ((slice_bm->width != bm->width) ||
+                    (slice_bm->height != bm->height)) {
+                    fprintf(stderr, "slice \"%s\" is %ux%u not %ux%u\n",
+                            options->slices[slice],
+                            slice_bm->width, slice_bm->height,
+                            bm->width, bm->height);
+                    free_bitmap(slice_bm);
+                    res = false;
+                    break;
+                }
+                mesh_gen_solid(solid[count + 1], slice_bm, options->transparent);
+                free_bitmap(slice_bm);
+            } else {
+                memset(solid[count + 1], 0, size);
+            }
+
+            job[count].slabgen = slabgen;
+            job[count].mesh.body = mesh->body;
+            job[count].below = solid[count];
+            job[count].above = solid[count + 1];
+            job[count].width = bm->width;
+            job[count].height = bm->height;
+            job[count].z = slice;
+
+            count++;
+            slice++;
+        }
+        if (!res) {
+            break;
+        }
+
+        trace_begin("generate slices %u-%u", slice - count, slice - 1);
+
+        /* the last slab of the batch is meshed on this thread */
+        for (jloop = 0; jloop < (count - 1); jloop++) {
+            job[jloop].started = (pthread_create(&job[jloop].thread, NULL,
+                                                 mesh_gen_slab_thread,
+                                                 &job[jloop]) == 0);
+        }
+        for (jloop = 0; jloop < count; jloop++) {
+            if (!job[jloop].started) {
+                mesh_gen_slab_thread(&job[jloop]);
+            }
+        }
+        for (jloop = 0; jloop < count; jloop++) {
+            if (job[jloop].started) {
+                pthread_join(job[jloop].thread, NULL);
+                job[jloop].started = false;
+            }
+            if (res && !mesh_gen_slab_append(mesh, &job[jloop].mesh)) {
+                fprintf(stderr, "unable to allocate slab facets\n");
+                res = false;
+            }
+        }
+
+        trace_end();
+
+        /* the top slice of the batch is below the next one */
+        swap = solid[0];
+        solid[0] = solid[count];
+        solid[count] = swap;
+    }
+
+volume_error:
+    for (jloop = 0; jloop < threads; jloop++) {
+        free(job[jloop].mesh.f);
+    }
+    for (jloop = 0; jloop <= threads; jloop++) {
+        free(solid[jloop]);
+    }
+
+    return res;
+}
+
+/** find a grey level to use as transparent when transparency is disabled
+ *
+ * The bitmap border must hold a transparent value so the generators need no
+ * bounds checks. When transparency is disabled any level the image does not
+ * use serves. If the image uses every level, level 0 pixels become level 1
+ * which only alters the result when a quantisation level is narrower than
+ * three grey levels.
+ */
+static unsigned int
+mesh_gen_transparent(bitmap *bm, options *options)
+{
+    bool used[256];
+    unsigned int row_loop;
+    unsigned int col_loop;
+    int value;
+    uint8_t *pxl;
+
+    memset(used, 0, sizeof(used));
+
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        pxl = bitmap_pixel(bm, 0, row_loop);
+        for (col_loop = 0; col_loop < bm->width; col_loop++) {
+            used[pxl[col_loop]] = true;
+        }
+    }
+
+    for (value = 255; value >= 0; value--) {
+        if (!used[value]) {
+            return value;
+        }
+    }
+
+    if ((256 / options->levels) < 3) {
+        fprintf(stderr, "every grey level is used, level 0 treated as level 1\n");
+    }
+
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        pxl = bitmap_pixel(bm, 0, row_loop);
+        for (col_loop = 0; col_loop < bm->width; col_loop++) {
+            if (pxl[col_loop] == 0) {
+                pxl[col_loop] = 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
 /* exported method documented in mesh_gen.h */
 bool
 mesh_from_bitmap(struct mesh *mesh, bitmap *bm, options *options)
 {
     bool res = false;
+    struct options gen_options;
+    const char *profile_name;
 
     mesh->height = bm->height;
     mesh->width = bm->width;
 
+    if (options->palette) {
+        INFO("Generating mesh from palette bitmap of size %dx%d\n",
+             bm->width, bm->height);
+        return mesh_gen_bodies(mesh, bm, options);
+    }
+
+    if (options->slice_count > 0) {
+        INFO("Generating mesh from %u slices of size %dx%d\n",
+             options->slice_count, bm->width, bm->height);
+        return mesh_gen_volume(mesh, bm, options);
+    }
+
+    /* generators see a transparent value held by the bitmap border */
+    gen_options = *options;
+    if (gen_options.transparent > 255) {
+        gen_options.transparent = mesh_gen_transparent(bm, options);
+    }
+    bitmap_border(bm, gen_options.transparent);
+
+    if ((options->offset != 0) || (options->profile != PROFILE_NONE)) {
+        profile_name = (options->profile == PROFILE_CHAMFER) ? "chamfered" : "filleted";
+        if (options->profile == PROFILE_NONE) {
+            INFO("Generating mesh from bitmap of size %dx%d offset by %g\n",
+                 bm->width, bm->height, options->offset);
+        } else if (options->offset == 0) {
+            INFO("Generating mesh from bitmap of size %dx%d with top edges %s by %g\n",
+                 bm->width, bm->height, profile_name, options->profile_size);
+        } else {
+            INFO("Generating mesh from bitmap of size %dx%d offset by %g with top edges %s by %g\n",
+                 bm->width, bm->height, options->offset,
+                 profile_name, options->profile_size);
+        }
+        return mesh_gen_field(mesh, bm, &gen_options);
+    }
+
     INFO("Generating mesh from bitmap of size %dx%d with %d levels\n",
          bm->width, bm->height, options->levels);
 
     switch (options->finish) {
     case FINISH_SURFACE:
-        res = mesh_gen_surface(mesh, bm, options);
+        res = mesh_gen_surface(mesh, bm, &gen_options);
         break;
 
     case FINISH_SMOOTH:
-        res = mesh_gen_squares(mesh, bm, options);
+        res = mesh_gen_squares(mesh, bm, &gen_options);
         break;
 
     case FINISH_CUBE:
-        res = mesh_gen_cubes(mesh, bm, options);
+        res = mesh_gen_cubes(mesh, bm, &gen_options);
         break;
 
     case FINISH_RECT:
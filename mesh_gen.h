@@ -14,6 +14,9 @@
 
 /** Convert raster image into triangle mesh
  *
+ * When options give a stack of slices the bitmap is the first slice and
+ * the remaining slices are read as they are required. Each slice becomes
+ * a layer of voxels one unit deep.
  */
 bool mesh_from_bitmap(struct mesh *mesh, bitmap *bm, options *options);
 
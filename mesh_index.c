@@ -17,13 +17,13 @@
  *       Skala, Jan Hrádek, Martin Kuchař (Department of Computer Science and
  *       Engineering, University of West Bohemia) which provided inspiration
  *       for hash functions used in early implementations. Turns out the the
- *       simple FNV outperformed them in the end.
- * - Fowler/Noll/Vo hash From its reference implementation which is *not*
- *       subject to my copyright and is in the public domain.
+ *       simple FNV outperformed them in the end, until it was replaced by a
+ *       word at a time multiplicative mix.
+ * - "Cache-, Hash- and Space-Efficient Bloom Filters" by Felix Putze, Peter
+ *       Sanders and Johannes Singler for the blocked filter layout.
  *
  * These served as sources of code snippets and algorihms but none of them
- * (except the FNV hash implementation) are responsible for this specific
- * implementation which is my fault.
+ * are responsible for this specific implementation which is my fault.
  */
 
 #include <stdint.h>
@@ -33,13 +33,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <assert.h>
 
 #include "option.h"
 #include "bitmap.h"
 #include "mesh.h"
 #include "mesh_gen.h"
 #include "mesh_index.h"
+#include "trace.h"
 
 
 /* Salt values.  These salts are XORed with the output of the hash function to
@@ -74,12 +74,19 @@ static const unsigned int salts[] = {
     0xa27e2a58, 0x66866fc5, 0x12519ce7, 0x437a8456,
 };
 
-/** Initialise bloom filter */
+/** Initialise bloom filter
+ *
+ * The filter is blocked, every probe for a key lands in a single cache line
+ * sized block so a query costs at most one cache miss. The number of blocks
+ * is a power of two so a block is selected with a mask.
+ */
 static bool
 mesh_bloom_init(struct mesh *mesh,
                 unsigned int entries,
                 unsigned int iterations)
 {
+    unsigned int blocks = 1;
+
     /* The salt table size imposes a limit on the number of iterations which
      * can be applied
      */
@@ -92,115 +99,117 @@ mesh_bloom_init(struct mesh *mesh,
         entries = (256 * 1024 * 8);
     }
 
-    /* Allocate table, each entry is one bit, packed into bytes. */
-    mesh->bloom_table = calloc(1, (entries + 7) / 8);
-    if (mesh->bloom_table == NULL) {
+    while ((blocks * BLOOM_BLOCK_BITS) < entries) {
+        blocks <<= 1;
+    }
+
+    /* Allocate table of cache line aligned blocks */
+    if (posix_memalign((void **)&mesh->bloom_table,
+                       BLOOM_BLOCK_BITS / 8,
+                       blocks * (BLOOM_BLOCK_BITS / 8)) != 0) {
+        mesh->bloom_table = NULL;
         return false;
     }
+    memset(mesh->bloom_table, 0, blocks * (BLOOM_BLOCK_BITS / 8));
 
     mesh->bloom_iterations = iterations;
-    mesh->bloom_table_entries = entries;
+    mesh->bloom_table_entries = blocks * BLOOM_BLOCK_BITS;
+    mesh->bloom_block_mask = blocks - 1;
 
     return true;
 }
 
 
-/** perform a 32 bit Fowler/Noll/Vo hash on a vetex point
+/** hash a vertex point
  *
- * Direct from reference code which has
- *
- * Please do not copyright this code.  This code is in the public domain.
+ * The three coordinates are mixed a whole word at a time with
+ * multiplicative constants instead of the octet at a time FNV-1 of earlier
+ * implementations. The high word selects the filter block and the low word
+ * the bits within it.
  */
-static inline uint32_t
+static inline uint64_t
 mesh_bloom_hash(struct pnt *pnt)
 {
-    uint32_t hval = 0; /* recommended 32 bit FNV-1 hash init */
-    unsigned char *bp = (unsigned char *)pnt;	/* start of buffer */
-    unsigned char *be = bp + sizeof(struct pnt);/* beyond end of buffer */
+    float coord[3];
+    uint32_t word[3];
+    uint64_t hval;
 
-    /*
-     * FNV-1 hash each octet in the buffer
+    /* adding zero turns -0.0 into 0.0 so points which compare equal also
+     * hash the same
      */
-    while (bp < be) {
+    coord[0] = pnt->x + 0.0f;
+    coord[1] = pnt->y + 0.0f;
+    coord[2] = pnt->z + 0.0f;
+    memcpy(word, coord, sizeof(word));
+
+    hval = ((uint64_t)word[1] << 32) | word[0];
+    hval *= 0x9e3779b97f4a7c15ULL;
+    hval ^= (uint64_t)word[2] * 0xc2b2ae3d27d4eb4fULL;
+    hval ^= hval >> 29;
+    hval *= 0x94d049bb133111ebULL;
+    hval ^= hval >> 32;
 
-        /* multiply by the 32 bit FNV magic prime mod 2^32 */
+    return hval;
+}
 
-        /*
-         * 32 bit magic FNV-1 prime 0x01000193
-         */
-        hval += (hval<<1) + (hval<<4) + (hval<<7) + (hval<<8) + (hval<<24);
+/** block of the filter a hash selects */
+static inline uint64_t *
+mesh_bloom_block(struct mesh *mesh, uint64_t hash)
+{
+    return mesh->bloom_table +
+        (((hash >> 32) & mesh->bloom_block_mask) * BLOOM_BLOCK_WORDS);
+}
 
-        /* xor the bottom with the current octet */
-        hval ^= (uint32_t)*bp++;
-    }
+/** bit within a block for one iteration of a hash
+ *
+ * Each unique hash is generated by XORing with a value from the salt table
+ * and then multiplied so the top bits select the bit.
+ */
+static inline unsigned int
+mesh_bloom_bit(uint64_t hash, unsigned int iteration)
+{
+    return (((uint32_t)hash ^ salts[iteration]) * 0x9e3779b1U) >> 23;
+}
 
-    /* return our new hash value */
-    return hval;
+/** start fetching the block of the filter a hash selects */
+static inline void
+mesh_bloom_prefetch(struct mesh *mesh, uint64_t hash)
+{
+    __builtin_prefetch(mesh_bloom_block(mesh, hash), 1);
 }
 
 static void
-mesh_bloom_insert(struct mesh *mesh, struct pnt *pnt)
+mesh_bloom_insert(struct mesh *mesh, uint64_t hash)
 {
-    unsigned int hash;
-    unsigned int subhash;
-    unsigned int index;
+    uint64_t *block;
+    unsigned int bit;
     unsigned int iloop; /* iteration loop */
-    uint8_t entry;
 
-    /* Generate hash of the point to insert */
-    hash = mesh_bloom_hash(pnt);
-
-    /* Generate multiple unique hashes by XORing with values in the
-     * salt table.
-     */
+    block = mesh_bloom_block(mesh, hash);
 
     for (iloop = 0; iloop < mesh->bloom_iterations; ++iloop) {
+        bit = mesh_bloom_bit(hash, iloop);
 
-        /* Generate a unique hash */
-        subhash = hash ^ salts[iloop];
-
-        /* Find the index into the table */
-        index = subhash % mesh->bloom_table_entries;
-
-        /* Insert into the table.
-         * index / 8 finds the byte index of the table,
-         * index % 8 gives the bit index within that byte to set.
-         */
-        entry = (uint8_t) (1 << (index % 8));
-        mesh->bloom_table[index / 8] |= entry;
+        /* bit / 64 finds the word in the block, bit % 64 the bit in it */
+        block[bit / 64] |= (uint64_t)1 << (bit % 64);
     }
 }
 
 static bool
-mesh_bloom_query(struct mesh *mesh, struct pnt *pnt)
+mesh_bloom_query(struct mesh *mesh, uint64_t hash)
 {
-    unsigned int hash;
-    unsigned int subhash;
-    unsigned int index;
+    uint64_t *block;
+    unsigned int bit;
     unsigned int iloop;
-    unsigned char entry;
-    int bit;
 
-    /* Generate hash of the value to lookup */
-    hash = mesh_bloom_hash(pnt);
+    block = mesh_bloom_block(mesh, hash);
 
-    /* Generate multiple unique hashes by XORing with values in the
-     * salt table. */
     for (iloop = 0; iloop < mesh->bloom_iterations; ++iloop) {
-
-        /* Generate a unique hash */
-        subhash = hash ^ salts[iloop];
-
-        /* Find the index into the table to test */
-        index = subhash % mesh->bloom_table_entries;
-
-        /* The byte at index / 8 holds the value to test */
-        entry = mesh->bloom_table[index / 8];
-        bit = 1 << (index % 8);
+        bit = mesh_bloom_bit(hash, iloop);
 
         /* Test if the particular bit is set; if it is not set,
          * this value can not have been inserted. */
-        if ((entry & bit) == 0) {
+        if ((block[bit / 64] & ((uint64_t)1 << (bit % 64))) == 0) {
             return false;
         }
     }
@@ -254,15 +263,20 @@ find_pnt(struct mesh *mesh, struct pnt *pnt)
     return idx;
 }
 
-/** Add vertex to indexed list */
+/** Add vertex to indexed list
+ *
+ * @param mesh The mesh to add the vertex to.
+ * @param npnt The point to add.
+ * @param hash The bloom filter hash of the point.
+ */
 static idxvtx
-mesh_add_pnt(struct mesh *mesh, struct pnt *npnt)
+mesh_add_pnt(struct mesh *mesh, struct pnt *npnt, uint64_t hash)
 {
     uint32_t idx;
     bool in_bloom;
     struct vertex *vertex;
 
-    in_bloom = mesh_bloom_query(mesh, npnt);
+    in_bloom = mesh_bloom_query(mesh, hash);
 
     if (in_bloom == false) {
         idx = mesh->vcount; /* not already in list */
@@ -285,7 +299,7 @@ mesh_add_pnt(struct mesh *mesh, struct pnt *npnt)
             mesh->valloc += 1000;
         }
 
-        mesh_bloom_insert(mesh, npnt);
+        mesh_bloom_insert(mesh, hash);
 
         vertex = vertex_from_index(mesh, idx);
         vertex->pnt = *npnt;
@@ -307,7 +321,10 @@ add_facet_to_vertex(struct mesh *mesh,
 
     vertex = vertex_from_index(mesh, ivertex);
 
-    assert(vertex->fcount < mesh->vertex_fcount);
+    if (vertex->fcount >= mesh->vertex_fcount) {
+        /* no room for another facet */
+        return false;
+    }
 
     vertex->facets[vertex->fcount++] = facet;
 
@@ -347,9 +364,12 @@ index_mesh(struct mesh *mesh,
 {
     struct facet *facet;
     struct facet *fend;
+    uint64_t hash[3];
 
     mesh->vertex_fcount = vertex_fcount;
 
+    trace_begin("index %u facets", mesh->fcount);
+
     /* initialise the bloom filter with enough entries for three vertex per
      * point and the complexity parameter (ok how many functions get run)
      */
@@ -362,15 +382,34 @@ index_mesh(struct mesh *mesh,
     /* manufacture pointlist and update indexed geometry */
     for (facet = mesh->f; facet < fend; facet++) {
 
-        /* update facet with indexed points */
-        facet->i[0] = mesh_add_pnt(mesh, &facet->v[0]);
-        facet->i[1] = mesh_add_pnt(mesh, &facet->v[1]);
-        facet->i[2] = mesh_add_pnt(mesh, &facet->v[2]);
+        /* hash all three corners up front so their filter blocks are
+         * fetched in parallel
+         */
+        hash[0] = mesh_bloom_hash(&facet->v[0]);
+        hash[1] = mesh_bloom_hash(&facet->v[1]);
+        hash[2] = mesh_bloom_hash(&facet->v[2]);
+        mesh_bloom_prefetch(mesh, hash[0]);
+        mesh_bloom_prefetch(mesh, hash[1]);
+        mesh_bloom_prefetch(mesh, hash[2]);
 
-        add_facet_to_vertex(mesh, facet, facet->i[0]);
-        add_facet_to_vertex(mesh, facet, facet->i[1]);
-        add_facet_to_vertex(mesh, facet, facet->i[2]);
+        /* update facet with indexed points */
+        facet->i[0] = mesh_add_pnt(mesh, &facet->v[0], hash[0]);
+        facet->i[1] = mesh_add_pnt(mesh, &facet->v[1], hash[1]);
+        facet->i[2] = mesh_add_pnt(mesh, &facet->v[2], hash[2]);
+
+        if (!add_facet_to_vertex(mesh, facet, facet->i[0]) ||
+            !add_facet_to_vertex(mesh, facet, facet->i[1]) ||
+            !add_facet_to_vertex(mesh, facet, facet->i[2])) {
+            trace_end();
+            fprintf(stderr,
+                    "a vertex is shared by more than %u facets, "
+                    "raise the vertex complexity with -c\n",
+                    vertex_fcount);
+            return false;
+        }
     }
 
-    return true;;
+    trace_end();
+
+    return true;
 }
@@ -12,13 +12,21 @@
 #ifndef PNG23D_MESH_INDEX_H
 #define PNG23D_MESH_INDEX_H 1
 
-/** add a facet to a vndexed vertex */
+/** add a facet to a vndexed vertex
+ *
+ * @return false if the vertex already refers to as many facets as the
+ *         vertex complexity allows.
+ */
 bool add_facet_to_vertex(struct mesh *mesh, struct facet *facet, idxvtx ivertex);
 
 /** remove a facet to a vndexed vertex */
 bool remove_facet_from_vertex(struct mesh *mesh, struct facet *facet, idxvtx ivertex);
 
-/** update the mesh geometry index representation */
+/** update the mesh geometry index representation
+ *
+ * @return false if a vertex is shared by more facets than the vertex
+ *         complexity allows.
+ */
 bool index_mesh(struct mesh *mesh, unsigned int bloom_complexity, unsigned int vertex_fcount);
 
 #endif
@@ -38,7 +38,7 @@ nepnt(struct pnt *p0, struct pnt *p1)
     }
 }
 
-static inline int 
+static inline float
 dot_product(pnt *a, pnt *b)
 {
     return ((a->x * b->x) + (a->y * b->y) + (a->z * b->z));
@@ -16,6 +16,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "option.h"
 #include "bitmap.h"
@@ -24,112 +27,11 @@
 #include "mesh_index.h"
 #include "mesh_simplify.h"
 #include "mesh_math.h"
+#include "meshlog.h"
+#include "trace.h"
 
 
 
-/* debug mesh dumping */
-
-static void
-dump_mesh_simplify_init(struct mesh *mesh)
-{
-    if (mesh->dumpfile == NULL)
-        return;
-
-    fprintf(mesh->dumpfile,
-            "<h2>Mesh Simplify</h2><p>Starting with %d facets and %d vertexes.\n",
-            mesh->fcount, mesh->vcount);
-
-    fprintf(mesh->dumpfile, "<table><tr>\n");
-}
-
-static void
-dump_mesh_simplify(struct mesh *mesh,
-          bool removing,
-          unsigned int start,
-          unsigned int end)
-{
-    unsigned int floop;
-    struct vertex *v0;
-    struct vertex *v1 = NULL;
-
-    if (mesh->dumpfile == NULL)
-        return;
-
-
-    v0 = vertex_from_index(mesh, start);
-
-    if (removing) {
-        v1 = vertex_from_index(mesh, end);
-        fprintf(mesh->dumpfile,
-                "<tr><th>Operation %d Removing %u->%u</th>",
-                mesh->dumpno, start, end);
-        mesh->dumpno++;
-    }
-
-    fprintf(mesh->dumpfile, "<td><svg width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n", DUMP_SVG_SIZE, DUMP_SVG_SIZE);
-
-    for (floop = 0; floop < mesh->fcount; floop++) {
-        if (same_normal(&mesh->f[floop].n, &v0->facets[0]->n)) {
-
-            fprintf(mesh->dumpfile,
-                    "<polygon points=\"%.1f,%.1f %.1f,%.1f %.1f,%.1f\" style=\"fill:lime;stroke:black;stroke-width=1\"/>\n",
-                    SVGPX(mesh->f[floop].v[0].x), SVGPY(mesh->f[floop].v[0].y),
-                    SVGPX(mesh->f[floop].v[1].x), SVGPY(mesh->f[floop].v[1].y),
-                    SVGPX(mesh->f[floop].v[2].x), SVGPY(mesh->f[floop].v[2].y));
-
-            /* label facet at centroid */
-            fprintf(mesh->dumpfile,
-                    "<text x=\"%.1f\" y=\"%.1f\" fill=\"blue\">%u</text>\n",
-                    (SVGPX(mesh->f[floop].v[0].x) +
-                     SVGPX(mesh->f[floop].v[1].x) +
-                     SVGPX(mesh->f[floop].v[2].x)) / 3,
-                    (SVGPY(mesh->f[floop].v[0].y) +
-                     SVGPY(mesh->f[floop].v[1].y) +
-                     SVGPY(mesh->f[floop].v[2].y)) / 3,
-                    floop);
-
-
-        }
-    }
-
-    if (v1 != NULL) {
-        fprintf(mesh->dumpfile,
-                "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" style=\"stroke:red;stroke-width:5\"/>\n",
-                SVGPX(v0->pnt.x), SVGPY(v0->pnt.y),
-                SVGPX(v1->pnt.x), SVGPY(v1->pnt.y));
-
-        fprintf(mesh->dumpfile,
-                "<text x=\"%.1f\" y=\"%.1f\" fill=\"black\">%u</text>\n",
-                SVGPX(v1->pnt.x) + 5, SVGPY(v1->pnt.y) + 5,  end);
-
-    }
-
-    fprintf(mesh->dumpfile,
-            "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"10\" fill=\"blue\"/>\n",
-            SVGPX(v0->pnt.x), SVGPY(v0->pnt.y));
-
-    fprintf(mesh->dumpfile,
-            "<text x=\"%.1f\" y=\"%.1f\" fill=\"black\">%u</text>\n",
-            SVGPX(v0->pnt.x) + 10, SVGPY(v0->pnt.y) + 5,  start);
-
-
-    fprintf(mesh->dumpfile, "</svg></td>");
-
-    if (!removing) {
-        fprintf(mesh->dumpfile, "</tr>");
-    }
-}
-
-static void
-dump_mesh_simplify_fini(struct mesh *mesh)
-{
-    if (mesh->dumpfile == NULL)
-        return;
-
-    fprintf(mesh->dumpfile,"</table>");
-}
-
-
 static void verify_mesh(struct mesh *mesh)
 {
     unsigned int floop; /* facet loop */
@@ -154,6 +56,37 @@ static void verify_mesh(struct mesh *mesh)
     }
 }
 
+/* monotonic time in nanoseconds */
+static uint64_t simplify_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* histogram of the number of facets on each vertex in use */
+static void
+valence_histogram(struct mesh *mesh, unsigned int *histogram)
+{
+    idxvtx vloop;
+    unsigned int fcount;
+
+    memset(histogram, 0, sizeof(unsigned int) * VALENCE_BUCKETS);
+
+    for (vloop = 0; vloop < mesh->vcount; vloop++) {
+        fcount = vertex_from_index(mesh, vloop)->fcount;
+        if (fcount == 0) {
+            continue; /* vertex no longer in use */
+        }
+        if (fcount >= VALENCE_BUCKETS) {
+            fcount = VALENCE_BUCKETS - 1;
+        }
+        histogram[fcount]++;
+    }
+}
+
 static bool
 check_move_ok(struct mesh *mesh, unsigned int from, unsigned int to)
 {
@@ -188,6 +121,7 @@ check_move_ok(struct mesh *mesh, unsigned int from, unsigned int to)
         } else {
             /* none of the facets verticies are the from vertex - uh oh */
             fprintf(stderr, "none of the facets verticies are the from vertex\n");
+            mesh->simplify.reject_index++;
             return false;
         }
 
@@ -196,11 +130,13 @@ check_move_ok(struct mesh *mesh, unsigned int from, unsigned int to)
         /* only allow creation of degenerate facets with common verticies */
         if (degenerate) {
             if ((nepnt(v0, v1)) && (nepnt(v1, v2)) && (nepnt(v2, v0))) {
+                mesh->simplify.reject_degenerate++;
                 return false;
             }
         } else {
             if (!same_normal(&nn, &fvtx->facets[floop]->n)) {
                 //fprintf(stderr, "normal changed (%.2f, %.2f, %.2f) to (%.2f, %.2f, %.2f)\n",fvtx->facets[floop]->n.x,fvtx->facets[floop]->n.y,fvtx->facets[floop]->n.z, nn.x,nn.y,nn.z);
+                mesh->simplify.reject_normal++;
                 return false;
             }
         }
@@ -270,7 +206,9 @@ move_facet_vertex(struct mesh *mesh,
         return false;
     }
     /* add facet to destination vertex */
-    add_facet_to_vertex(mesh, facet, to);
+    if (add_facet_to_vertex(mesh, facet, to) == false) {
+        return false;
+    }
 
     /* remove facet from original vertex */
     if (remove_facet_from_vertex(mesh, facet, from) == false) {
@@ -309,10 +247,15 @@ static bool
 merge_edge(struct mesh *mesh, idxvtx start, idxvtx end)
 {
     struct facet *facet;
+    struct vertex *svertex;
     struct vertex *evertex;
+    unsigned int corner;
+
+    meshlog_merge_start(mesh, start, end);
 
-    dump_mesh_simplify(mesh, true, start, end);
+    mesh->simplify.merges++;
 
+    svertex = vertex_from_index(mesh, start);
     evertex = vertex_from_index(mesh, end);
 
     /* change all the facets on end vertex to point at start virtex
@@ -324,33 +267,165 @@ merge_edge(struct mesh *mesh, idxvtx start, idxvtx end)
         facet = evertex->facets[0];
 
         if (facet_on_vertex(mesh, facet, start)) {
+            meshlog_facet_remove(mesh, facet);
             remove_facet(mesh, facet); /* remove degenerate facet */
+            mesh->simplify.facets_removed++;
         } else {
+            if (mesh->dumpfile != NULL) {
+                for (corner = 0; facet->i[corner] != end; corner++);
+                meshlog_facet_move(mesh, facet, corner, &svertex->pnt);
+            }
             move_facet_vertex(mesh, facet, end, start);
+            mesh->simplify.facets_moved++;
         }
     }
 
-    dump_mesh_simplify(mesh, false, start, end);
+    meshlog_merge_end(mesh);
 
     return false;
 }
 
-/** determinae if a vertex is topoligcally a removal candidate  */
-static bool 
-is_candidate(struct mesh *mesh, int ivtx)
+/** kinds of vertex which may be removed */
+enum candidate {
+    CANDIDATE_NONE, /**< vertex cannot be removed */
+    CANDIDATE_FLAT, /**< all facets lie in one plane */
+    CANDIDATE_CREASE, /**< facets lie in two planes meeting on a straight line */
+};
+
+/** is an edge from a vertex on the crease between two planes
+ *
+ * The edge is on the crease if it is shared by a facet in each plane.
+ */
+static bool
+is_crease_edge(struct vertex *vtx, pnt *n, idxvtx other)
+{
+    unsigned int floop; /* facet loop */
+    struct facet *facet;
+
+    for (floop = 0; floop < vtx->fcount; floop++) {
+        facet = vtx->facets[floop];
+        if (((facet->i[0] == other) ||
+             (facet->i[1] == other) ||
+             (facet->i[2] == other)) &&
+            same_normal(&facet->n, n)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** determine if a vertex between two planes lies on a straight crease
+ *
+ * There must be exactly two crease edges, one either side of the vertex,
+ * and they must be collinear. Moving the vertex along such a crease leaves
+ * both planes unchanged.
+ */
+static bool
+is_straight_crease(struct mesh *mesh, idxvtx ivtx, pnt *n0, pnt *n1)
+{
+    unsigned int floop; /* facet loop */
+    unsigned int vloop; /* vertex within facets */
+    struct vertex *vtx = vertex_from_index(mesh, ivtx);
+    struct facet *facet;
+    idxvtx other;
+    idxvtx crease[2];
+    unsigned int ccount = 0; /* number of crease edges found */
+    pnt a;
+    pnt b;
+    pnt cn;
+
+    for (floop = 0; floop < vtx->fcount; floop++) {
+        facet = vtx->facets[floop];
+        if (!same_normal(&facet->n, n0)) {
+            continue; /* crease edges are found from the first plane */
+        }
+
+        for (vloop = 0; vloop < 3; vloop++) {
+            other = facet->i[vloop];
+            if ((other == ivtx) ||
+                ((ccount > 0) && (crease[0] == other)) ||
+                ((ccount > 1) && (crease[1] == other))) {
+                continue;
+            }
+
+            if (is_crease_edge(vtx, n1, other)) {
+                if (ccount == 2) {
+                    return false; /* too many crease edges */
+                }
+                crease[ccount++] = other;
+            }
+        }
+    }
+
+    if (ccount != 2) {
+        return false;
+    }
+
+    /* crease edges must be collinear and on opposite sides of the vertex */
+    a.x = vertex_from_index(mesh, crease[0])->pnt.x - vtx->pnt.x;
+    a.y = vertex_from_index(mesh, crease[0])->pnt.y - vtx->pnt.y;
+    a.z = vertex_from_index(mesh, crease[0])->pnt.z - vtx->pnt.z;
+    b.x = vertex_from_index(mesh, crease[1])->pnt.x - vtx->pnt.x;
+    b.y = vertex_from_index(mesh, crease[1])->pnt.y - vtx->pnt.y;
+    b.z = vertex_from_index(mesh, crease[1])->pnt.z - vtx->pnt.z;
+
+    cross_product(&cn, &a, &b);
+    if ((cn.x != 0.0) || (cn.y != 0.0) || (cn.z != 0.0)) {
+        return false;
+    }
+
+    if (((a.x * b.x) + (a.y * b.y) + (a.z * b.z)) >= 0) {
+        return false;
+    }
+
+    return true;
+}
+
+/** determine what kind of removal candidate a vertex is */
+static enum candidate
+vertex_candidate(struct mesh *mesh, int ivtx)
 {
     unsigned int floop; /* facet loop */
     struct vertex *vtx = vertex_from_index(mesh, ivtx);
+    pnt *n0;
+    pnt *n1 = NULL;
+
+    if (vtx->fcount == 0) {
+        return CANDIDATE_FLAT;
+    }
 
     /* Every facet at the end of the edge must have a normal which is parallel
-     * and the same sign magnitude
+     * and the same sign magnitude as one of at most two planes
      */
+    n0 = &vtx->facets[0]->n;
     for (floop = 1; floop < vtx->fcount; floop++) {
-        if (!same_normal(&vtx->facets[floop - 1]->n, &vtx->facets[floop]->n))
-            return false;
+        if (same_normal(n0, &vtx->facets[floop]->n)) {
+            continue;
+        }
+
+        if (n1 == NULL) {
+            n1 = &vtx->facets[floop]->n;
+        } else if (!same_normal(n1, &vtx->facets[floop]->n)) {
+            return CANDIDATE_NONE;
+        }
     }
 
-    return true;
+    if (n1 == NULL) {
+        return CANDIDATE_FLAT;
+    }
+
+    if (is_straight_crease(mesh, ivtx, n0, n1)) {
+        return CANDIDATE_CREASE;
+    }
+
+    return CANDIDATE_NONE;
+}
+
+/** determinae if a vertex is topoligcally a removal candidate  */
+static bool
+is_candidate(struct mesh *mesh, int ivtx)
+{
+    return (vertex_candidate(mesh, ivtx) != CANDIDATE_NONE);
 }
 
 /** find an adjacent vertex suitabile for removal.
@@ -363,6 +438,7 @@ find_adjacent(struct mesh *mesh, unsigned int ivtx, unsigned int *avtx)
     struct vertex *vtx; /* initial vertex */
     unsigned int civtx; /* candidate vertex index */
     struct vertex *cvtx; /* candidate vertex */
+    enum candidate ctype; /* kind of candidate */
 
     vtx = vertex_from_index(mesh, ivtx);
 
@@ -376,7 +452,9 @@ find_adjacent(struct mesh *mesh, unsigned int ivtx, unsigned int *avtx)
                 continue; /* skip starting vertex */
             }
 
-            if (!is_candidate(mesh, civtx)) {
+            ctype = vertex_candidate(mesh, civtx);
+            if (ctype == CANDIDATE_NONE) {
+                mesh->simplify.reject_candidate++;
                 continue; /* skip non candidate verticies */
             }
 
@@ -386,6 +464,7 @@ find_adjacent(struct mesh *mesh, unsigned int ivtx, unsigned int *avtx)
              * complicated to represent
              */
             if (((vtx->fcount + cvtx->fcount) - 2) > mesh->vertex_fcount) {
+                mesh->simplify.reject_complexity++;
                 continue;
             }
 
@@ -394,6 +473,9 @@ find_adjacent(struct mesh *mesh, unsigned int ivtx, unsigned int *avtx)
             }
 
             /* found something suitable */
+            if (ctype == CANDIDATE_CREASE) {
+                mesh->simplify.crease_merges++;
+            }
             *avtx = civtx;
             return true;
 
@@ -405,25 +487,125 @@ find_adjacent(struct mesh *mesh, unsigned int ivtx, unsigned int *avtx)
 }
 
 
+/** order vertices by descending valence
+ *
+ * When simplification is bounded the most valuable work should be done
+ * first. The highest valence vertices are the centres of the largest flat
+ * fans the generators produce, so visiting them first removes facets from
+ * the densest regions before the limit is reached. A counting sort keeps
+ * this linear in the number of vertices.
+ */
+static idxvtx *
+valence_order(struct mesh *mesh)
+{
+    idxvtx *order;
+    unsigned int *start; /* first order entry for each valence */
+    unsigned int fcount;
+    unsigned int pos;
+    idxvtx vloop;
+
+    order = malloc(mesh->vcount * sizeof(idxvtx));
+    start = calloc(mesh->vertex_fcount + 2, sizeof(unsigned int));
+    if ((order == NULL) || (start == NULL)) {
+        free(order);
+        free(start);
+        return NULL;
+    }
+
+    /* count each valence, highest first */
+    for (vloop = 0; vloop < mesh->vcount; vloop++) {
+        fcount = vertex_from_index(mesh, vloop)->fcount;
+        start[(mesh->vertex_fcount - fcount) + 1]++;
+    }
+
+    for (fcount = 1; fcount <= mesh->vertex_fcount + 1; fcount++) {
+        start[fcount] += start[fcount - 1];
+    }
+
+    for (vloop = 0; vloop < mesh->vcount; vloop++) {
+        fcount = vertex_from_index(mesh, vloop)->fcount;
+        pos = start[mesh->vertex_fcount - fcount]++;
+        order[pos] = vloop;
+    }
+
+    free(start);
+
+    return order;
+}
+
 /* simplify mesh by half edge removal
  *
  * algorithm is:
  * find vertex where all facets have the same normal
  * search each vertex of each attached facet for one where all its facets have teh same normal
  * merge second vertex into first
+ *
+ * If a time limit or target facet count is given the vertices are visited
+ * in descending valence order and the simplification stops as soon as a
+ * limit is reached. Every merge leaves a valid mesh so stopping at any
+ * point is safe.
  */
 bool
-simplify_mesh(struct mesh *mesh)
+simplify_mesh(struct mesh *mesh, float time_limit, uint32_t target_fcount)
 {
-    unsigned int vloop = 0;
+    unsigned int oloop = 0; /* position in vertex visit order */
+    idxvtx vloop;
     unsigned int vtx1;
+    uint64_t pass_start;
+    uint64_t deadline = 0;
+    idxvtx *order = NULL;
+    unsigned int pass;
+    unsigned int steps = 0;
+
+    /* an empty mesh, such as an outline shrunk away, is never indexed */
+    if (mesh->fcount == 0) {
+        return true;
+    }
 
     /* ensure index tables are up to date */
     assert(mesh->v != NULL);
 
-    dump_mesh_simplify_init(mesh);
+    if (mesh->simplify.passes == 0) {
+        valence_histogram(mesh, mesh->simplify.valence_before);
+    }
+
+    meshlog_snapshot(mesh);
+
+    pass = mesh->simplify.passes++;
+    if (pass >= SIMPLIFY_TIMED_PASSES) {
+        pass = SIMPLIFY_TIMED_PASSES - 1;
+    }
+    pass_start = simplify_time();
+    trace_begin("simplify pass %u", mesh->simplify.passes);
+
+    if ((time_limit > 0) || (target_fcount > 0)) {
+        order = valence_order(mesh);
+        if (order == NULL) {
+            fprintf(stderr, "unable to order vertices, limits ignored\n");
+        }
+    }
+
+    if (time_limit > 0) {
+        deadline = pass_start + (uint64_t)(time_limit * 1000000000.0);
+    }
+
+    mesh->simplify.stop = SIMPLIFY_COMPLETE;
+
+    while (oloop < mesh->vcount) {
+        /* limits are only checked periodically to keep the cost low */
+        if ((deadline != 0) &&
+            ((++steps & 0xff) == 0) &&
+            (simplify_time() >= deadline)) {
+            mesh->simplify.stop = SIMPLIFY_DEADLINE;
+            break;
+        }
+
+        if (order != NULL) {
+            vloop = order[oloop];
+        } else {
+            vloop = oloop;
+        }
 
-    while (vloop < mesh->vcount) {
         /* find a candidate edge */
         if (is_candidate(mesh, vloop) &&
             find_adjacent(mesh, vloop, &vtx1)) {
@@ -431,17 +613,193 @@ simplify_mesh(struct mesh *mesh)
             /* collapse verticies */
             merge_edge(mesh, vloop, vtx1);
 
+            if ((target_fcount > 0) && (mesh->fcount <= target_fcount)) {
+                mesh->simplify.stop = SIMPLIFY_TARGET;
+                break;
+            }
+
             /* do *not* advance past this vertex as we may have just modified
              * it!
              */
         } else {
-            vloop++;
+            oloop++;
         }
     }
 
-    dump_mesh_simplify_fini(mesh);
+    mesh->simplify.examined += oloop;
+
+    free(order);
+
+    trace_end();
+    mesh->simplify.pass_time[pass] += simplify_time() - pass_start;
 
+    meshlog_snapshot(mesh);
+
+    trace_begin("simplify verify");
     verify_mesh(mesh);
+    trace_end();
+
+    valence_histogram(mesh, mesh->simplify.valence_after);
 
     return true;
 }
+
+/* write the current mesh as a level of detail output */
+static bool
+write_lod(struct mesh *mesh, options *options, unsigned int lod, mesh_writer *writer)
+{
+    char *filename;
+    int fd;
+    bool ret;
+
+    filename = lod_filename(options, lod);
+    if (filename == NULL) {
+        return false;
+    }
+
+    INFO("Writing level of detail %u with %u facets to \"%s\"\n",
+         lod + 1, mesh->fcount, filename);
+
+    fd = open(filename,
+              O_WRONLY | O_CREAT | O_TRUNC,
+              S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening level of detail output \"%s\"\n",
+                filename);
+        free(filename);
+        return false;
+    }
+
+    trace_begin("output lod %u", lod + 1);
+    ret = writer(mesh, fd, options);
+    trace_end();
+
+    close(fd);
+    free(filename);
+
+    return ret;
+}
+
+/* exported method documented in mesh_simplify.h
+ *
+ * The simplification only ever removes facets so a single run passes
+ * through every requested level of detail in turn. The run is split at each
+ * ratio's facet count and the mesh written out before carrying on, which
+ * gives the same result as recording the collapse sequence and replaying
+ * it without having to keep the sequence.
+ */
+bool
+simplify_mesh_lod(struct mesh *mesh, options *options, mesh_writer *writer)
+{
+    unsigned int lod;
+    uint32_t start_fcount = mesh->fcount;
+    uint32_t lod_fcount;
+    uint64_t start = simplify_time();
+    float remaining = options->simplify_time;
+    bool more = true; /* further simplification is possible */
+
+    for (lod = 0; lod < options->lod_count; lod++) {
+        lod_fcount = (uint32_t)(start_fcount * options->lod_ratio[lod]);
+        if (lod_fcount < options->simplify_fcount) {
+            lod_fcount = options->simplify_fcount;
+        }
+        if (lod_fcount == 0) {
+            lod_fcount = 1;
+        }
+
+        if (more && (mesh->fcount > lod_fcount)) {
+            simplify_mesh(mesh, remaining, lod_fcount);
+
+            /* once a pass completes or runs out of time no further facets
+             * can be removed so the remaining levels are all the same mesh.
+             */
+            more = (mesh->simplify.stop == SIMPLIFY_TARGET);
+        }
+
+        if (write_lod(mesh, options, lod, writer) == false) {
+            return false;
+        }
+
+        if (options->simplify_time > 0) {
+            remaining = options->simplify_time -
+                (simplify_time() - start) / 1000000000.0;
+            if (remaining <= 0) {
+                more = false;
+            }
+        }
+    }
+
+    if (more) {
+        return simplify_mesh(mesh, remaining, options->simplify_fcount);
+    }
+
+    return true;
+}
+
+/* exported method documented in mesh_simplify.h */
+void
+simplify_mesh_info(struct mesh *mesh, options *options)
+{
+    struct simplify_stats *stats = &mesh->simplify;
+    unsigned int loop;
+    unsigned int rejects;
+
+    if (!options->verbose) {
+        return;
+    }
+
+    rejects = stats->reject_candidate + stats->reject_complexity +
+              stats->reject_degenerate + stats->reject_normal +
+              stats->reject_index;
+
+    switch (stats->stop) {
+    case SIMPLIFY_COMPLETE:
+        INFO("Simplification completed examining all %u vertices\n",
+             stats->examined);
+        break;
+
+    case SIMPLIFY_DEADLINE:
+        INFO("Simplification reached time limit after examining %u of %u vertices (%u%%)\n",
+             stats->examined, mesh->vcount,
+             (stats->examined * 100) / mesh->vcount);
+        break;
+
+    case SIMPLIFY_TARGET:
+        INFO("Simplification reached target facet count after examining %u of %u vertices (%u%%)\n",
+             stats->examined, mesh->vcount,
+             (stats->examined * 100) / mesh->vcount);
+        break;
+    }
+
+    INFO("Simplification made %u passes collapsing %u edges (%u on creases), %u facets removed and %u moved\n",
+         stats->passes, stats->merges, stats->crease_merges,
+         stats->facets_removed, stats->facets_moved);
+
+    for (loop = 0; (loop < stats->passes) && (loop < SIMPLIFY_TIMED_PASSES); loop++) {
+        INFO("Simplification pass %u%s took %.3fms\n",
+             loop + 1,
+             ((loop + 1) == SIMPLIFY_TIMED_PASSES) ? " onwards" : "",
+             stats->pass_time[loop] / 1000000.0);
+    }
+
+    INFO("Simplification rejected %u adjacent vertex merges:\n", rejects);
+    INFO("  %u not coplanar or on a straight crease (not a candidate)\n", stats->reject_candidate);
+    INFO("  %u too many facets for vertex (raise -c)\n", stats->reject_complexity);
+    INFO("  %u would create degenerate facet\n", stats->reject_degenerate);
+    INFO("  %u would change facet normal\n", stats->reject_normal);
+    if (stats->reject_index != 0) {
+        INFO("  %u inconsistent vertex index\n", stats->reject_index);
+    }
+
+    INFO("Vertex valence histogram (facets: before after)\n");
+    for (loop = 1; loop < VALENCE_BUCKETS; loop++) {
+        if ((stats->valence_before[loop] != 0) ||
+            (stats->valence_after[loop] != 0)) {
+            INFO("  %2u%s: %8u %8u\n",
+                 loop,
+                 (loop == (VALENCE_BUCKETS - 1)) ? "+" : " ",
+                 stats->valence_before[loop],
+                 stats->valence_after[loop]);
+        }
+    }
+}
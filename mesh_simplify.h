@@ -12,7 +12,32 @@
 #ifndef PNG23D_MESH_SIMPLIFY_H
 #define PNG23D_MESH_SIMPLIFY_H 1
 
-/** remove uneccessary verticies */
-bool simplify_mesh(struct mesh *mesh);
+/** remove uneccessary verticies
+ *
+ * @param mesh The indexed mesh to simplify.
+ * @param time_limit The maximum time to spend in seconds or 0 for no limit.
+ * @param target_fcount Stop once the mesh has this many facets or 0 for no
+ *                      limit.
+ */
+bool simplify_mesh(struct mesh *mesh, float time_limit, uint32_t target_fcount);
+
+/** output routine used to write each level of detail */
+typedef bool (mesh_writer)(struct mesh *mesh, int fd, options *options);
+
+/** remove uneccessary verticies writing levels of detail along the way
+ *
+ * Each level of detail from the options is written with the writer to the
+ * file named by lod_filename() as soon as the simplification has reduced
+ * the facet count to its ratio of the starting count. The simplification
+ * then continues to the limits given in the options.
+ *
+ * @param mesh The indexed mesh to simplify.
+ * @param options The options giving the limits and level of detail ratios.
+ * @param writer The routine used to output each level of detail.
+ */
+bool simplify_mesh_lod(struct mesh *mesh, options *options, mesh_writer *writer);
+
+/** output simplification statistics when verbose */
+void simplify_mesh_info(struct mesh *mesh, options *options);
 
 #endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to process facets in structure of arrays blocks.
+ *
+ * The mesh keeps its facets as an array of structures because the indexing
+ * and simplification work a facet at a time through vertex facet lists. The
+ * bulk operations over every facet when writing output instead copy runs of
+ * facets into a block where each component has its own array and run simple
+ * loops over whole arrays, which the compiler turns into SIMD code.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh.h"
+#include "mesh_soa.h"
+
+/* copy one facet into a block entry */
+static inline void
+facet_block_set(struct facet_block *blk, unsigned int idx, const struct facet *facet)
+{
+    unsigned int corner;
+
+    for (corner = 0; corner < 3; corner++) {
+        blk->vx[corner][idx] = facet->v[corner].x;
+        blk->vy[corner][idx] = facet->v[corner].y;
+        blk->vz[corner][idx] = facet->v[corner].z;
+    }
+    blk->nx[idx] = facet->n.x;
+    blk->ny[idx] = facet->n.y;
+    blk->nz[idx] = facet->n.z;
+}
+
+/* keep the unused tail defined so the kernels never see garbage */
+static void facet_block_clear(struct facet_block *blk, unsigned int count)
+{
+    unsigned int corner;
+
+    if (count < FACET_BLOCK) {
+        for (corner = 0; corner < 3; corner++) {
+            memset(&blk->vx[corner][count], 0, (FACET_BLOCK - count) * sizeof(float));
+            memset(&blk->vy[corner][count], 0, (FACET_BLOCK - count) * sizeof(float));
+            memset(&blk->vz[corner][count], 0, (FACET_BLOCK - count) * sizeof(float));
+        }
+        memset(&blk->nx[count], 0, (FACET_BLOCK - count) * sizeof(float));
+        memset(&blk->ny[count], 0, (FACET_BLOCK - count) * sizeof(float));
+        memset(&blk->nz[count], 0, (FACET_BLOCK - count) * sizeof(float));
+    }
+}
+
+/* exported method documented in mesh_soa.h */
+void
+facet_block_load(struct facet_block *blk, const struct facet *facets, unsigned int count)
+{
+    unsigned int floop;
+
+    blk->count = count;
+
+    for (floop = 0; floop < count; floop++) {
+        facet_block_set(blk, floop, facets + floop);
+    }
+
+    facet_block_clear(blk, count);
+}
+
+/* exported method documented in mesh_soa.h */
+void
+facet_block_gather(struct facet_block *blk, const struct facet *facets, const uint32_t *order, unsigned int count)
+{
+    unsigned int floop;
+
+    blk->count = count;
+
+    for (floop = 0; floop < count; floop++) {
+        facet_block_set(blk, floop, facets + order[floop]);
+    }
+
+    facet_block_clear(blk, count);
+}
+
+/* exported method documented in mesh_soa.h */
+void
+facet_block_normals(struct facet_block *blk)
+{
+    unsigned int floop;
+    float ax, ay, az;
+    float bx, by, bz;
+
+    for (floop = 0; floop < FACET_BLOCK; floop++) {
+        ax = blk->vx[1][floop] - blk->vx[0][floop];
+        ay = blk->vy[1][floop] - blk->vy[0][floop];
+        az = blk->vz[1][floop] - blk->vz[0][floop];
+
+        bx = blk->vx[2][floop] - blk->vx[0][floop];
+        by = blk->vy[2][floop] - blk->vy[0][floop];
+        bz = blk->vz[2][floop] - blk->vz[0][floop];
+
+        blk->nx[floop] = ay * bz - az * by;
+        blk->ny[floop] = az * bx - ax * bz;
+        blk->nz[floop] = ax * by - ay * bx;
+    }
+}
+
+/* exported method documented in mesh_soa.h
+ *
+ * The module is built without errno setting maths so the square root is
+ * vectorised along with the rest of the loop.
+ */
+void
+facet_block_unit_normals(struct facet_block *blk)
+{
+    unsigned int floop;
+    float len;
+    float scale;
+
+    for (floop = 0; floop < FACET_BLOCK; floop++) {
+        len = sqrtf((blk->nx[floop] * blk->nx[floop]) +
+                    (blk->ny[floop] * blk->ny[floop]) +
+                    (blk->nz[floop] * blk->nz[floop]));
+
+        /* a zero length normal divides by one instead, leaving it zero
+         * without a branch in the loop
+         */
+        scale = 1.0f / (len + (len == 0.0f));
+
+        blk->nx[floop] *= scale;
+        blk->ny[floop] *= scale;
+        blk->nz[floop] *= scale;
+    }
+}
+
+/* exported method documented in mesh_soa.h */
+void
+facet_block_scale(struct facet_block *blk, float xyscale, float zscale)
+{
+    unsigned int floop;
+    unsigned int corner;
+
+    for (corner = 0; corner < 3; corner++) {
+        for (floop = 0; floop < FACET_BLOCK; floop++) {
+            blk->vx[corner][floop] *= xyscale;
+            blk->vy[corner][floop] *= xyscale;
+            blk->vz[corner][floop] *= zscale;
+        }
+    }
+}
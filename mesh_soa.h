@@ -0,0 +1,91 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * structure of arrays facet blocks header.
+ */
+
+#ifndef PNG23D_MESH_SOA_H
+#define PNG23D_MESH_SOA_H 1
+
+/** Number of facets held in a facet block */
+#define FACET_BLOCK 256
+
+/** A block of facets in structure of arrays layout
+ *
+ * Each coordinate of each corner is held in its own array so the block
+ * kernels operate on whole arrays at once and the compiler can vectorise
+ * them. The kernels always process the whole block, entries beyond count are
+ * ignored.
+ */
+struct facet_block {
+    unsigned int count; /**< number of valid facets in the block */
+    float vx[3][FACET_BLOCK] __attribute__((aligned(64))); /**< corner x */
+    float vy[3][FACET_BLOCK] __attribute__((aligned(64))); /**< corner y */
+    float vz[3][FACET_BLOCK] __attribute__((aligned(64))); /**< corner z */
+    float nx[FACET_BLOCK] __attribute__((aligned(64))); /**< normal x */
+    float ny[FACET_BLOCK] __attribute__((aligned(64))); /**< normal y */
+    float nz[FACET_BLOCK] __attribute__((aligned(64))); /**< normal z */
+};
+
+/** load facets into a block
+ *
+ * @param blk The block to load.
+ * @param facets The facets to load from.
+ * @param count The number of facets to load, at most FACET_BLOCK.
+ */
+void facet_block_load(struct facet_block *blk, const struct facet *facets, unsigned int count);
+
+/** load facets selected by index into a block
+ *
+ * @param blk The block to load.
+ * @param facets The facets to load from.
+ * @param order The indices of the facets to load.
+ * @param count The number of facets to load, at most FACET_BLOCK.
+ */
+void facet_block_gather(struct facet_block *blk, const struct facet *facets, const uint32_t *order, unsigned int count);
+
+/** compute the surface normal of every facet in a block
+ *
+ * The normals are the cross product of the facet edges, exactly as
+ * pnt_normal() computes them.
+ */
+void facet_block_normals(struct facet_block *blk);
+
+/** scale every normal in a block to unit length
+ *
+ * Zero length normals are left as zero.
+ */
+void facet_block_unit_normals(struct facet_block *blk);
+
+/** scale every vertex in a block
+ *
+ * @param blk The block to scale.
+ * @param xyscale The scale applied to the x and y axis.
+ * @param zscale The scale applied to the z axis.
+ */
+void facet_block_scale(struct facet_block *blk, float xyscale, float zscale);
+
+/** get a vertex from a block */
+static inline void
+facet_block_vertex(const struct facet_block *blk, unsigned int idx, unsigned int corner, pnt *pnt)
+{
+    pnt->x = blk->vx[corner][idx];
+    pnt->y = blk->vy[corner][idx];
+    pnt->z = blk->vz[corner][idx];
+}
+
+/** get a normal from a block */
+static inline void
+facet_block_normal(const struct facet_block *blk, unsigned int idx, pnt *pnt)
+{
+    pnt->x = blk->nx[idx];
+    pnt->y = blk->ny[idx];
+    pnt->z = blk->nz[idx];
+}
+
+#endif
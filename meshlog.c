@@ -0,0 +1,160 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to record the mesh debug event log.
+ *
+ * Rather than render the mesh on every operation the simplification
+ * operations are recorded as small fixed size events. A full snapshot of
+ * the facets is written whenever the events since the previous snapshot
+ * exceed the size of a snapshot, which bounds the log to a small multiple
+ * of the event volume while letting the renderer (meshlog2html) start
+ * replay close to any operation.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh.h"
+#include "meshlog.h"
+
+static void meshlog_header(struct mesh *mesh)
+{
+    uint32_t hdr[3];
+
+    hdr[0] = MESHLOG_VERSION;
+    hdr[1] = mesh->width;
+    hdr[2] = mesh->height;
+
+    fwrite(MESHLOG_MAGIC, MESHLOG_MAGIC_LEN, 1, mesh->dumpfile);
+    fwrite(hdr, sizeof(hdr), 1, mesh->dumpfile);
+
+    mesh->dumphdr = true;
+}
+
+static void
+meshlog_record(struct mesh *mesh,
+               enum meshlog_record type,
+               const void *payload)
+{
+    uint8_t rtype = type;
+    size_t size = meshlog_payload_size(type);
+
+    fwrite(&rtype, 1, 1, mesh->dumpfile);
+    fwrite(payload, size, 1, mesh->dumpfile);
+
+    mesh->dumpbytes += size + 1;
+}
+
+/* exported interface documented in meshlog.h */
+void meshlog_snapshot(struct mesh *mesh)
+{
+    uint32_t snap[2];
+    uint32_t floop;
+
+    if (mesh->dumpfile == NULL)
+        return;
+
+    if (!mesh->dumphdr) {
+        meshlog_header(mesh);
+    }
+
+    snap[0] = mesh->dumpno;
+    snap[1] = mesh->fcount;
+    meshlog_record(mesh, MESHLOG_SNAPSHOT, snap);
+
+    /* normal and vertices are contiguous at the start of each facet */
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        fwrite(&mesh->f[floop].n, MESHLOG_FACET_SIZE, 1, mesh->dumpfile);
+    }
+
+    mesh->dumpbytes = 0;
+}
+
+/* exported interface documented in meshlog.h */
+void meshlog_merge_start(struct mesh *mesh, idxvtx start, idxvtx end)
+{
+    struct {
+        uint32_t opno;
+        uint32_t start;
+        uint32_t end;
+        pnt spnt;
+        pnt epnt;
+        pnt n;
+    } rec;
+    struct vertex *svtx;
+
+    if (mesh->dumpfile == NULL)
+        return;
+
+    svtx = vertex_from_index(mesh, start);
+
+    rec.opno = mesh->dumpno;
+    rec.start = start;
+    rec.end = end;
+    rec.spnt = svtx->pnt;
+    rec.epnt = vertex_from_index(mesh, end)->pnt;
+    rec.n = svtx->facets[0]->n;
+
+    meshlog_record(mesh, MESHLOG_MERGE_START, &rec);
+}
+
+/* exported interface documented in meshlog.h */
+void meshlog_merge_end(struct mesh *mesh)
+{
+    uint32_t opno;
+
+    if (mesh->dumpfile == NULL)
+        return;
+
+    opno = mesh->dumpno++;
+    meshlog_record(mesh, MESHLOG_MERGE_END, &opno);
+
+    /* snapshot once the events would cost more to replay than to reload */
+    if (mesh->dumpbytes >= (mesh->fcount * MESHLOG_FACET_SIZE)) {
+        meshlog_snapshot(mesh);
+    }
+}
+
+/* exported interface documented in meshlog.h */
+void
+meshlog_facet_move(struct mesh *mesh,
+                   struct facet *facet,
+                   unsigned int corner,
+                   pnt *to)
+{
+    struct {
+        uint32_t facet;
+        uint32_t corner;
+        pnt to;
+    } rec;
+
+    if (mesh->dumpfile == NULL)
+        return;
+
+    rec.facet = facet - mesh->f;
+    rec.corner = corner;
+    rec.to = *to;
+
+    meshlog_record(mesh, MESHLOG_FACET_MOVE, &rec);
+}
+
+/* exported interface documented in meshlog.h */
+void meshlog_facet_remove(struct mesh *mesh, struct facet *facet)
+{
+    uint32_t idx;
+
+    if (mesh->dumpfile == NULL)
+        return;
+
+    idx = facet - mesh->f;
+
+    meshlog_record(mesh, MESHLOG_FACET_REMOVE, &idx);
+}
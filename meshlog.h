@@ -0,0 +1,104 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * mesh debug event log header.
+ *
+ * The log is a binary file in host byte order comprising a header followed
+ * by a sequence of records. Each record is a single type byte followed by a
+ * fixed size payload determined by the type, except snapshots which are
+ * followed by their facets.
+ *
+ * header:
+ *   UINT8[8]  - magic "png23dml"
+ *   UINT32    - version
+ *   UINT32    - conversion source width
+ *   UINT32    - conversion source height
+ *
+ * MESHLOG_SNAPSHOT:
+ *   UINT32    - operation number
+ *   UINT32    - facet count
+ *   foreach facet
+ *     REAL32[3]  - normal
+ *     REAL32[9]  - three vertices
+ *
+ * MESHLOG_MERGE_START:
+ *   UINT32    - operation number
+ *   UINT32[2] - start and end vertex index
+ *   REAL32[3] - start vertex location
+ *   REAL32[3] - end vertex location
+ *   REAL32[3] - normal of the plane being simplified
+ *
+ * MESHLOG_MERGE_END:
+ *   UINT32    - operation number
+ *
+ * MESHLOG_FACET_MOVE:
+ *   UINT32    - facet index
+ *   UINT32    - facet corner (0 to 2)
+ *   REAL32[3] - new location of corner
+ *
+ * MESHLOG_FACET_REMOVE:
+ *   UINT32    - facet index, the last facet is moved into this slot
+ */
+
+#ifndef PNG23D_MESHLOG_H
+#define PNG23D_MESHLOG_H 1
+
+#define MESHLOG_MAGIC "png23dml"
+#define MESHLOG_MAGIC_LEN 8
+#define MESHLOG_VERSION 1
+
+/** size of each facet in a snapshot */
+#define MESHLOG_FACET_SIZE (sizeof(pnt) * 4)
+
+enum meshlog_record {
+    MESHLOG_SNAPSHOT = 1,
+    MESHLOG_MERGE_START = 2,
+    MESHLOG_MERGE_END = 3,
+    MESHLOG_FACET_MOVE = 4,
+    MESHLOG_FACET_REMOVE = 5,
+};
+
+/** size of a records payload, snapshot facets excluded */
+static inline size_t
+meshlog_payload_size(enum meshlog_record type)
+{
+    switch (type) {
+    case MESHLOG_SNAPSHOT:
+        return sizeof(uint32_t) * 2;
+
+    case MESHLOG_MERGE_START:
+        return (sizeof(uint32_t) * 3) + (sizeof(pnt) * 3);
+
+    case MESHLOG_MERGE_END:
+        return sizeof(uint32_t);
+
+    case MESHLOG_FACET_MOVE:
+        return (sizeof(uint32_t) * 2) + sizeof(pnt);
+
+    case MESHLOG_FACET_REMOVE:
+        return sizeof(uint32_t);
+    }
+    return 0;
+}
+
+/** record a snapshot of every facet in the mesh */
+void meshlog_snapshot(struct mesh *mesh);
+
+/** record the start of an edge merge */
+void meshlog_merge_start(struct mesh *mesh, idxvtx start, idxvtx end);
+
+/** record the end of an edge merge */
+void meshlog_merge_end(struct mesh *mesh);
+
+/** record a facet corner moving to a new location */
+void meshlog_facet_move(struct mesh *mesh, struct facet *facet, unsigned int corner, pnt *to);
+
+/** record the removal of a facet */
+void meshlog_facet_remove(struct mesh *mesh, struct facet *facet);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Render a mesh debug event log as HTML.
+ *
+ * The log is first scanned to find the last snapshot at or before the
+ * requested range, the facets are reloaded from there and the events
+ * replayed. Each merge operation within the range is rendered as SVG of
+ * the facets on the plane being simplified before and after the merge.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mesh.h"
+#include "mesh_math.h"
+#include "meshlog.h"
+
+/** merge start record */
+struct merge_start {
+    uint32_t opno;
+    uint32_t start;
+    uint32_t end;
+    pnt spnt;
+    pnt epnt;
+    pnt n;
+};
+
+/** facet move record */
+struct facet_move {
+    uint32_t facet;
+    uint32_t corner;
+    pnt to;
+};
+
+static bool
+read_header(FILE *logf, struct mesh *mesh)
+{
+    char magic[MESHLOG_MAGIC_LEN];
+    uint32_t hdr[3];
+
+    if ((fread(magic, MESHLOG_MAGIC_LEN, 1, logf) != 1) ||
+        (memcmp(magic, MESHLOG_MAGIC, MESHLOG_MAGIC_LEN) != 0) ||
+        (fread(hdr, sizeof(hdr), 1, logf) != 1) ||
+        (hdr[0] != MESHLOG_VERSION)) {
+        return false;
+    }
+
+    mesh->width = hdr[1];
+    mesh->height = hdr[2];
+
+    /* avoid division by zero in the SVG scaling */
+    if (mesh->width == 0) {
+        mesh->width = 1;
+    }
+
+    return true;
+}
+
+/* read the next records type and payload, returns 0 at end of log */
+static int
+read_record(FILE *logf, void *payload)
+{
+    uint8_t rtype;
+    size_t size;
+
+    if (fread(&rtype, 1, 1, logf) != 1) {
+        return 0;
+    }
+
+    size = meshlog_payload_size(rtype);
+    if ((size == 0) || (fread(payload, size, 1, logf) != 1)) {
+        fprintf(stderr, "Corrupt mesh log record\n");
+        return 0;
+    }
+
+    return rtype;
+}
+
+/* load the facets of a snapshot */
+static bool
+read_snapshot(FILE *logf, struct mesh *mesh, uint32_t fcount)
+{
+    uint32_t floop;
+
+    if (fcount > mesh->falloc) {
+        mesh->f = realloc(mesh->f, fcount * sizeof(struct facet));
+        if (mesh->f == NULL) {
+            return false;
+        }
+        mesh->falloc = fcount;
+    }
+
+    for (floop = 0; floop < fcount; floop++) {
+        if (fread(&mesh->f[floop].n, MESHLOG_FACET_SIZE, 1, logf) != 1) {
+            return false;
+        }
+    }
+    mesh->fcount = fcount;
+
+    return true;
+}
+
+/* offset of last snapshot at or before operation first */
+static long
+find_snapshot(FILE *logf, uint32_t first)
+{
+    long offset;
+    long best = -1;
+    uint8_t payload[64];
+    uint32_t *snap = (uint32_t *)payload;
+    int rtype;
+
+    offset = ftell(logf);
+    while ((rtype = read_record(logf, payload)) != 0) {
+        if (rtype == MESHLOG_SNAPSHOT) {
+            if (snap[0] > first) {
+                break;
+            }
+            best = offset;
+            fseek(logf, snap[1] * MESHLOG_FACET_SIZE, SEEK_CUR);
+        }
+        offset = ftell(logf);
+    }
+
+    return best;
+}
+
+static void
+render_svg(FILE *outf,
+           struct mesh *mesh,
+           pnt *n,
+           pnt *spnt, uint32_t start,
+           pnt *epnt, uint32_t end)
+{
+    unsigned int floop;
+
+    fprintf(outf, "<td><svg width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n", DUMP_SVG_SIZE, DUMP_SVG_SIZE);
+
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        if (same_normal(&mesh->f[floop].n, n)) {
+
+            fprintf(outf,
+                    "<polygon points=\"%.1f,%.1f %.1f,%.1f %.1f,%.1f\" style=\"fill:lime;stroke:black;stroke-width=1\"/>\n",
+                    SVGPX(mesh->f[floop].v[0].x), SVGPY(mesh->f[floop].v[0].y),
+                    SVGPX(mesh->f[floop].v[1].x), SVGPY(mesh->f[floop].v[1].y),
+                    SVGPX(mesh->f[floop].v[2].x), SVGPY(mesh->f[floop].v[2].y));
+
+            /* label facet at centroid */
+            fprintf(outf,
+                    "<text x=\"%.1f\" y=\"%.1f\" fill=\"blue\">%u</text>\n",
+                    (SVGPX(mesh->f[floop].v[0].x) +
+                     SVGPX(mesh->f[floop].v[1].x) +
+                     SVGPX(mesh->f[floop].v[2].x)) / 3,
+                    (SVGPY(mesh->f[floop].v[0].y) +
+                     SVGPY(mesh->f[floop].v[1].y) +
+                     SVGPY(mesh->f[floop].v[2].y)) / 3,
+                    floop);
+        }
+    }
+
+    if (epnt != NULL) {
+        fprintf(outf,
+                "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" style=\"stroke:red;stroke-width:5\"/>\n",
+                SVGPX(spnt->x), SVGPY(spnt->y),
+                SVGPX(epnt->x), SVGPY(epnt->y));
+
+        fprintf(outf,
+                "<text x=\"%.1f\" y=\"%.1f\" fill=\"black\">%u</text>\n",
+                SVGPX(epnt->x) + 5, SVGPY(epnt->y) + 5, end);
+    }
+
+    if (spnt != NULL) {
+        fprintf(outf,
+                "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"10\" fill=\"blue\"/>\n",
+                SVGPX(spnt->x), SVGPY(spnt->y));
+
+        fprintf(outf,
+                "<text x=\"%.1f\" y=\"%.1f\" fill=\"black\">%u</text>\n",
+                SVGPX(spnt->x) + 10, SVGPY(spnt->y) + 5, start);
+    }
+
+    fprintf(outf, "</svg></td>");
+}
+
+/* apply a facet move event */
+static void
+replay_move(struct mesh *mesh, struct facet_move *move)
+{
+    struct facet *facet;
+
+    if (move->facet >= mesh->fcount) {
+        return;
+    }
+    facet = mesh->f + move->facet;
+    facet->v[move->corner % 3] = move->to;
+    pnt_normal(&facet->n, &facet->v[0], &facet->v[1], &facet->v[2]);
+}
+
+/* apply a facet removal event */
+static void
+replay_remove(struct mesh *mesh, uint32_t idx)
+{
+    if (idx >= mesh->fcount) {
+        return;
+    }
+    mesh->fcount--;
+    mesh->f[idx] = mesh->f[mesh->fcount];
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    uint32_t first = 0;
+    uint32_t last = UINT32_MAX;
+    pnt plane = { 0, 0, 1 };
+    FILE *logf;
+    FILE *outf;
+    struct mesh mesh;
+    long offset;
+    uint8_t payload[64];
+    uint32_t *snap = (uint32_t *)payload;
+    struct merge_start current;
+    int rtype;
+    bool in_merge = false;
+    uint32_t ops = 0;
+
+    while ((opt = getopt(argc, argv, "s:e:p:")) != -1) {
+        switch (opt) {
+        case 's': /* first operation */
+            first = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'e': /* last operation */
+            last = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'p': /* plane normal for final mesh */
+            if (sscanf(optarg, "%f,%f,%f", &plane.x, &plane.y, &plane.z) != 3) {
+                fprintf(stderr, "plane must be given as x,y,z\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        default:
+            goto usage;
+        }
+    }
+
+    if ((optind + 1) >= argc) {
+        goto usage;
+    }
+
+    logf = fopen(argv[optind], "rb");
+    if (logf == NULL) {
+        fprintf(stderr, "Unable to open mesh log %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&mesh, 0, sizeof(mesh));
+    if (!read_header(logf, &mesh)) {
+        fprintf(stderr, "%s is not a png23d mesh log\n", argv[optind]);
+        fclose(logf);
+        return EXIT_FAILURE;
+    }
+
+    offset = find_snapshot(logf, first);
+    if (offset < 0) {
+        fprintf(stderr, "Mesh log contains no snapshot\n");
+        fclose(logf);
+        return EXIT_FAILURE;
+    }
+    fseek(logf, offset, SEEK_SET);
+
+    outf = fopen(argv[optind + 1], "w");
+    if (outf == NULL) {
+        fprintf(stderr, "Unable to open output %s\n", argv[optind + 1]);
+        fclose(logf);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(outf,"<html>\n<body>");
+    fprintf(outf, "<h2>Mesh Simplify</h2><p>Operations %u to ", first);
+    if (last == UINT32_MAX) {
+        fprintf(outf, "end");
+    } else {
+        fprintf(outf, "%u", last);
+    }
+    fprintf(outf, "</p>\n<table>\n");
+
+    while ((rtype = read_record(logf, payload)) != 0) {
+        switch (rtype) {
+        case MESHLOG_SNAPSHOT:
+            if (!read_snapshot(logf, &mesh, snap[1])) {
+                fprintf(stderr, "Corrupt mesh log snapshot\n");
+                rtype = 0;
+            }
+            break;
+
+        case MESHLOG_MERGE_START:
+            memcpy(&current, payload, sizeof(current));
+            in_merge = ((current.opno >= first) && (current.opno <= last));
+            if (in_merge) {
+                fprintf(outf,
+                        "<tr><th>Operation %u Removing %u->%u</th>",
+                        current.opno, current.start, current.end);
+                render_svg(outf, &mesh, &current.n,
+                           &current.spnt, current.start,
+                           &current.epnt, current.end);
+            }
+            break;
+
+        case MESHLOG_MERGE_END:
+            if (in_merge) {
+                render_svg(outf, &mesh, &current.n,
+                           &current.spnt, current.start,
+                           NULL, 0);
+                fprintf(outf, "</tr>\n");
+                in_merge = false;
+                ops++;
+            }
+            if (snap[0] >= last) {
+                rtype = 0; /* range complete */
+            }
+            break;
+
+        case MESHLOG_FACET_MOVE:
+            replay_move(&mesh, (struct facet_move *)payload);
+            break;
+
+        case MESHLOG_FACET_REMOVE:
+            replay_remove(&mesh, snap[0]);
+            break;
+        }
+
+        if (rtype == 0) {
+            break;
+        }
+    }
+
+    fprintf(outf, "</table>\n");
+
+    /* reaching the end of the log leaves the final mesh */
+    if (rtype == 0 && feof(logf)) {
+        fprintf(outf, "<h2>Final mesh</h2>");
+
+        fprintf(outf,
+                "<p>Final mesh had %u facets.</p>\n", mesh.fcount);
+
+        fprintf(outf,"<p>Mesh of all facets with normal (%.1f,%.1f,%.1f)</p>\n<table><tr>", plane.x, plane.y, plane.z);
+        render_svg(outf, &mesh, &plane, NULL, 0, NULL, 0);
+        fprintf(outf,"</tr></table>\n");
+    }
+
+    fprintf(outf,"</body>\n</html>\n");
+
+    fclose(outf);
+    fclose(logf);
+    free(mesh.f);
+
+    fprintf(stderr, "Rendered %u operations\n", ops);
+
+    return EXIT_SUCCESS;
+
+usage:
+    fprintf(stderr,
+            "Usage: meshlog2html [-s first] [-e last] [-p x,y,z] logfile outfile\n\n"
+            "\tlogfile\tThe mesh debug log written by png23d -m\n"
+            "\toutfile\tThe HTML file to write\n"
+            "\t-s\tFirst merge operation to render\n"
+            "\t-e\tLast merge operation to render\n"
+            "\t-p\tNormal of the plane to show for the final mesh\n");
+    return EXIT_FAILURE;
+}
@@ -16,14 +16,161 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
 
 #include "option.h"
 
+/* parse comma separated level of detail ratios into descending order */
+static bool parse_lod(options *options, char *arg)
+{
+    char *end;
+    float ratio;
+    unsigned int pos;
+
+    options->lod_count = 0;
+
+    do {
+        ratio = strtof(arg, &end);
+        if ((end == arg) || (ratio <= 0) || (ratio >= 1)) {
+            fprintf(stderr, "level of detail ratios must be between 0 and 1\n");
+            return false;
+        }
+
+        if (options->lod_count == LOD_MAX) {
+            fprintf(stderr, "at most %d levels of detail may be given\n", LOD_MAX);
+            return false;
+        }
+
+        /* insertion keeps the most detailed level first */
+        pos = options->lod_count++;
+        while ((pos > 0) && (options->lod_ratio[pos - 1] < ratio)) {
+            options->lod_ratio[pos] = options->lod_ratio[pos - 1];
+            pos--;
+        }
+        options->lod_ratio[pos] = ratio;
+
+        arg = end + 1;
+    } while (*end == ',');
+
+    if (*end != 0) {
+        fprintf(stderr, "level of detail ratios must be between 0 and 1\n");
+        return false;
+    }
+
+    return true;
+}
+
+/* parse comma separated index:height body heights */
+static bool parse_bodies(options *options, char *arg)
+{
+    char *end;
+    unsigned long idx;
+    float height;
+
+    do {
+        idx = strtoul(arg, &end, 0);
+        if ((end == arg) || (*end != ':') || (idx > 255)) {
+            fprintf(stderr, "body heights must be given as index:height\n");
+            return false;
+        }
+
+        arg = end + 1;
+        height = strtof(arg, &end);
+        if ((end == arg) || (height < 0)) {
+            fprintf(stderr, "body heights cannot be negative\n");
+            return false;
+        }
+        options->body_height[idx] = height;
+
+        arg = end + 1;
+    } while (*end == ',');
+
+    if (*end != 0) {
+        fprintf(stderr, "body heights must be given as index:height\n");
+        return false;
+    }
+
+    return true;
+}
+
+/* parse a kind:size edge profile */
+static bool parse_profile(options *options, char *arg)
+{
+    char *size;
+
+    size = strchr(arg, ':');
+    if (size == NULL) {
+        fprintf(stderr, "edge profile must be given as chamfer:size or fillet:size\n");
+        return false;
+    }
+    *size++ = 0;
+
+    if (strcmp(arg, "chamfer") == 0) {
+        options->profile = PROFILE_CHAMFER;
+    } else if (strcmp(arg, "fillet") == 0) {
+        options->profile = PROFILE_FILLET;
+    } else {
+        fprintf(stderr, "Unknown edge profile %s\n", arg);
+        return false;
+    }
+
+    options->profile_size = strtof(size, NULL);
+    if (!isfinite(options->profile_size) || (options->profile_size <= 0)) {
+        fprintf(stderr, "edge profile size must be a positive number\n");
+        return false;
+    }
+
+    return true;
+}
+
+/* output types written from a mesh */
+static bool mesh_output_type(enum output_type type)
+{
+    return ((type == OUTPUT_STL) ||
+            (type == OUTPUT_ASTL) ||
+            (type == OUTPUT_SCAD) ||
+            (type == OUTPUT_3MF));
+}
+
+/* exported method documented in option.h */
+char *
+lod_filename(options *options, unsigned int lod)
+{
+    char *filename;
+    char *ext;
+    char *base;
+    size_t len;
+
+    len = strlen(options->outfile) + 16;
+    filename = malloc(len);
+    if (filename == NULL) {
+        return NULL;
+    }
+
+    base = strrchr(options->outfile, '/');
+    if (base == NULL) {
+        base = options->outfile;
+    }
+    ext = strrchr(base, '.');
+    if ((ext == NULL) || (ext == base)) {
+        ext = options->outfile + strlen(options->outfile);
+    }
+
+    snprintf(filename, len, "%.*s-lod%u%s",
+             (int)(ext - options->outfile), options->outfile, lod + 1, ext);
+
+    return filename;
+}
+
 options *
 read_options(int argc, char **argv)
 {
     int opt;
+    unsigned int idx;
     options *options;
+    bool depth_set = false;
+    bool complexity_set = false;
+    bool stack = false;
 
     options = calloc(1, sizeof(struct options));
     if (options == NULL) {
@@ -42,11 +189,16 @@ read_options(int argc, char **argv)
     options->width = 0.0;
     options->height = 0.0;
     options->depth = 1.0;
+    options->resolution = 0.0;
     options->bloom_complexity = 2;
     options->vertex_complexity = 16;
+    options->curve_tolerance = 1.0;
+    for (idx = 0; idx < 256; idx++) {
+        options->body_height[idx] = 1.0;
+    }
 
     /* parse comamndline options */
-    while ((opt = getopt(argc, argv, "Vvf:w:d:h:m:t:l:o:O:b:c:")) != -1) {
+    while ((opt = getopt(argc, argv, "Vvf:w:d:h:m:t:l:o:O:b:c:T:r:s:n:L:R:e:SPB:g:E:")) != -1) {
         switch (opt) {
 
         case 't': /* transparent colour */
@@ -95,11 +247,16 @@ read_options(int argc, char **argv)
 
         case 'd': /* output depth */
             options->depth = strtof(optarg, NULL);
+            depth_set = true;
             break;
 
         case 'o': /* output type */
             if (strcmp(optarg, "pgm") == 0) {
                 options->type = OUTPUT_PGM;
+            } else if (strcmp(optarg, "bpgm") == 0) {
+                options->type = OUTPUT_BPGM;
+            } else if (strcmp(optarg, "png") == 0) {
+                options->type = OUTPUT_PNG;
             } else if (strcmp(optarg, "rscad") == 0) {
                 options->type = OUTPUT_RSCAD;
             } else if (strcmp(optarg, "scad") == 0) {
@@ -108,6 +265,12 @@ read_options(int argc, char **argv)
                 options->type = OUTPUT_STL;
             } else if (strcmp(optarg, "astl") == 0) {
                 options->type = OUTPUT_ASTL;
+            } else if (strcmp(optarg, "svg") == 0) {
+                options->type = OUTPUT_SVG;
+            } else if (strcmp(optarg, "oscad") == 0) {
+                options->type = OUTPUT_OSCAD;
+            } else if (strcmp(optarg, "3mf") == 0) {
+                options->type = OUTPUT_3MF;
             } else {
                 fprintf(stderr, "Unknown output type %s\n", optarg);
                 goto read_options_error;
@@ -117,6 +280,83 @@ read_options(int argc, char **argv)
 
         case 'O': /* optimisation level */
             options->optimise = strtoul(optarg, NULL,0);
+            if (options->optimise > OPTIMISE_CLUSTER) {
+                fprintf(stderr, "optimisation level must be between 0 and 3\n");
+                goto read_options_error;
+            }
+            break;
+
+        case 'r': /* vertex clustering resolution */
+            options->resolution = strtof(optarg, NULL);
+            if (options->resolution < 0) {
+                fprintf(stderr, "resolution cannot be negative\n");
+                goto read_options_error;
+            }
+            break;
+
+        case 's': /* simplification time limit */
+            options->simplify_time = strtof(optarg, NULL);
+            if (options->simplify_time < 0) {
+                fprintf(stderr, "simplification time limit cannot be negative\n");
+                goto read_options_error;
+            }
+            break;
+
+        case 'n': /* simplification target facet count */
+            options->simplify_fcount = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'e': /* outline curve fitting tolerance */
+            options->curve_tolerance = strtof(optarg, NULL);
+            if (options->curve_tolerance < 0) {
+                fprintf(stderr, "curve fitting tolerance cannot be negative\n");
+                goto read_options_error;
+            }
+            break;
+
+        case 'g': /* outline offset */
+            options->offset = strtof(optarg, NULL);
+            if (!isfinite(options->offset)) {
+                fprintf(stderr, "outline offset must be a number\n");
+                goto read_options_error;
+            }
+            break;
+
+        case 'E': /* top edge profile */
+            if (parse_profile(options, optarg) == false) {
+                goto read_options_error;
+            }
+            break;
+
+        case 'L': /* level of detail ratios */
+            if (parse_lod(options, optarg) == false) {
+                goto read_options_error;
+            }
+            break;
+
+        case 'R': /* headerless raw input dimensions */
+            if ((sscanf(optarg, "%ux%u",
+                        &options->raw_width, &options->raw_height) != 2) ||
+                (options->raw_width == 0) ||
+                (options->raw_height == 0)) {
+                fprintf(stderr, "raw input size must be given as widthxheight\n");
+                goto read_options_error;
+            }
+            break;
+
+        case 'S': /* input is a stack of slices */
+            stack = true;
+            break;
+
+        case 'P': /* a body for each palette index */
+            options->palette = true;
+            break;
+
+        case 'B': /* palette index body heights */
+            if (parse_bodies(options, optarg) == false) {
+                goto read_options_error;
+            }
+            options->palette = true;
             break;
 
         case 'b': /* bloom filter complexity */
@@ -129,6 +369,7 @@ read_options(int argc, char **argv)
 
         case 'c': /* indexed vertex complexity */
             options->vertex_complexity = strtoul(optarg, NULL, 0);
+            complexity_set = true;
             if (options->vertex_complexity > 128) {
                 fprintf(stderr, "vertex complexity must be between 8 and 128\n");
                 goto read_options_error;
@@ -139,6 +380,10 @@ read_options(int argc, char **argv)
             options->meshdebug = strdup(optarg);
             break;
 
+        case 'T': /* execution trace output filename */
+            options->tracefile = strdup(optarg);
+            break;
+
         case 'V':
             fprintf(stderr, "png23d version %d.%02d\n",
                     VERSION / 100, VERSION % 100);
@@ -155,7 +400,11 @@ read_options(int argc, char **argv)
     }
 
 
-    if (((options->finish == FINISH_RECT) ||
+    /* rectangular cuboid and outline output ignore the finish */
+    if ((options->type != OUTPUT_RSCAD) &&
+        (options->type != OUTPUT_SVG) &&
+        (options->type != OUTPUT_OSCAD) &&
+        ((options->finish == FINISH_RECT) ||
          (options->finish == FINISH_SMOOTH)) &&
         (options->levels != 1)) {
         fprintf(stderr, "Rectangular Cuboid and Marching square finish only support a single level\n");
@@ -168,7 +417,131 @@ read_options(int argc, char **argv)
         goto read_options_error;
     }
     options->infile = strdup(argv[optind]);
-    options->outfile = strdup(argv[optind + 1]);
+    if (stack) {
+        /* the output follows every slice */
+        options->outfile = strdup(argv[argc - 1]);
+    } else {
+        options->outfile = strdup(argv[optind + 1]);
+    }
+
+    if (options->palette) {
+        if (!mesh_output_type(options->type)) {
+            fprintf(stderr, "palette bodies require a mesh output type\n");
+            goto read_options_error;
+        }
+        if ((options->levels != 1) || stack) {
+            fprintf(stderr, "palette bodies cannot be combined with levels or slices\n");
+            goto read_options_error;
+        }
+        if (options->optimise == OPTIMISE_CLUSTER) {
+            /* clustering merges vertices of neighbouring bodies */
+            fprintf(stderr, "palette bodies cannot be simplified by clustering\n");
+            goto read_options_error;
+        }
+
+        /* bodies meeting at a corner each keep their own walls there */
+        if (!complexity_set) {
+            options->vertex_complexity = 32;
+        }
+    }
+
+    if (stack) {
+        if (!mesh_output_type(options->type)) {
+            fprintf(stderr, "slice stacks require a mesh output type\n");
+            goto read_options_error;
+        }
+        if ((options->finish != FINISH_CUBE) &&
+            (options->finish != FINISH_SMOOTH)) {
+            fprintf(stderr, "slice stacks require cube or smooth finish\n");
+            goto read_options_error;
+        }
+        if (options->levels != 1) {
+            fprintf(stderr, "slice stacks cannot be quantised into levels\n");
+            goto read_options_error;
+        }
+
+        options->slices = argv + optind;
+        options->slice_count = argc - 1 - optind;
+
+        /* each slice is a level of the output */
+        options->levels = options->slice_count;
+
+        /* resolved from the output width once the slice size is known */
+        if (!depth_set) {
+            options->depth = 0;
+        }
+
+        /* voxels meeting at a corner can share more facets than pixels */
+        if (!complexity_set) {
+            options->vertex_complexity = 32;
+        }
+    }
+
+    /* 3mf keeps each level as a separate body for multiple materials */
+    if ((options->type == OUTPUT_3MF) &&
+        (options->levels > 1) &&
+        !stack &&
+        (options->finish == FINISH_CUBE)) {
+        if (options->optimise == OPTIMISE_CLUSTER) {
+            fprintf(stderr, "level bodies cannot be simplified by clustering\n");
+            goto read_options_error;
+        }
+        options->level_bodies = true;
+    }
+
+    if ((options->profile != PROFILE_NONE) &&
+        !mesh_output_type(options->type)) {
+        fprintf(stderr, "edge profiles require a mesh output type\n");
+        goto read_options_error;
+    }
+
+    if ((options->profile != PROFILE_NONE) &&
+        (options->optimise == OPTIMISE_CLUSTER)) {
+        /* clustering snaps the profile heights onto whole levels */
+        fprintf(stderr, "edge profiles cannot be simplified by clustering\n");
+        goto read_options_error;
+    }
+
+    /* both are generated from the distance field of the outline */
+    if ((options->offset != 0) || (options->profile != PROFILE_NONE)) {
+        if ((options->type != OUTPUT_SVG) &&
+            (options->type != OUTPUT_OSCAD) &&
+            !mesh_output_type(options->type)) {
+            fprintf(stderr, "outline offset requires an outline or mesh output type\n");
+            goto read_options_error;
+        }
+        if (options->transparent > 255) {
+            fprintf(stderr, "outline offset and edge profiles require a transparent colour\n");
+            goto read_options_error;
+        }
+        if ((options->levels != 1) || options->palette || stack) {
+            fprintf(stderr, "outline offset and edge profiles cannot be combined with levels, palette bodies or slices\n");
+            goto read_options_error;
+        }
+        if (options->finish == FINISH_SURFACE) {
+            fprintf(stderr, "outline offset and edge profiles cannot be used with surface finish\n");
+            goto read_options_error;
+        }
+    }
+
+    if (options->lod_count > 0) {
+        if ((options->optimise != OPTIMISE_EDGE) &&
+            (options->optimise != OPTIMISE_QEM)) {
+            fprintf(stderr, "levels of detail require edge simplification\n");
+            goto read_options_error;
+        }
+        if ((options->type != OUTPUT_STL) &&
+            (options->type != OUTPUT_ASTL) &&
+            (options->type != OUTPUT_SCAD) &&
+            (options->type != OUTPUT_3MF)) {
+            fprintf(stderr, "levels of detail require a mesh output type\n");
+            goto read_options_error;
+        }
+        if (strcmp(options->outfile, "-") == 0) {
+            fprintf(stderr, "levels of detail require an output filename\n");
+            goto read_options_error;
+        }
+    }
 
     return options;
 
@@ -176,11 +549,18 @@ read_options_error:
     fprintf(stderr,
             "Usage: png23d [-t transparent] [-V] [-v] [-f finish] [-O optimisation]\n"
             "              [-w width] [-h height] [-d depth] [-l levels] [-o outtype]\n"
-            "              [-b complexity] [-m filename] infile outfile\n\n"
-            "\tinfile\tThe input file\n"
+            "              [-b complexity] [-r resolution] [-s seconds] [-n facets]\n"
+            "              [-L ratio[,ratio...]] [-R widthxheight] [-e tolerance]\n"
+            "              [-P] [-B index:height[,index:height...]] [-g offset]\n"
+            "              [-E chamfer:size|fillet:size]\n"
+            "              [-m filename] [-T filename] infile outfile\n"
+            "       png23d -S [options] slice... outfile\n\n"
+            "\tinfile\tThe png, pgm or ppm input file or - for stdin\n"
+            "\tslice\tInput files stacked in z order with -S\n"
             "\toutfile\tThe output file or - for stdout\n"
             "\t-l\tNumber of levels to quantise the heightmap into.\n"
-            "\t-o\tThe output file type. One of pgm, bscad, pscad, stl, astl\n");
+            "\t-o\tThe output file type. One of pgm, bpgm, png, rscad, scad, stl, astl,\n"
+            "\t\tsvg, oscad, 3mf\n");
 
     free(options);
     return NULL;
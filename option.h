@@ -21,12 +21,27 @@
 
 enum output_type {
     OUTPUT_PGM,
+    OUTPUT_BPGM,
+    OUTPUT_PNG,
     OUTPUT_SCAD,
     OUTPUT_RSCAD,
     OUTPUT_STL,
     OUTPUT_ASTL,
+    OUTPUT_SVG,
+    OUTPUT_OSCAD,
+    OUTPUT_3MF,
 };
 
+enum optimise_level {
+    OPTIMISE_NONE = 0, /* no mesh optimisation */
+    OPTIMISE_EDGE = 1, /* edge removal */
+    OPTIMISE_QEM = 2, /* quadratic surface removal (unimplemented) */
+    OPTIMISE_CLUSTER = 3, /* vertex clustering */
+};
+
+/* maximum number of level of detail outputs */
+#define LOD_MAX 8
+
 enum output_finish {
     FINISH_CUBE,
     FINISH_RECT,
@@ -34,6 +49,12 @@ enum output_finish {
     FINISH_SURFACE,
 };
 
+enum edge_profile {
+    PROFILE_NONE, /* square top edges */
+    PROFILE_CHAMFER, /* sloped top edges */
+    PROFILE_FILLET, /* rounded top edges */
+};
+
 typedef struct options {
     time_t start_time;
 
@@ -59,16 +80,52 @@ typedef struct options {
     char *infile; /* input filename */
     char *outfile; /* output filename */
 
+    bool palette; /* generate a body for each palette index */
+    float body_height[256]; /* height of each palette index body relative to depth */
+    bool level_bodies; /* generate a body for each level */
+
+    char **slices; /* slice filenames in z order */
+    unsigned int slice_count; /* number of slices, 0 if not a stack */
+
+    unsigned int raw_width; /* width of headerless raw input, 0 if not raw */
+    unsigned int raw_height; /* height of headerless raw input */
+
     float width; /* the target width */
     float height; /* the target height */
     float depth; /* the target depth */
 
+    float resolution; /* grid size for vertex clustering in output units */
+
+    float simplify_time; /* maximum time to spend simplifying in seconds */
+    unsigned int simplify_fcount; /* target facet count for simplification */
+
+    float curve_tolerance; /* outline curve fitting tolerance in pixels, 0 for none */
+
+    float offset; /* outline offset in output units, positive grows */
+
+    enum edge_profile profile; /* profile of the top edges */
+    float profile_size; /* width and height of the edge profile in output units */
+
+    float lod_ratio[LOD_MAX]; /* level of detail facet ratios, descending */
+    unsigned int lod_count; /* number of level of detail outputs */
+
     char *meshdebug; /* filename for mesh debug output */
 
+    char *tracefile; /* filename for execution trace output */
+
 } options;
 
 
 options *read_options(int argc, char **argv);
 
+/** filename for a level of detail output
+ *
+ * The level number is inserted before the extension of the output filename
+ * so "logo.stl" becomes "logo-lod1.stl" for the first level.
+ *
+ * @return The filename which the caller must free or NULL on error.
+ */
+char *lod_filename(options *options, unsigned int lod);
+
 
 #endif
@@ -0,0 +1,695 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to output in 3MF format
+ *
+ * A 3MF file is a zip archive holding the model as XML. Each body of the
+ * mesh is written as a closed object with its own vertex list; when there
+ * are several bodies each object also has a base material of its own, so
+ * bodies meeting at a wall do not share it. The XML is formatted straight
+ * into a text buffer which is deflated as it fills, so the archive is
+ * streamed and may be written to a pipe. Entry sizes follow the data in
+ * zip data descriptors.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "option.h"
+#include "bitmap.h"
+#include "mesh.h"
+#include "mesh_gen.h"
+#include "mesh_index.h"
+#include "mesh_simplify.h"
+#include "mesh_cluster.h"
+#include "outbuf.h"
+#include "out_3mf.h"
+#include "trace.h"
+
+/** size of the text buffer deflated each time it fills */
+#define TMF_TEXT_SIZE (64 * 1024)
+
+/** longest text of a single vertex or triangle element */
+#define TMF_LINE 128
+
+/** size of the deflate output buffer */
+#define TMF_ZOUT_SIZE (64 * 1024)
+
+/** number of parts in the archive */
+#define TMF_PARTS 3
+
+/** zip archive entry */
+struct tmf_part {
+    const char *name; /**< name within the archive */
+    uint32_t crc; /**< crc32 of the uncompressed data */
+    uint32_t csize; /**< compressed size */
+    uint32_t usize; /**< uncompressed size */
+    uint32_t offset; /**< offset of the local header */
+};
+
+/** streamed zip archive writer */
+struct tmf_zip {
+    struct outbuf *ob;
+    bool error; /**< an error has occurred */
+    uint64_t offset; /**< bytes written to the archive */
+    uint16_t dos_time; /**< modification time of entries */
+    uint16_t dos_date; /**< modification date of entries */
+
+    struct tmf_part part[TMF_PARTS];
+    unsigned int pcount; /**< number of parts started */
+
+    z_stream zs; /**< deflate state of the current part */
+    uint64_t usize; /**< uncompressed size of the current part */
+    uint64_t csize; /**< compressed size of the current part */
+    uint32_t crc; /**< crc32 of the current part */
+
+    char text[TMF_TEXT_SIZE]; /**< text waiting to be deflated */
+    size_t tlen; /**< length of waiting text */
+    uint8_t zout[TMF_ZOUT_SIZE]; /**< deflate output */
+};
+
+static inline uint8_t *tmf_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t *tmf_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static void tmf_write(struct tmf_zip *zip, const void *data, size_t len)
+{
+    if (outbuf_write(zip->ob, data, len) == false) {
+        zip->error = true;
+    }
+    zip->offset += len;
+}
+
+/* deflate the waiting text */
+static void tmf_deflate(struct tmf_zip *zip, int flush)
+{
+    int ret;
+
+    zip->crc = crc32(zip->crc, (uint8_t *)zip->text, zip->tlen);
+    zip->usize += zip->tlen;
+
+    zip->zs.next_in = (uint8_t *)zip->text;
+    zip->zs.avail_in = zip->tlen;
+    do {
+        zip->zs.next_out = zip->zout;
+        zip->zs.avail_out = TMF_ZOUT_SIZE;
+
+        ret = deflate(&zip->zs, flush);
+        if (ret == Z_STREAM_ERROR) {
+            zip->error = true;
+            break;
+        }
+
+        zip->csize += TMF_ZOUT_SIZE - zip->zs.avail_out;
+        tmf_write(zip, zip->zout, TMF_ZOUT_SIZE - zip->zs.avail_out);
+    } while ((zip->zs.avail_out == 0) ||
+             ((flush == Z_FINISH) && (ret != Z_STREAM_END)));
+
+    zip->tlen = 0;
+}
+
+/* space for at least TMF_LINE characters of text */
+static inline char *tmf_reserve(struct tmf_zip *zip)
+{
+    if ((zip->tlen + TMF_LINE) > TMF_TEXT_SIZE) {
+        tmf_deflate(zip, Z_NO_FLUSH);
+    }
+    return zip->text + zip->tlen;
+}
+
+static void tmf_text(struct tmf_zip *zip, const char *text)
+{
+    size_t len = strlen(text);
+    size_t space;
+
+    while (len > 0) {
+        space = TMF_TEXT_SIZE - zip->tlen;
+        if (space == 0) {
+            tmf_deflate(zip, Z_NO_FLUSH);
+            space = TMF_TEXT_SIZE;
+        }
+        if (space > len) {
+            space = len;
+        }
+        memcpy(zip->text + zip->tlen, text, space);
+        zip->tlen += space;
+        text += space;
+        len -= space;
+    }
+}
+
+/* start a deflated entry, sizes follow the data in a descriptor */
+static void tmf_part_begin(struct tmf_zip *zip, const char *name)
+{
+    uint8_t hdr[30];
+    uint8_t *p = hdr;
+    struct tmf_part *part = &zip->part[zip->pcount++];
+
+    part->name = name;
+    part->offset = zip->offset;
+
+    p = tmf_put32(p, 0x04034b50); /* local file header signature */
+    p = tmf_put16(p, 20); /* version needed to extract */
+    p = tmf_put16(p, 0x0008); /* sizes in data descriptor */
+    p = tmf_put16(p, 8); /* deflate */
+    p = tmf_put16(p, zip->dos_time);
+    p = tmf_put16(p, zip->dos_date);
+    p = tmf_put32(p, 0); /* crc */
+    p = tmf_put32(p, 0); /* compressed size */
+    p = tmf_put32(p, 0); /* uncompressed size */
+    p = tmf_put16(p, strlen(name));
+    p = tmf_put16(p, 0); /* extra field length */
+    tmf_write(zip, hdr, p - hdr);
+    tmf_write(zip, name, strlen(name));
+
+    memset(&zip->zs, 0, sizeof(z_stream));
+    if (deflateInit2(&zip->zs, Z_BEST_SPEED, Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        zip->error = true;
+    }
+    zip->crc = crc32(0, NULL, 0);
+    zip->usize = 0;
+    zip->csize = 0;
+    zip->tlen = 0;
+}
+
+static void tmf_part_end(struct tmf_zip *zip)
+{
+    uint8_t desc[16];
+    uint8_t *p = desc;
+    struct tmf_part *part = &zip->part[zip->pcount - 1];
+
+    tmf_deflate(zip, Z_FINISH);
+    deflateEnd(&zip->zs);
+
+    if ((zip->usize > UINT32_MAX) || (zip->offset > UINT32_MAX)) {
+        fprintf(stderr, "3mf output is limited to 4GiB\n");
+        zip->error = true;
+    }
+
+    part->crc = zip->crc;
+    part->csize = zip->csize;
+    part->usize = zip->usize;
+
+    p = tmf_put32(p, 0x08074b50); /* data descriptor signature */
+    p = tmf_put32(p, part->crc);
+    p = tmf_put32(p, part->csize);
+    p = tmf_put32(p, part->usize);
+    tmf_write(zip, desc, p - desc);
+}
+
+/* write the central directory */
+static void tmf_zip_end(struct tmf_zip *zip)
+{
+    uint8_t hdr[46];
+    uint8_t *p;
+    unsigned int ploop;
+    uint32_t start = zip->offset;
+
+    for (ploop = 0; ploop < zip->pcount; ploop++) {
+        p = hdr;
+        p = tmf_put32(p, 0x02014b50); /* central file header signature */
+        p = tmf_put16(p, 20); /* version made by */
+        p = tmf_put16(p, 20); /* version needed to extract */
+        p = tmf_put16(p, 0x0008);
+        p = tmf_put16(p, 8);
+        p = tmf_put16(p, zip->dos_time);
+        p = tmf_put16(p, zip->dos_date);
+        p = tmf_put32(p, zip->part[ploop].crc);
+        p = tmf_put32(p, zip->part[ploop].csize);
+        p = tmf_put32(p, zip->part[ploop].usize);
+        p = tmf_put16(p, strlen(zip->part[ploop].name));
+        p = tmf_put16(p, 0); /* extra field length */
+        p = tmf_put16(p, 0); /* comment length */
+        p = tmf_put16(p, 0); /* disk number */
+        p = tmf_put16(p, 0); /* internal attributes */
+        p = tmf_put32(p, 0); /* external attributes */
+        p = tmf_put32(p, zip->part[ploop].offset);
+        tmf_write(zip, hdr, p - hdr);
+        tmf_write(zip, zip->part[ploop].name, strlen(zip->part[ploop].name));
+    }
+
+    p = hdr;
+    p = tmf_put32(p, 0x06054b50); /* end of central directory signature */
+    p = tmf_put16(p, 0); /* disk number */
+    p = tmf_put16(p, 0); /* disk with central directory */
+    p = tmf_put16(p, zip->pcount);
+    p = tmf_put16(p, zip->pcount);
+    p = tmf_put32(p, zip->offset - start);
+    p = tmf_put32(p, start);
+    p = tmf_put16(p, 0); /* comment length */
+    tmf_write(zip, hdr, p - hdr);
+}
+
+/* format an unsigned integer */
+static inline char *tmf_uint(char *p, uint32_t v)
+{
+    char digits[10];
+    unsigned int len = 0;
+
+    do {
+        digits[len++] = '0' + (v % 10);
+        v = v / 10;
+    } while (v != 0);
+
+    while (len > 0) {
+        *p++ = digits[--len];
+    }
+    return p;
+}
+
+/* format a value to six decimal places without trailing zeros */
+static inline char *tmf_float(char *p, float v)
+{
+    int64_t fixed;
+    uint32_t frac;
+    unsigned int len = 6;
+    unsigned int dloop;
+
+    fixed = (int64_t)(((double)v * 1000000.0) + ((v < 0) ? -0.5 : 0.5));
+    if (fixed < 0) {
+        *p++ = '-';
+        fixed = -fixed;
+    }
+
+    p = tmf_uint(p, fixed / 1000000);
+
+    frac = fixed % 1000000;
+    if (frac != 0) {
+        while ((frac % 10) == 0) {
+            frac = frac / 10;
+            len--;
+        }
+        *p++ = '.';
+        for (dloop = len; dloop > 0; dloop--) {
+            p[dloop - 1] = '0' + (frac % 10);
+            frac = frac / 10;
+        }
+        p += len;
+    }
+    return p;
+}
+
+static const char tmf_content_types[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+    " <Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+    " <Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+    "</Types>\n";
+
+static const char tmf_rels[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+    " <Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+    "</Relationships>\n";
+
+/** facet at a position in the output order */
+static inline struct facet *
+tmf_facet(struct mesh *mesh, const uint32_t *order, uint32_t floop)
+{
+    if (order == NULL) {
+        return mesh->f + floop;
+    }
+    return mesh->f + order[floop];
+}
+
+/** vertex numbering of the object being written */
+struct tmf_numbers {
+    uint32_t *number; /**< output number of each vertex within its object */
+    uint32_t *stamp; /**< object which last numbered each vertex, plus one */
+    idxvtx *used; /**< vertices of the current object in output order */
+    uint32_t count; /**< number of vertices in the current object */
+};
+
+/* number the vertices used by a range of facets
+ *
+ * Simplification leaves vertices which no facet uses in the index and each
+ * body is written with its own vertices, only those in use are written, in
+ * the order the facets first use them. A vertex's stamp shows whether its
+ * number belongs to the current object, so nothing is reset between bodies
+ * and every body together costs a single pass over the facets.
+ */
+static void
+tmf_vertex_numbers(struct mesh *mesh,
+                   struct tmf_numbers *nums,
+                   const uint32_t *order,
+                   uint32_t first,
+                   uint32_t last,
+                   uint32_t object)
+{
+    struct facet *facet;
+    unsigned int floop;
+    unsigned int vloop;
+    idxvtx ivtx;
+
+    nums->count = 0;
+    for (floop = first; floop < last; floop++) {
+        facet = tmf_facet(mesh, order, floop);
+        for (vloop = 0; vloop < 3; vloop++) {
+            ivtx = facet->i[vloop];
+            if (nums->stamp[ivtx] != (object + 1)) {
+                nums->stamp[ivtx] = object + 1;
+                nums->number[ivtx] = nums->count;
+                nums->used[nums->count++] = ivtx;
+            }
+        }
+    }
+}
+
+/* lowest coordinates used by any facet, every body is moved by the same */
+static void tmf_origin(struct mesh *mesh, pnt *min)
+{
+    unsigned int floop;
+    unsigned int vloop;
+    struct vertex *vertex;
+
+    min->x = min->y = min->z = 0;
+    for (floop = 0; floop < mesh->fcount; floop++) {
+        for (vloop = 0; vloop < 3; vloop++) {
+            vertex = vertex_from_index(mesh, mesh->f[floop].i[vloop]);
+            if ((floop == 0) || (vertex->pnt.x < min->x)) {
+                min->x = vertex->pnt.x;
+            }
+            if ((floop == 0) || (vertex->pnt.y < min->y)) {
+                min->y = vertex->pnt.y;
+            }
+            if ((floop == 0) || (vertex->pnt.z < min->z)) {
+                min->z = vertex->pnt.z;
+            }
+        }
+    }
+}
+
+/* write the numbered vertices moved to start at the origin */
+static void
+tmf_write_vertices(struct tmf_zip *zip,
+                   struct mesh *mesh,
+                   const struct tmf_numbers *nums,
+                   const pnt *min,
+                   options *options)
+{
+    unsigned int vloop;
+    struct vertex *vertex;
+    float xyscale = options->width / mesh->width;
+    float zscale = options->depth / options->levels;
+    char *p;
+
+    trace_begin("output vertices");
+    tmf_text(zip, "<vertices>\n");
+    for (vloop = 0; vloop < nums->count; vloop++) {
+        vertex = vertex_from_index(mesh, nums->used[vloop]);
+
+        p = tmf_reserve(zip);
+        memcpy(p, "<vertex x=\"", 11);
+        p = tmf_float(p + 11, (vertex->pnt.x - min->x) * xyscale);
+        memcpy(p, "\" y=\"", 5);
+        p = tmf_float(p + 5, (vertex->pnt.y - min->y) * xyscale);
+        memcpy(p, "\" z=\"", 5);
+        p = tmf_float(p + 5, (vertex->pnt.z - min->z) * zscale);
+        memcpy(p, "\"/>\n", 4);
+        zip->tlen = (p + 4) - zip->text;
+    }
+    tmf_text(zip, "</vertices>\n");
+    trace_end();
+}
+
+/* write a range of triangles */
+static void
+tmf_write_triangles(struct tmf_zip *zip,
+                    struct mesh *mesh,
+                    const uint32_t *number,
+                    const uint32_t *order,
+                    uint32_t first,
+                    uint32_t last)
+{
+    unsigned int tloop;
+    struct facet *facet;
+    char *p;
+
+    tmf_text(zip, "<triangles>\n");
+    for (tloop = first; tloop < last; tloop++) {
+        if (((tloop - first) % TRACE_OUT_CHUNK) == 0) {
+            if (tloop != first) {
+                trace_end();
+            }
+            trace_begin("output facets %u", tloop);
+        }
+
+        facet = tmf_facet(mesh, order, tloop);
+
+        p = tmf_reserve(zip);
+        memcpy(p, "<triangle v1=\"", 14);
+        p = tmf_uint(p + 14, number[facet->i[0]]);
+        memcpy(p, "\" v2=\"", 6);
+        p = tmf_uint(p + 6, number[facet->i[1]]);
+        memcpy(p, "\" v3=\"", 6);
+        p = tmf_uint(p + 6, number[facet->i[2]]);
+        memcpy(p, "\"/>\n", 4);
+        zip->tlen = (p + 4) - zip->text;
+    }
+
+    if (last != first) {
+        trace_end();
+    }
+    tmf_text(zip, "</triangles>\n");
+}
+
+/* write a range of facets as a mesh object */
+static void
+tmf_write_object(struct tmf_zip *zip,
+                 struct mesh *mesh,
+                 struct tmf_numbers *nums,
+                 const pnt *min,
+                 const uint32_t *order,
+                 uint32_t first,
+                 uint32_t last,
+                 uint32_t object,
+                 const char *text,
+                 options *options)
+{
+    tmf_vertex_numbers(mesh, nums, order, first, last, object);
+
+    tmf_text(zip, text);
+    tmf_text(zip, "<mesh>\n");
+    tmf_write_vertices(zip, mesh, nums, min, options);
+    tmf_write_triangles(zip, mesh, nums->number, order, first, last);
+    tmf_text(zip,
+             "</mesh>\n"
+             "</object>\n");
+}
+
+/* write an indexed mesh as a 3mf archive */
+static bool
+tmf_write_mesh(struct mesh *mesh, int fd, options *options)
+{
+    struct tmf_zip *zip;
+    struct tmf_numbers nums;
+    uint32_t *order = NULL;
+    uint32_t bstart[257];
+    unsigned int ocount = 0; /* number of objects */
+    unsigned int body;
+    char line[TMF_LINE];
+    time_t now;
+    struct tm *tm;
+    pnt min;
+    bool ret;
+
+    zip = calloc(1, sizeof(struct tmf_zip));
+    if (zip == NULL) {
+        return false;
+    }
+
+    /* one allocation holds the number, stamp and used arrays */
+    nums.number = calloc(3 * (mesh->vcount + 1), sizeof(uint32_t));
+    if (nums.number == NULL) {
+        free(zip);
+        return false;
+    }
+    nums.stamp = nums.number + mesh->vcount + 1;
+    nums.used = nums.stamp + mesh->vcount + 1;
+
+    if (mesh->multibody) {
+        order = mesh_body_order(mesh, bstart);
+        if (order == NULL) {
+            free(nums.number);
+            free(zip);
+            return false;
+        }
+    }
+
+    zip->ob = outbuf_open(fd);
+    if (zip->ob == NULL) {
+        free(nums.number);
+        free(order);
+        free(zip);
+        return false;
+    }
+
+    now = options->start_time;
+    tm = localtime(&now);
+    if ((tm != NULL) && (tm->tm_year >= 80)) {
+        zip->dos_time = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2);
+        zip->dos_date = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
+    }
+
+    tmf_origin(mesh, &min);
+
+    tmf_part_begin(zip, "[Content_Types].xml");
+    tmf_text(zip, tmf_content_types);
+    tmf_part_end(zip);
+
+    tmf_part_begin(zip, "_rels/.rels");
+    tmf_text(zip, tmf_rels);
+    tmf_part_end(zip);
+
+    tmf_part_begin(zip, "3D/3dmodel.model");
+    tmf_text(zip,
+             "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+             "<metadata name=\"Application\">png23d</metadata>\n"
+             "<resources>\n");
+
+    if (order != NULL) {
+        /* a base material for each body which has facets */
+        tmf_text(zip, "<basematerials id=\"1\">\n");
+        for (body = 0; body < 256; body++) {
+            if (bstart[body] == bstart[body + 1]) {
+                continue;
+            }
+            snprintf(line, sizeof(line),
+                     "<base name=\"body %u\" displaycolor=\"#%06X\"/>\n",
+                     body, (unsigned int)mesh->body_colour[body]);
+            tmf_text(zip, line);
+        }
+        tmf_text(zip, "</basematerials>\n");
+
+        /* each body is a closed object of its own material */
+        for (body = 0; body < 256; body++) {
+            if (bstart[body] == bstart[body + 1]) {
+                continue;
+            }
+            snprintf(line, sizeof(line),
+                     "<object id=\"%u\" name=\"body %u\" type=\"model\" pid=\"1\" pindex=\"%u\">\n",
+                     ocount + 2, body, ocount);
+            tmf_write_object(zip, mesh, &nums, &min, order,
+                             bstart[body], bstart[body + 1], ocount,
+                             line, options);
+            ocount++;
+        }
+    } else {
+        tmf_write_object(zip, mesh, &nums, &min, NULL, 0, mesh->fcount, 0,
+                         "<object id=\"2\" type=\"model\">\n", options);
+        ocount = 1;
+    }
+
+    tmf_text(zip,
+             "</resources>\n"
+             "<build>\n");
+    for (body = 0; body < ocount; body++) {
+        snprintf(line, sizeof(line), "<item objectid=\"%u\"/>\n", body + 2);
+        tmf_text(zip, line);
+    }
+    tmf_text(zip,
+             "</build>\n"
+             "</model>\n");
+    tmf_part_end(zip);
+
+    tmf_zip_end(zip);
+
+    ret = outbuf_close(zip->ob) && !zip->error;
+
+    free(nums.number);
+    free(order);
+    free(zip);
+
+    return ret;
+}
+
+/* 3mf output */
+bool output_3mf(bitmap *bm, int fd, options *options)
+{
+    struct mesh *mesh;
+    uint32_t start_vcount;
+    bool ret;
+
+    mesh = new_mesh();
+    if (mesh == NULL) {
+        fprintf(stderr,"unable to create mesh\n");
+        return false;
+    }
+
+    debug_mesh_init(mesh, options->meshdebug);
+
+    trace_begin("generate");
+    if (mesh_from_bitmap(mesh, bm, options) == false) {
+        trace_end();
+        fprintf(stderr,"unable to convert bitmap to mesh\n");
+        free_mesh(mesh);
+        return false;
+    }
+    trace_end();
+
+    if (options->optimise == OPTIMISE_CLUSTER) {
+        /* clustering is performed before the mesh is indexed */
+        if (cluster_mesh_options(mesh, options) == false) {
+            free_mesh(mesh);
+            return false;
+        }
+    }
+
+    start_vcount = mesh->fcount * 3; /* each facet has 3 vertex */
+
+    INFO("Indexing %d vertices\n", start_vcount);
+    if (index_mesh(mesh, options->bloom_complexity,
+                   options->vertex_complexity) == false) {
+        free_mesh(mesh);
+        return false;
+    }
+
+    if ((options->optimise > 0) && (options->optimise != OPTIMISE_CLUSTER)) {
+        INFO("Simplification of mesh with %d facets using %d unique verticies\n",
+             mesh->fcount, mesh->vcount);
+
+        if (simplify_mesh_lod(mesh, options, tmf_write_mesh) == false) {
+            free_mesh(mesh);
+            return false;
+        }
+
+        INFO("Result mesh has %d facets using %d unique verticies\n",
+             mesh->fcount, mesh->vcount);
+
+        simplify_mesh_info(mesh, options);
+    }
+
+    INFO("Writing 3MF output\n");
+
+    ret = tmf_write_mesh(mesh, fd, options);
+
+    free_mesh(mesh);
+
+    return ret;
+}
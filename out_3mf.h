@@ -0,0 +1,17 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * 3MF format output header.
+ */
+
+#ifndef PNG23D_OUT_3MF_H
+#define PNG23D_OUT_3MF_H 1
+
+bool output_3mf(bitmap *bm, int fd, options *options);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to output the outline of the opaque area as an extruded
+ * polygon in SCAD format
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "option.h"
+#include "bitmap.h"
+#include "outline.h"
+#include "outbuf.h"
+#include "out_oscad.h"
+#include "trace.h"
+
+/** fraction of the fitting tolerance curves are flattened to */
+#define OSCAD_FLATNESS 0.25f
+
+/* the scad polygon uses the even-odd rule across its paths so holes are
+ * cut out
+ */
+bool output_outline_scad(bitmap *bm, int fd, options *options)
+{
+    struct outline *ol;
+    struct opnt *pnts = NULL;
+    unsigned int pcount = 0;
+    unsigned int palloc = 0;
+    unsigned int *pstart; /* first point of each loop */
+    unsigned int lloop;
+    unsigned int ploop;
+    int xoff; /* x offset so 3d model is centered */
+    int yoff; /* y offset so 3d model is centered */
+    struct outbuf *ob;
+    bool ret = true;
+
+    trace_begin("outline");
+    if (options->offset != 0) {
+        ol = outline_offset(bm, options->transparent,
+                            options->offset * bm->width / options->width,
+                            options->curve_tolerance);
+    } else {
+        ol = outline_from_bitmap(bm, options->transparent, options->curve_tolerance);
+    }
+    trace_end();
+    if (ol == NULL) {
+        fprintf(stderr, "unable to trace outline\n");
+        return false;
+    }
+
+    pstart = malloc((ol->lcount + 1) * sizeof(unsigned int));
+    if (pstart == NULL) {
+        free_outline(ol);
+        return false;
+    }
+
+    /* flatten curves to within a fraction of the fitting tolerance */
+    for (lloop = 0; lloop < ol->lcount; lloop++) {
+        pstart[lloop] = pcount;
+        if (outline_flatten(ol, lloop,
+                            options->curve_tolerance * OSCAD_FLATNESS,
+                            &pnts, &pcount, &palloc) == false) {
+            ret = false;
+            break;
+        }
+    }
+    pstart[lloop] = pcount;
+
+    INFO("Outline has %u loops with %u segments flattened to %u points\n",
+         ol->lcount, ol->scount, pcount);
+
+    ob = outbuf_open(fd);
+    if ((ret == false) || (ob == NULL)) {
+        if (ob != NULL) {
+            outbuf_close(ob);
+        }
+        free(pnts);
+        free(pstart);
+        free_outline(ol);
+        return false;
+    }
+
+    xoff = (bm->width / 2);
+    yoff = (bm->height / 2);
+
+    outbuf_printf(ob, "// Generated by png23d\n\n");
+
+    outbuf_printf(ob, "target_width = %f;\n", options->width);
+    outbuf_printf(ob, "target_depth = %f;\n\n", options->depth);
+
+    outbuf_printf(ob, "module image(sx,sy,sz) {\n scale([sx, sy, sz]) linear_extrude(height = 1) polygon(points = [\n");
+
+    trace_begin("output points");
+    for (ploop = 0; ploop < pcount; ploop++) {
+        outbuf_printf(ob, "[%g,%g],\n",
+                      pnts[ploop].x - xoff,
+                      yoff - pnts[ploop].y);
+    }
+    trace_end();
+
+    outbuf_printf(ob, "], paths = [\n");
+
+    for (lloop = 0; lloop < ol->lcount; lloop++) {
+        outbuf_printf(ob, "[");
+        for (ploop = pstart[lloop]; ploop < pstart[lloop + 1]; ploop++) {
+            outbuf_printf(ob, (ploop == pstart[lloop]) ? "%u" : ",%u", ploop);
+        }
+        outbuf_printf(ob, "],\n");
+    }
+
+    outbuf_printf(ob, "]); }\n\n");
+
+    outbuf_printf(ob, "image_width = %d;\n", bm->width);
+    outbuf_printf(ob, "image_height = %d;\n\n", bm->height);
+
+    outbuf_printf(ob, "image(target_width / image_width, target_width / image_width, target_depth);\n");
+
+    free(pnts);
+    free(pstart);
+    free_outline(ol);
+
+    return outbuf_close(ob);
+}
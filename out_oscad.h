@@ -0,0 +1,17 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * extruded outline SCAD output header.
+ */
+
+#ifndef PNG23D_OUT_OSCAD_H
+#define PNG23D_OUT_OSCAD_H 1
+
+bool output_outline_scad(bitmap *bm, int fd, options *options);
+
+#endif
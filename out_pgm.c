@@ -4,47 +4,254 @@
  * Licenced under the MIT License,
  *                http://www.opensource.org/licenses/mit-license.php
  *
- * This file is part of png23d. 
- * 
- * Routines to output in PGM format
+ * This file is part of png23d.
+ *
+ * Routines to output quantised previews in PGM and PNG format
  */
 
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <png.h>
+#include <zlib.h>
+
 #include "option.h"
 #include "bitmap.h"
+#include "outbuf.h"
 #include "out_pgm.h"
 
+/** quantisation of source pixels to preview levels */
+struct pgm_quant {
+    uint32_t mul; /**< reciprocal of the level size scaled by 65536 */
+    uint32_t transparent; /**< pixels at or above this are transparent */
+};
+
+static void pgm_quant_init(struct pgm_quant *q, options *options)
+{
+    unsigned int div;
+
+    div = options->transparent / options->levels;
+    if (div == 0) {
+        div = 1;
+    }
+
+    /* (pixel * mul) >> 16 equals pixel / div for every 8 bit pixel when
+     * div is no larger than 256
+     */
+    q->mul = (65536 + div - 1) / div;
+    q->transparent = options->transparent;
+}
+
+/** quantise a row of pixels
+ *
+ * Bitmap rows are padded to BITMAP_ALIGN so whole aligned blocks are
+ * processed, allowing the fixed length inner loop to be vectorised. The
+ * destination must have room for the padding.
+ */
+static void
+pgm_quantise_row(const struct pgm_quant *q,
+                 const uint8_t * restrict src,
+                 uint8_t * restrict dst,
+                 uint32_t width)
+{
+    size_t x;
+    unsigned int bloop;
+    uint32_t pixel;
+    uint32_t mul = q->mul;
+    uint32_t transparent = q->transparent;
+
+    for (x = 0; x < width; x += BITMAP_ALIGN) {
+        for (bloop = 0; bloop < BITMAP_ALIGN; bloop++) {
+            pixel = src[bloop];
+            /* white is used as transparent in preview output */
+            dst[bloop] = (pixel < transparent) ? ((pixel * mul) >> 16) : 255;
+        }
+        src += BITMAP_ALIGN;
+        dst += BITMAP_ALIGN;
+    }
+}
+
+/** allocate a row buffer large enough for pgm_quantise_row */
+static uint8_t *pgm_row_alloc(bitmap *bm)
+{
+    return malloc((bm->width + BITMAP_ALIGN - 1) & ~(BITMAP_ALIGN - 1));
+}
+
+/* ascii P2 output */
 bool output_pgm(bitmap *bm, int fd, options *options)
 {
+    struct pgm_quant q;
     unsigned int row_loop;
     unsigned int col_loop;
-    unsigned int div;
-    uint8_t pixel;
-    FILE *outf;
+    uint8_t *row;
+    char *text;
+    char *pos;
+    char level_text[256][5]; /* each level as text followed by a space */
+    uint8_t level_len[256];
+    unsigned int lloop;
+    struct outbuf *ob;
 
-    outf = fdopen(dup(fd), "w");
+    pgm_quant_init(&q, options);
 
-    div = options->transparent / options->levels;
+    for (lloop = 0; lloop < 256; lloop++) {
+        level_len[lloop] = snprintf(level_text[lloop], 5, "%u ", lloop);
+    }
+
+    row = pgm_row_alloc(bm);
+    text = malloc((bm->width * 4) + 1);
+    ob = outbuf_open(fd);
+    if ((row == NULL) || (text == NULL) || (ob == NULL)) {
+        free(row);
+        free(text);
+        if (ob != NULL) {
+            outbuf_close(ob);
+        }
+        return false;
+    }
 
-    fprintf(outf, "P2\n# test output\n%u %u\n255\n", bm->width, bm->height);
+    outbuf_printf(ob, "P2\n# test output\n%u %u\n255\n", bm->width, bm->height);
     for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        pgm_quantise_row(&q, bitmap_pixel(bm, 0, row_loop), row, bm->width);
+
+        pos = text;
         for (col_loop = 0; col_loop < bm->width; col_loop++) {
-            pixel = bm->data[(row_loop * bm->width) + col_loop];
-            if (pixel < options->transparent) { 
-                fprintf(outf, "%d ", pixel / div);
-            } else {
-                /* white is used as transparent in pgm output */
-                fprintf(outf, "255 ");
-            }
+            memcpy(pos, level_text[row[col_loop]], 4);
+            pos += level_len[row[col_loop]];
+        }
+        *pos++ = '\n';
+
+        if (outbuf_write(ob, text, pos - text) == false) {
+            break;
+        }
+    }
+
+    free(row);
+    free(text);
+
+    return outbuf_close(ob);
+}
+
+/* binary P5 output */
+bool output_pgm_binary(bitmap *bm, int fd, options *options)
+{
+    struct pgm_quant q;
+    unsigned int row_loop;
+    unsigned int chunk_rows; /* rows quantised before each write */
+    unsigned int crow;
+    uint8_t *chunk;
+    struct outbuf *ob;
+
+    pgm_quant_init(&q, options);
+
+    /* quantise a buffer's worth of rows at a time so large images are
+     * written in a few big writes
+     */
+    chunk_rows = OUTBUF_SIZE / (bm->width + BITMAP_ALIGN);
+    if (chunk_rows == 0) {
+        chunk_rows = 1;
+    }
+    if (chunk_rows > bm->height) {
+        chunk_rows = bm->height;
+    }
+
+    chunk = malloc((size_t)chunk_rows * bm->width + BITMAP_ALIGN);
+    ob = outbuf_open(fd);
+    if ((chunk == NULL) || (ob == NULL)) {
+        free(chunk);
+        if (ob != NULL) {
+            outbuf_close(ob);
         }
-        fprintf(outf, "\n");
+        return false;
     }
 
-    fclose(outf);
+    outbuf_printf(ob, "P5\n%u %u\n255\n", bm->width, bm->height);
+    for (row_loop = 0; row_loop < bm->height; row_loop += crow) {
+        /* rows are packed, each row's padding is overwritten by the next */
+        for (crow = 0;
+             (crow < chunk_rows) && ((row_loop + crow) < bm->height);
+             crow++) {
+            pgm_quantise_row(&q,
+                             bitmap_pixel(bm, 0, row_loop + crow),
+                             chunk + ((size_t)crow * bm->width),
+                             bm->width);
+        }
+
+        if (outbuf_write(ob, chunk, (size_t)crow * bm->width) == false) {
+            break;
+        }
+    }
+
+    free(chunk);
+
+    return outbuf_close(ob);
+}
+
+/* libpng output callbacks */
+static void pgm_png_write(png_structp png_ptr, png_bytep data, png_size_t len)
+{
+    outbuf_write(png_get_io_ptr(png_ptr), data, len);
+}
+
+static void pgm_png_flush(png_structp png_ptr)
+{
+}
+
+/* 8 bit greyscale png output */
+bool output_png(bitmap *bm, int fd, options *options)
+{
+    struct pgm_quant q;
+    unsigned int row_loop;
+    uint8_t *row;
+    struct outbuf *ob;
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    pgm_quant_init(&q, options);
+
+    row = pgm_row_alloc(bm);
+    ob = outbuf_open(fd);
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = (png_ptr == NULL) ? NULL : png_create_info_struct(png_ptr);
+    if ((row == NULL) || (ob == NULL) || (info_ptr == NULL)) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        free(row);
+        if (ob != NULL) {
+            outbuf_close(ob);
+        }
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        free(row);
+        outbuf_close(ob);
+        return false;
+    }
+
+    png_set_write_fn(png_ptr, ob, pgm_png_write, pgm_png_flush);
+
+    /* a preview is written once and viewed immediately so favour speed */
+    png_set_compression_level(png_ptr, Z_BEST_SPEED);
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+
+    png_set_IHDR(png_ptr, info_ptr, bm->width, bm->height, 8,
+                 PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        pgm_quantise_row(&q, bitmap_pixel(bm, 0, row_loop), row, bm->width);
+        png_write_row(png_ptr, row);
+    }
+
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    free(row);
 
-    return true;
+    return outbuf_close(ob);
 }
@@ -6,12 +6,19 @@
  *
  * This file is part of png23d. 
  * 
- * PGM format output header.
+ * PGM and PNG preview output header.
  */
 
 #ifndef PNG23D_OUT_PGM_H
 #define PNG23D_OUT_PGM_H 1
 
+/** ascii (P2) pgm output of the quantised bitmap */
 bool output_pgm(bitmap *bm, int fd, options *options);
 
+/** binary (P5) pgm output of the quantised bitmap */
+bool output_pgm_binary(bitmap *bm, int fd, options *options);
+
+/** 8 bit greyscale png output of the quantised bitmap */
+bool output_png(bitmap *bm, int fd, options *options);
+
 #endif
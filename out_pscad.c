@@ -23,22 +23,136 @@
 #include "mesh_index.h"
 #include "mesh_gen.h"
 #include "mesh_simplify.h"
+#include "mesh_cluster.h"
+#include "outbuf.h"
 #include "out_pscad.h"
+#include "trace.h"
 
 
-/* ascii stl outout */
-bool output_flat_scad_polyhedron(bitmap *bm, int fd, options *options)
+/* write the triangles of a run of facets, in order if one is given */
+static void
+pscad_write_triangles(struct outbuf *ob,
+                      struct mesh *mesh,
+                      const uint32_t *order,
+                      uint32_t first,
+                      uint32_t last)
 {
-    struct mesh *mesh;
-    unsigned int ploop;
     unsigned int tloop; /* triangle loop */
+    struct facet *facet;
+
+    for (tloop = first; tloop < last; tloop++) {
+        if ((tloop % TRACE_OUT_CHUNK) == 0) {
+            if (tloop != 0) {
+                trace_end();
+            }
+            trace_begin("output facets %u", tloop);
+        }
+
+        if (order == NULL) {
+            facet = mesh->f + tloop;
+        } else {
+            facet = mesh->f + order[tloop];
+        }
+
+        outbuf_printf(ob, "[%u,%u,%u],\n",
+                facet->i[0],
+                facet->i[1],
+                facet->i[2] );
+    }
+}
+
+/* write an indexed mesh as a scad polyhedron
+ *
+ * A multiple body mesh is written as a polyhedron for each body sharing a
+ * single list of points.
+ */
+static bool
+pscad_write_mesh(struct mesh *mesh, int fd, options *options)
+{
+    unsigned int ploop;
     int xoff; /* x offset so 3d model is centered */
     int yoff; /* y offset so 3d model is centered */
-    FILE *outf;
-    uint32_t start_vcount;
+    struct outbuf *ob;
     struct vertex *vertex;
+    uint32_t *order = NULL;
+    uint32_t bstart[257];
+    unsigned int body;
+
+    if (mesh->multibody) {
+        order = mesh_body_order(mesh, bstart);
+        if (order == NULL) {
+            return false;
+        }
+    }
+
+    ob = outbuf_open(fd);
+    if (ob == NULL) {
+        free(order);
+        return false;
+    }
+
+    xoff = (mesh->width / 2);
+    yoff = (mesh->height / 2);
+
+    outbuf_printf(ob, "// Generated by png23d\n\n");
+
+    outbuf_printf(ob, "target_width = %f;\n", options->width);
+    outbuf_printf(ob, "target_depth = %f;\n\n", options->depth);
+
+    if (order == NULL) {
+        outbuf_printf(ob, "module image(sx,sy,sz) {\n scale([sx, sy, sz]) polyhedron(points = [\n");
+    } else {
+        outbuf_printf(ob, "image_points = [\n");
+    }
+
+    trace_begin("output vertices");
+    for (ploop = 0; ploop < mesh->vcount; ploop++) {
+        vertex = vertex_from_index(mesh, ploop);
+        outbuf_printf(ob, "[%f,%f,%f],\n",
+                vertex->pnt.x - xoff,
+                vertex->pnt.y + yoff,
+                vertex->pnt.z);
+    }
+    trace_end();
+
+    if (order == NULL) {
+        outbuf_printf(ob, "], triangles = [\n");
+        pscad_write_triangles(ob, mesh, NULL, 0, mesh->fcount);
+        outbuf_printf(ob, "]); }\n\n");
+    } else {
+        outbuf_printf(ob, "];\n\nmodule image(sx,sy,sz) {\n scale([sx, sy, sz]) {\n");
+        for (body = 0; body < 256; body++) {
+            if (bstart[body] == bstart[body + 1]) {
+                continue;
+            }
+            outbuf_printf(ob, "  // body %u\n  polyhedron(points = image_points, triangles = [\n", body);
+            pscad_write_triangles(ob, mesh, order,
+                                  bstart[body], bstart[body + 1]);
+            outbuf_printf(ob, "]);\n");
+        }
+        outbuf_printf(ob, " } }\n\n");
+    }
+
+    if (mesh->fcount != 0) {
+        trace_end();
+    }
+
+    free(order);
 
-    outf = fdopen(dup(fd), "w");
+    outbuf_printf(ob, "image_width = %d;\n", mesh->width);
+    outbuf_printf(ob, "image_height = %d;\n\n", mesh->height);
+
+    outbuf_printf(ob, "image(target_width / image_width, target_width / image_width, target_depth);\n");
+
+    return outbuf_close(ob);
+}
+
+/* ascii stl outout */
+bool output_flat_scad_polyhedron(bitmap *bm, int fd, options *options)
+{
+    struct mesh *mesh;
+    uint32_t start_vcount;
+    bool ret;
 
     mesh = new_mesh();
     if (mesh == NULL) {
@@ -48,15 +162,39 @@ bool output_flat_scad_polyhedron(bitmap *bm, int fd, options *options)
 
     debug_mesh_init(mesh, options->meshdebug);
 
+    trace_begin("generate");
     if (mesh_from_bitmap(mesh, bm, options) == false) {
+        trace_end();
         fprintf(stderr,"unable to convert bitmap to mesh\n");
+        free_mesh(mesh);
         return false;
     }
+    trace_end();
+
+    if (mesh->fcount == 0) {
+        /* nothing to index, such as an outline shrunk away */
+        INFO("Generated mesh is empty\n");
+        ret = pscad_write_mesh(mesh, fd, options);
+        free_mesh(mesh);
+        return ret;
+    }
+
+    if (options->optimise == OPTIMISE_CLUSTER) {
+        /* clustering is performed before the mesh is indexed */
+        if (cluster_mesh_options(mesh, options) == false) {
+            free_mesh(mesh);
+            return false;
+        }
+    }
 
     start_vcount = mesh->fcount * 3; /* each facet has 3 vertex */
 
     INFO("Indexing %d vertices\n", start_vcount);
-    index_mesh(mesh, options->bloom_complexity, options->vertex_complexity);
+    if (index_mesh(mesh, options->bloom_complexity,
+                   options->vertex_complexity) == false) {
+        free_mesh(mesh);
+        return false;
+    }
 
     INFO("Bloom filter prevented %d (%d%%) lookups\n",
          start_vcount - mesh->find_count,
@@ -68,55 +206,24 @@ bool output_flat_scad_polyhedron(bitmap *bm, int fd, options *options)
          mesh->find_count,
          mesh->find_cost / mesh->find_count);
 
-    if (options->optimise > 0) {
+    if ((options->optimise > 0) && (options->optimise != OPTIMISE_CLUSTER)) {
         INFO("Simplification of mesh with %d facets using %d unique verticies\n",
              mesh->fcount, mesh->vcount);
 
-        simplify_mesh(mesh);
+        if (simplify_mesh_lod(mesh, options, pscad_write_mesh) == false) {
+            free_mesh(mesh);
+            return false;
+        }
 
         INFO("Result mesh has %d facets using %d unique verticies\n",
              mesh->fcount, mesh->vcount);
-    }
-
-    xoff = (bm->width / 2);
-    yoff = (bm->height / 2);
 
-    fprintf(outf, "// Generated by png23d\n\n");
-
-    fprintf(outf, "target_width = %f;\n", options->width);
-    fprintf(outf, "target_depth = %f;\n\n", options->depth);
-
-    fprintf(outf, "module image(sx,sy,sz) {\n scale([sx, sy, sz]) polyhedron(points = [\n");
-
-    for (ploop = 0; ploop < mesh->vcount; ploop++) {
-        vertex = vertex_from_index(mesh, ploop);
-        fprintf(outf, "[%f,%f,%f],\n",
-                vertex->pnt.x - xoff,
-                vertex->pnt.y + yoff,
-                vertex->pnt.z);
+        simplify_mesh_info(mesh, options);
     }
 
-    fprintf(outf, "], triangles = [\n");
-
-    for (tloop = 0; tloop < mesh->fcount; tloop++) {
-        fprintf(outf, "[%u,%u,%u],\n",
-                mesh->f[tloop].i[0],
-                mesh->f[tloop].i[1],
-                mesh->f[tloop].i[2] );
-    }
-
-
-    fprintf(outf, "]); }\n\n");
-
-    fprintf(outf, "image_width = %d;\n", bm->width);
-    fprintf(outf, "image_height = %d;\n\n", bm->height);
-
-    fprintf(outf, "image(target_width / image_width, target_width / image_width, target_depth);\n");
-
+    ret = pscad_write_mesh(mesh, fd, options);
 
     free_mesh(mesh);
 
-    fclose(outf);
-
-    return true;
+    return ret;
 }
@@ -12,92 +12,247 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "option.h"
 #include "bitmap.h"
+#include "outbuf.h"
 #include "out_rscad.h"
 
 static void 
-output_scad_cube(FILE *outf, int x,int y, int z, int width, int height, int depth)
+output_scad_cube(struct outbuf *ob, int x,int y, int z, int width, int height, int depth)
 {
-    fprintf(outf,
+    outbuf_printf(ob,
             "        translate([%d, %d, %d]) cube([%d.01, %d.01, %d.01]);\n",
             x, y, z,
             width, height, depth);
 }
 
-/* generate scad output as rows of cubes */
-bool output_flat_scad_cubes(bitmap *bm, int fd, options *options)
+/** cuboid decomposition state */
+struct rscad {
+    uint32_t width; /**< width of the image */
+    uint32_t height; /**< height of the image */
+    uint16_t *column; /**< number of levels each pixel column occupies */
+    uint16_t *cover; /**< levels of each column covered by cuboids */
+    uint32_t *pending; /**< columns in each row not yet fully covered */
+    bool start[257]; /**< levels at which a cuboid may start */
+};
+
+/* can a cuboid starting at level z include the column at idx */
+static inline bool rscad_open(struct rscad *rs, size_t idx, unsigned int z)
+{
+    return (rs->cover[idx] == z) && (rs->column[idx] > z);
+}
+
+/* find the height of every pixel column
+ *
+ * This uses the same levels as the cube finish where level z is present
+ * when the pixel value is at least z * (256 / levels).
+ */
+static void
+rscad_columns(struct rscad *rs, bitmap *bm, options *options,
+              unsigned int bbox[4])
 {
-    int xoff; /* x offset so 3d model is centered */
-    int yoff; /* y offset so 3d model is centered */
     unsigned int row_loop;
     unsigned int col_loop;
-    unsigned int col_start; /* start col of run */
-    unsigned int xmin = bm->width;
-    unsigned int xmax = 0;
-    unsigned int ymin = bm->height;
-    unsigned int ymax = 0;
-    FILE *outf;
+    unsigned int step = 256 / options->levels;
+    uint16_t level_column[256]; /* column height of each pixel value */
+    unsigned int column;
+    unsigned int vloop;
+    size_t idx;
+
+    for (vloop = 0; vloop < 256; vloop++) {
+        column = (vloop / step) + 1;
+        if (column > options->levels) {
+            column = options->levels;
+        }
+        if (vloop == options->transparent) {
+            column = 0;
+        }
+        level_column[vloop] = column;
+    }
 
-    outf = fdopen(dup(fd), "w");
+    bbox[0] = bm->width; /* xmin */
+    bbox[1] = 0; /* xmax */
+    bbox[2] = bm->height; /* ymin */
+    bbox[3] = 0; /* ymax */
 
-    xoff = (bm->width / 2);
-    yoff = (bm->height / 2);
+    for (row_loop = 0; row_loop < bm->height; row_loop++) {
+        for (col_loop = 0; col_loop < bm->width; col_loop++) {
+            idx = ((size_t)row_loop * bm->width) + col_loop;
+            column = level_column[*bitmap_pixel(bm, col_loop, row_loop)];
+            rs->column[idx] = column;
 
-    fprintf(outf, "// Generated by png23d\n\n");
+            if (column == 0) {
+                continue;
+            }
 
-    fprintf(outf, "target_width = %f;\n", options->width);
-    fprintf(outf, "target_depth = %f;\n\n", options->depth);
+            rs->start[column] = true;
+            rs->pending[row_loop]++;
 
-    fprintf(outf, "module image(sx,sy,sz) {\n scale([sx, sy, sz]) union() {\n");
+            if (col_loop < bbox[0])
+                bbox[0] = col_loop;
+            if (col_loop > bbox[1])
+                bbox[1] = col_loop;
+            if (row_loop < bbox[2])
+                bbox[2] = row_loop;
+            if (row_loop > bbox[3])
+                bbox[3] = row_loop;
+        }
+    }
+}
 
-    for (row_loop = 0; row_loop < bm->height; row_loop++) {
-        col_start = bm->width;
-        for (col_loop = 0; col_loop < bm->width; col_loop++) {
-            
-            if (bm->data[(row_loop * bm->width) + col_loop] != options->transparent) {
-                /* this cell is "opaque" */
-                if (col_start > col_loop) {
-                    /* mark start of run */
-                    col_start = col_loop;
+/* cover every column which has been covered up to level z
+ *
+ * The open columns are decomposed into rectangles, each grown as far right
+ * as it can go and then as far down as the whole span allows. Each
+ * rectangle becomes a cuboid from level z up to its lowest column.
+ */
+static unsigned int
+rscad_level(struct rscad *rs, struct outbuf *ob, unsigned int z, int xoff, int yoff)
+{
+    unsigned int row_loop;
+    unsigned int col_loop;
+    unsigned int xloop;
+    unsigned int yloop;
+    unsigned int rwidth; /* rectangle width */
+    unsigned int rheight; /* rectangle height */
+    unsigned int top; /* level at top of cuboid */
+    unsigned int count = 0;
+    size_t idx;
+
+    for (row_loop = 0; row_loop < rs->height; row_loop++) {
+        if (rs->pending[row_loop] == 0) {
+            continue;
+        }
+
+        for (col_loop = 0; col_loop < rs->width; col_loop++) {
+            idx = ((size_t)row_loop * rs->width) + col_loop;
+            if (!rscad_open(rs, idx, z)) {
+                continue;
+            }
+
+            /* grow right */
+            top = rs->column[idx];
+            for (rwidth = 1;
+                 ((col_loop + rwidth) < rs->width) &&
+                     rscad_open(rs, idx + rwidth, z);
+                 rwidth++) {
+                if (rs->column[idx + rwidth] < top) {
+                    top = rs->column[idx + rwidth];
+                }
+            }
+
+            /* grow down while the whole span is open */
+            for (rheight = 1; (row_loop + rheight) < rs->height; rheight++) {
+                idx = ((size_t)(row_loop + rheight) * rs->width) + col_loop;
+                for (xloop = 0; xloop < rwidth; xloop++) {
+                    if (!rscad_open(rs, idx + xloop, z)) {
+                        break;
+                    }
                 }
-                if (col_loop < xmin)
-                    xmin = col_loop;
-                if (col_loop > xmax)
-                    xmax = col_loop;
-                if (row_loop < ymin)
-                    ymin = row_loop;
-                if (row_loop > ymax)
-                    ymax = row_loop;
-
-            } else {
-                /* cell is transparent */
-                if (col_start < col_loop) {
-                    /* output previous run */
-                    output_scad_cube(outf,
-                                     col_start - xoff, yoff - row_loop , 0,
-                                     col_loop - col_start, 1, 1);
-                    col_start = bm->width; /* ready for next run */
+                if (xloop != rwidth) {
+                    break;
+                }
+                for (xloop = 0; xloop < rwidth; xloop++) {
+                    if (rs->column[idx + xloop] < top) {
+                        top = rs->column[idx + xloop];
+                    }
+                }
+            }
+
+            output_scad_cube(ob,
+                             col_loop - xoff,
+                             yoff - (row_loop + rheight - 1),
+                             z,
+                             rwidth, rheight, top - z);
+            count++;
+
+            /* mark the covered levels */
+            for (yloop = row_loop; yloop < (row_loop + rheight); yloop++) {
+                idx = ((size_t)yloop * rs->width) + col_loop;
+                for (xloop = 0; xloop < rwidth; xloop++) {
+                    rs->cover[idx + xloop] = top;
+                    if (rs->column[idx + xloop] == top) {
+                        rs->pending[yloop]--;
+                    }
                 }
             }
+
+            col_loop += rwidth - 1;
         }
-        /* need to close any active run at edge of image */
-        if (col_start < col_loop) {
-            /* output active run */
-            output_scad_cube(outf,
-                             col_start - xoff, row_loop - yoff, 0,
-                             col_loop - col_start, 1, 1);
+    }
+
+    return count;
+}
+
+/* generate scad output as a union of cuboids
+ *
+ * Columns are covered from the bottom up. Cuboids only start at the
+ * bottom or on top of another cuboid, whose top is the height of some
+ * column, so only levels which are a column height need to be examined.
+ */
+bool output_flat_scad_cubes(bitmap *bm, int fd, options *options)
+{
+    int xoff; /* x offset so 3d model is centered */
+    int yoff; /* y offset so 3d model is centered */
+    unsigned int bbox[4];
+    unsigned int zloop;
+    unsigned int count = 0;
+    size_t pixels = (size_t)bm->width * bm->height;
+    struct rscad rs = {
+        .width = bm->width,
+        .height = bm->height,
+    };
+    struct outbuf *ob;
+
+    rs.column = malloc(pixels * sizeof(uint16_t));
+    rs.cover = calloc(pixels, sizeof(uint16_t));
+    rs.pending = calloc(bm->height, sizeof(uint32_t));
+    ob = outbuf_open(fd);
+    if ((rs.column == NULL) || (rs.cover == NULL) ||
+        (rs.pending == NULL) || (ob == NULL)) {
+        free(rs.column);
+        free(rs.cover);
+        free(rs.pending);
+        if (ob != NULL) {
+            outbuf_close(ob);
         }
+        return false;
+    }
+
+    rscad_columns(&rs, bm, options, bbox);
+    rs.start[0] = true;
+
+    xoff = (bm->width / 2);
+    yoff = (bm->height / 2);
+
+    outbuf_printf(ob, "// Generated by png23d\n\n");
+
+    outbuf_printf(ob, "target_width = %f;\n", options->width);
+    outbuf_printf(ob, "target_depth = %f;\n\n", options->depth);
 
+    outbuf_printf(ob, "module image(sx,sy,sz) {\n scale([sx, sy, sz]) union() {\n");
+
+    for (zloop = 0; zloop < options->levels; zloop++) {
+        if (rs.start[zloop]) {
+            count += rscad_level(&rs, ob, zloop, xoff, yoff);
+        }
     }
 
-    fprintf(outf, "    }\n}\n\n");
-    fprintf(outf, "image_width = %d;\n", xmax - xmin);
-    fprintf(outf, "image_height = %d;\n\n", ymax - ymin);
+    INFO("Generated %u cuboids\n", count);
+
+    outbuf_printf(ob, "    }\n}\n\n");
+    outbuf_printf(ob, "image_width = %d;\n", bbox[1] - bbox[0]);
+    outbuf_printf(ob, "image_height = %d;\n", bbox[3] - bbox[2]);
+    outbuf_printf(ob, "image_levels = %d;\n\n", options->levels);
+
+    outbuf_printf(ob, "image(target_width / image_width, target_width / image_width, target_depth / image_levels);\n");
 
-    fprintf(outf, "image(target_width / image_width, target_width / image_width, target_depth);\n");
+    free(rs.column);
+    free(rs.cover);
+    free(rs.pending);
 
-    return true;
+    return outbuf_close(ob);
 }
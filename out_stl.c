@@ -23,10 +23,16 @@
 #include "mesh_gen.h"
 #include "mesh_index.h"
 #include "mesh_simplify.h"
+#include "mesh_cluster.h"
+#include "mesh_soa.h"
+#include "outbuf.h"
 #include "out_stl.h"
+#include "trace.h"
 
+static bool stl_write_binary(struct mesh *mesh, int fd, options *options);
+static bool stl_write_ascii(struct mesh *mesh, int fd, options *options);
 
-static struct mesh *stl_mesh(bitmap *bm, int fd, options *options)
+static struct mesh *stl_mesh(bitmap *bm, options *options, mesh_writer *writer)
 {
     struct mesh *mesh;
 
@@ -38,22 +44,40 @@ static struct mesh *stl_mesh(bitmap *bm, int fd, options *options)
 
     debug_mesh_init(mesh, options->meshdebug);
 
+    trace_begin("generate");
     if (mesh_from_bitmap(mesh, bm, options) == false) {
+        trace_end();
         fprintf(stderr,"unable to convert bitmap to mesh with requested finish\n");
         free_mesh(mesh);
         return NULL;
     }
-
-    if (options->optimise > 0) {
+    trace_end();
+
+    if (mesh->fcount == 0) {
+        /* nothing to index, such as an outline shrunk away */
+        INFO("Generated mesh is empty\n");
+    } else if (options->optimise == OPTIMISE_CLUSTER) {
+        if (cluster_mesh_options(mesh, options) == false) {
+            free_mesh(mesh);
+            return NULL;
+        }
+    } else if (options->optimise > 0) {
         uint32_t start_vcount = mesh->fcount * 3; /* each facet has 3 vertex */
 
         INFO("Indexing %d vertices\n", start_vcount);
-        index_mesh(mesh, options->bloom_complexity, options->vertex_complexity);
+        if (index_mesh(mesh, options->bloom_complexity,
+                       options->vertex_complexity) == false) {
+            free_mesh(mesh);
+            return NULL;
+        }
 
         INFO("Simplification of mesh with %d facets using %d unique verticies\n",
              mesh->fcount, start_vcount);
 
-        simplify_mesh(mesh);
+        if (simplify_mesh_lod(mesh, options, writer) == false) {
+            free_mesh(mesh);
+            return NULL;
+        }
 
         INFO("Bloom filter prevented %d (%d%%) lookups\n",
              start_vcount - mesh->find_count,
@@ -69,6 +93,8 @@ static struct mesh *stl_mesh(bitmap *bm, int fd, options *options)
 
         INFO("Result mesh has %d facets using %d unique verticies\n",
              mesh->fcount, mesh->vcount);
+
+        simplify_mesh_info(mesh, options);
     }
 
     INFO("width bitmap:%d output:%f\n",bm->width, options->width);
@@ -81,6 +107,25 @@ static struct mesh *stl_mesh(bitmap *bm, int fd, options *options)
 }
 
 
+/** scale a block of facets and give them unit normals
+ *
+ * The mesh normals are unnormalised cross products which remain parallel
+ * to the true normal under uniform scaling. When the depth scale differs
+ * from the width scale the normals change direction so they are recomputed
+ * from the scaled vertices.
+ */
+static void
+stl_block_prepare(struct facet_block *blk, float xscale, float zscale)
+{
+    facet_block_scale(blk, xscale, zscale);
+
+    if (xscale != zscale) {
+        facet_block_normals(blk);
+    }
+
+    facet_block_unit_normals(blk);
+}
+
 /* binary stl output
  *
  * UINT8[80] – Header
@@ -95,75 +140,112 @@ static struct mesh *stl_mesh(bitmap *bm, int fd, options *options)
  * end
  *
  */
-bool output_flat_stl(bitmap *bm, int fd, options *options)
+static bool
+stl_write_binary(struct mesh *mesh, int fd, options *options)
 {
-    struct mesh *mesh;
     unsigned int floop;
+    unsigned int bloop; /* facet within block */
     uint8_t header[80];
-    bool ret = true;
     struct binstltri {
             pnt n; /**< surface normal */
             pnt v[3]; /**< triangle vertices */
             uint16_t attribute;
-    } __attribute__((packed)) binstltri;
-    float xscale = options->width / bm->width;
+    } __attribute__((packed)) *binstltri;
+    struct facet_block *blk;
+    struct outbuf *ob;
+    pnt pnt;
+    float xscale = options->width / mesh->width;
     float zscale = options->depth / options->levels;
 
     assert(sizeof(struct binstltri) == 50); /* this is foul and nasty */
 
-    mesh = stl_mesh(bm, fd, options);
-    if (mesh == NULL) {
+    blk = malloc(sizeof(struct facet_block));
+    binstltri = malloc(FACET_BLOCK * sizeof(struct binstltri));
+    ob = outbuf_open(fd);
+    if ((blk == NULL) || (binstltri == NULL) || (ob == NULL)) {
+        free(blk);
+        free(binstltri);
+        if (ob != NULL) {
+            outbuf_close(ob);
+        }
         return false;
     }
 
-    INFO("Writing Binary STL output\n");
-
     /* write file header */
     memset(header, 0, 80);
     snprintf((char *)header, 80,
              "Binary STL generated by png23d from %s", options->infile);
-    if (write(fd, header, 80) != 80) {
-        ret = false;
-        goto output_flat_stl_error;
-    }
+    outbuf_write(ob, header, 80);
+    outbuf_write(ob, &mesh->fcount, sizeof(uint32_t));
+
+    /* write triangles a block at a time after scaling */
+    for (floop = 0; floop < mesh->fcount; floop += FACET_BLOCK) {
+        if ((floop % TRACE_OUT_CHUNK) == 0) {
+            if (floop != 0) {
+                trace_end();
+            }
+            trace_begin("output facets %u", floop);
+        }
 
-    /* write number of triangles in file */
-    if (write(fd, &mesh->fcount, sizeof(uint32_t)) != sizeof(uint32_t)) {
-        ret = false;
-        goto output_flat_stl_error;
-    }
+        blk->count = mesh->fcount - floop;
+        if (blk->count > FACET_BLOCK) {
+            blk->count = FACET_BLOCK;
+        }
+
+        facet_block_load(blk, mesh->f + floop, blk->count);
+        stl_block_prepare(blk, xscale, zscale);
+
+        /* packed members cannot be pointed to so go via a local */
+        for (bloop = 0; bloop < blk->count; bloop++) {
+            facet_block_normal(blk, bloop, &pnt);
+            binstltri[bloop].n = pnt;
+            facet_block_vertex(blk, bloop, 0, &pnt);
+            binstltri[bloop].v[0] = pnt;
+            facet_block_vertex(blk, bloop, 1, &pnt);
+            binstltri[bloop].v[1] = pnt;
+            facet_block_vertex(blk, bloop, 2, &pnt);
+            binstltri[bloop].v[2] = pnt;
+            binstltri[bloop].attribute = 0;
+        }
 
-    binstltri.attribute = 0;
-
-    /* write each triangle after scaling */
-    for (floop=0; floop < mesh->fcount; floop++) {
-        /* copy vertex points with scaling */
-        binstltri.n = mesh->f[floop].n;
-        binstltri.v[0].x = mesh->f[floop].v[0].x * xscale;
-        binstltri.v[0].y = mesh->f[floop].v[0].y * xscale;
-        binstltri.v[0].z = mesh->f[floop].v[0].z * zscale;
-        binstltri.v[1].x = mesh->f[floop].v[1].x * xscale;
-        binstltri.v[1].y = mesh->f[floop].v[1].y * xscale;
-        binstltri.v[1].z = mesh->f[floop].v[1].z * zscale;
-        binstltri.v[2].x = mesh->f[floop].v[2].x * xscale;
-        binstltri.v[2].y = mesh->f[floop].v[2].y * xscale;
-        binstltri.v[2].z = mesh->f[floop].v[2].z * zscale;
-
-        if (write(fd, &binstltri, sizeof(struct binstltri)) != sizeof(struct binstltri)) {
-            ret = false;
+        if (outbuf_write(ob, binstltri,
+                         blk->count * sizeof(struct binstltri)) == false) {
             break;
         }
     }
 
-output_flat_stl_error:
+    if (mesh->fcount != 0) {
+        trace_end();
+    }
+
+    free(blk);
+    free(binstltri);
+
+    return outbuf_close(ob);
+}
+
+bool output_flat_stl(bitmap *bm, int fd, options *options)
+{
+    struct mesh *mesh;
+    bool ret;
+
+    mesh = stl_mesh(bm, options, stl_write_binary);
+    if (mesh == NULL) {
+        return false;
+    }
+
+    INFO("Writing Binary STL output\n");
+
+    ret = stl_write_binary(mesh, fd, options);
+
     free_mesh(mesh);
 
     return ret;
 }
 
-static inline void output_stl_tri(FILE *outf, const struct facet *facet, float xscale, float zscale)
+static inline void output_stl_tri(struct outbuf *ob, const struct facet_block *blk, unsigned int idx)
 {
-    fprintf(outf,
+    outbuf_printf(ob,
             "  facet normal %.6f %.6f %.6f\n"
             "    outer loop\n"
             "      vertex %.6f %.6f %.6f\n"
@@ -171,41 +253,126 @@ static inline void output_stl_tri(FILE *outf, const struct facet *facet, float x
             "      vertex %.6f %.6f %.6f\n"
             "    endloop\n"
             "  endfacet\n",
-            facet->n.x, facet->n.y, facet->n.z,
-            facet->v[0].x * xscale, facet->v[0].y * xscale, facet->v[0].z * zscale,
-            facet->v[1].x * xscale, facet->v[1].y * xscale, facet->v[1].z * zscale,
-            facet->v[2].x * xscale, facet->v[2].y * xscale, facet->v[2].z * zscale);
+            blk->nx[idx], blk->ny[idx], blk->nz[idx],
+            blk->vx[0][idx], blk->vy[0][idx], blk->vz[0][idx],
+            blk->vx[1][idx], blk->vy[1][idx], blk->vz[1][idx],
+            blk->vx[2][idx], blk->vy[2][idx], blk->vz[2][idx]);
+}
+
+/* write a run of facets as ascii, in order if one is given */
+static void
+stl_write_ascii_facets(struct outbuf *ob,
+                       struct facet_block *blk,
+                       struct mesh *mesh,
+                       const uint32_t *order,
+                       uint32_t first,
+                       uint32_t last,
+                       options *options)
+{
+    unsigned int floop;
+    unsigned int bloop; /* facet within block */
+    unsigned int count;
+
+    for (floop = first; floop < last; floop += FACET_BLOCK) {
+        if ((floop % TRACE_OUT_CHUNK) == 0) {
+            if (floop != 0) {
+                trace_end();
+            }
+            trace_begin("output facets %u", floop);
+        }
+
+        count = last - floop;
+        if (count > FACET_BLOCK) {
+            count = FACET_BLOCK;
+        }
+
+        if (order == NULL) {
+            facet_block_load(blk, mesh->f + floop, count);
+        } else {
+            facet_block_gather(blk, mesh->f, order + floop, count);
+        }
+        stl_block_prepare(blk,
+                          options->width / mesh->width,
+                          options->depth / options->levels);
+
+        for (bloop = 0; bloop < blk->count; bloop++) {
+            output_stl_tri(ob, blk, bloop);
+        }
+    }
+}
+
+/* ascii output, a separate solid for each body of a multiple body mesh */
+static bool
+stl_write_ascii(struct mesh *mesh, int fd, options *options)
+{
+    struct facet_block *blk;
+    struct outbuf *ob;
+    uint32_t *order = NULL;
+    uint32_t bstart[257];
+    unsigned int body;
+
+    blk = malloc(sizeof(struct facet_block));
+    if (blk == NULL) {
+        return false;
+    }
+
+    if (mesh->multibody) {
+        order = mesh_body_order(mesh, bstart);
+        if (order == NULL) {
+            free(blk);
+            return false;
+        }
+    }
+
+    ob = outbuf_open(fd);
+    if (ob == NULL) {
+        free(order);
+        free(blk);
+        return false;
+    }
+
+    if (order == NULL) {
+        outbuf_printf(ob, "solid png2stl_Model\n");
+        stl_write_ascii_facets(ob, blk, mesh, NULL, 0, mesh->fcount, options);
+        outbuf_printf(ob, "endsolid png2stl_Model\n");
+    } else {
+        for (body = 0; body < 256; body++) {
+            if (bstart[body] == bstart[body + 1]) {
+                continue;
+            }
+            outbuf_printf(ob, "solid png2stl_Body%u\n", body);
+            stl_write_ascii_facets(ob, blk, mesh, order,
+                                   bstart[body], bstart[body + 1], options);
+            outbuf_printf(ob, "endsolid png2stl_Body%u\n", body);
+        }
+    }
+
+    if (mesh->fcount != 0) {
+        trace_end();
+    }
+
+    free(order);
+    free(blk);
+
+    return outbuf_close(ob);
 }
 
 /* ascii stl outout */
 bool output_flat_astl(bitmap *bm, int fd, options *options)
 {
     struct mesh *mesh;
-    unsigned int floop;
-    FILE *outf;
+    bool ret;
 
-    mesh = stl_mesh(bm, fd, options);
+    mesh = stl_mesh(bm, options, stl_write_ascii);
     if (mesh == NULL) {
         return false;
     }
 
     INFO("Writing ASCII STL output\n");
-    outf = fdopen(dup(fd), "w");
 
-    fprintf(outf, "solid png2stl_Model\n");
-
-    for (floop = 0; floop < mesh->fcount; floop++) {
-        output_stl_tri(outf,
-                       mesh->f + floop,
-                       options->width / bm->width,
-                       options->depth / options->levels );
-    }
-
-    fprintf(outf, "endsolid png2stl_Model\n");
+    ret = stl_write_ascii(mesh, fd, options);
 
     free_mesh(mesh);
 
-    fclose(outf);
-
-    return true;
+    return ret;
 }
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to output the outline of the opaque area in SVG format
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "option.h"
+#include "bitmap.h"
+#include "outline.h"
+#include "outbuf.h"
+#include "out_svg.h"
+#include "trace.h"
+
+/* write outlines as a single even-odd filled path so holes are cut out */
+bool output_svg(bitmap *bm, int fd, options *options)
+{
+    struct outline *ol;
+    struct outline_loop *loop;
+    struct outline_seg *seg;
+    unsigned int lloop;
+    unsigned int sloop;
+    struct outbuf *ob;
+
+    trace_begin("outline");
+    if (options->offset != 0) {
+        ol = outline_offset(bm, options->transparent,
+                            options->offset * bm->width / options->width,
+                            options->curve_tolerance);
+    } else {
+        ol = outline_from_bitmap(bm, options->transparent, options->curve_tolerance);
+    }
+    trace_end();
+    if (ol == NULL) {
+        fprintf(stderr, "unable to trace outline\n");
+        return false;
+    }
+
+    INFO("Outline has %u loops with %u segments\n", ol->lcount, ol->scount);
+
+    ob = outbuf_open(fd);
+    if (ob == NULL) {
+        free_outline(ol);
+        return false;
+    }
+
+    outbuf_printf(ob,
+                  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                  "<!-- Generated by png23d -->\n"
+                  "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+                  "width=\"%g\" height=\"%g\" viewBox=\"0 0 %u %u\">\n"
+                  "<path fill=\"black\" fill-rule=\"evenodd\" d=\"",
+                  options->width,
+                  (options->width * bm->height) / bm->width,
+                  bm->width, bm->height);
+
+    trace_begin("output loops");
+    for (lloop = 0; lloop < ol->lcount; lloop++) {
+        loop = &ol->loop[lloop];
+
+        outbuf_printf(ob, "\nM%g %g", loop->start.x, loop->start.y);
+
+        /* the closing segment is implied by Z */
+        for (sloop = 0; (sloop + 1) < loop->count; sloop++) {
+            seg = &ol->seg[loop->first + sloop];
+            if (seg->cubic) {
+                outbuf_printf(ob, "C%g %g %g %g %g %g",
+                              seg->c1.x, seg->c1.y,
+                              seg->c2.x, seg->c2.y,
+                              seg->p.x, seg->p.y);
+            } else {
+                outbuf_printf(ob, "L%g %g", seg->p.x, seg->p.y);
+            }
+        }
+
+        seg = &ol->seg[loop->first + sloop];
+        if (seg->cubic) {
+            outbuf_printf(ob, "C%g %g %g %g %g %g",
+                          seg->c1.x, seg->c1.y,
+                          seg->c2.x, seg->c2.y,
+                          seg->p.x, seg->p.y);
+        }
+        outbuf_printf(ob, "Z");
+    }
+    trace_end();
+
+    outbuf_printf(ob, "\"/>\n</svg>\n");
+
+    free_outline(ol);
+
+    return outbuf_close(ob);
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * SVG outline output header.
+ */
+
+#ifndef PNG23D_OUT_SVG_H
+#define PNG23D_OUT_SVG_H 1
+
+bool output_svg(bitmap *bm, int fd, options *options);
+
+#endif
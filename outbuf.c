@@ -0,0 +1,303 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Buffered output.
+ *
+ * Output is gathered into page aligned buffers. When writing to a pipe the
+ * buffers are sized to exactly the pipe capacity and each full buffer is
+ * spliced into the pipe with vmsplice so the kernel references the pages
+ * rather than copying them. Two buffers are used alternately; once a whole
+ * buffer has been spliced the pipe can hold nothing else so the pages of
+ * the previous buffer have been consumed and it is safe to refill.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE /* vmsplice and pipe sizing */
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+#include "outbuf.h"
+
+/** longest formatted output expected from a single outbuf_printf */
+#define OUTBUF_LINE 512
+
+struct outbuf {
+    int fd; /**< output file descriptor */
+    bool splice; /**< full buffers are spliced into a pipe */
+    bool error; /**< an output error has occurred */
+
+    uint8_t *buf[2]; /**< output buffers */
+    unsigned int cur; /**< buffer being filled */
+    size_t len; /**< bytes used in the current buffer */
+    size_t size; /**< size of each buffer */
+};
+
+static bool write_all(int fd, const uint8_t *data, size_t len)
+{
+    ssize_t wr;
+
+    while (len > 0) {
+        wr = write(fd, data, len);
+        if (wr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += wr;
+        len -= wr;
+    }
+
+    return true;
+}
+
+#ifdef __linux__
+/* capacity of a pipe, or 0 if fd is not a pipe which can be spliced into */
+static size_t outbuf_pipe_size(int fd)
+{
+    struct stat st;
+    int size;
+
+    if ((fstat(fd, &st) != 0) || !S_ISFIFO(st.st_mode)) {
+        return 0;
+    }
+
+    /* a larger pipe means fewer wakeups, the current size is kept on error */
+    fcntl(fd, F_SETPIPE_SZ, OUTBUF_SIZE);
+
+    size = fcntl(fd, F_GETPIPE_SZ);
+    if ((size <= 0) || ((size % sysconf(_SC_PAGESIZE)) != 0)) {
+        return 0;
+    }
+
+    return size;
+}
+
+/* splice the current buffer into the pipe and switch buffers */
+static bool outbuf_splice(struct outbuf *ob)
+{
+    struct iovec iov;
+    ssize_t spliced;
+
+    iov.iov_base = ob->buf[ob->cur];
+    iov.iov_len = ob->len;
+
+    while (iov.iov_len > 0) {
+        spliced = vmsplice(ob->fd, &iov, 1, 0);
+        if (spliced < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* the other buffer may still be in the pipe so stop splicing
+             * and write everything from this buffer from now on
+             */
+            ob->splice = false;
+            return write_all(ob->fd, iov.iov_base, iov.iov_len);
+        }
+        iov.iov_base = (uint8_t *)iov.iov_base + spliced;
+        iov.iov_len -= spliced;
+    }
+
+    ob->cur ^= 1;
+
+    return true;
+}
+#else
+static size_t outbuf_pipe_size(int fd)
+{
+    return 0;
+}
+
+static bool outbuf_splice(struct outbuf *ob)
+{
+    return write_all(ob->fd, ob->buf[ob->cur], ob->len);
+}
+#endif
+
+static uint8_t *outbuf_alloc(size_t size)
+{
+    void *buf;
+
+    /* mapped rather than allocated so pages still referenced by the pipe
+     * are never handed out again by the allocator
+     */
+    buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        return NULL;
+    }
+
+    return buf;
+}
+
+/* output the current buffer */
+static bool outbuf_flush(struct outbuf *ob)
+{
+    bool ret;
+
+    if (ob->splice && (ob->len == ob->size)) {
+        ret = outbuf_splice(ob);
+    } else {
+        ret = write_all(ob->fd, ob->buf[ob->cur], ob->len);
+    }
+
+    ob->len = 0;
+    if (ret == false) {
+        ob->error = true;
+    }
+
+    return ret;
+}
+
+/* exported method documented in outbuf.h */
+struct outbuf *outbuf_open(int fd)
+{
+    struct outbuf *ob;
+
+    ob = calloc(1, sizeof(struct outbuf));
+    if (ob == NULL) {
+        return NULL;
+    }
+
+    ob->fd = fd;
+    ob->size = outbuf_pipe_size(fd);
+    if (ob->size != 0) {
+        ob->buf[1] = outbuf_alloc(ob->size);
+        ob->splice = (ob->buf[1] != NULL);
+    } else {
+        ob->size = OUTBUF_SIZE;
+    }
+
+    ob->buf[0] = outbuf_alloc(ob->size);
+    if (ob->buf[0] == NULL) {
+        if (ob->buf[1] != NULL) {
+            munmap(ob->buf[1], ob->size);
+        }
+        free(ob);
+        return NULL;
+    }
+
+    return ob;
+}
+
+/* exported method documented in outbuf.h */
+bool outbuf_write(struct outbuf *ob, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    size_t space;
+
+    /* large writes to files need not be copied */
+    if (!ob->splice && (ob->len == 0) && (len >= ob->size)) {
+        if (write_all(ob->fd, src, len) == false) {
+            ob->error = true;
+        }
+        return !ob->error;
+    }
+
+    while ((len > 0) && !ob->error) {
+        space = ob->size - ob->len;
+        if (space > len) {
+            space = len;
+        }
+
+        memcpy(ob->buf[ob->cur] + ob->len, src, space);
+        ob->len += space;
+        src += space;
+        len -= space;
+
+        if (ob->len == ob->size) {
+            outbuf_flush(ob);
+        }
+    }
+
+    return !ob->error;
+}
+
+/* exported method documented in outbuf.h */
+bool outbuf_printf(struct outbuf *ob, const char *fmt, ...)
+{
+    va_list ap;
+    size_t space;
+    int len;
+    char line[OUTBUF_LINE];
+    char *text;
+
+    /* format straight into the buffer when it fits */
+    space = ob->size - ob->len;
+    va_start(ap, fmt);
+    len = vsnprintf((char *)ob->buf[ob->cur] + ob->len, space, fmt, ap);
+    va_end(ap);
+
+    if (len < 0) {
+        ob->error = true;
+        return false;
+    }
+
+    if ((size_t)len < space) {
+        ob->len += len;
+        return !ob->error;
+    }
+
+    /* the text spans the end of the buffer */
+    if (len < OUTBUF_LINE) {
+        text = line;
+    } else {
+        text = malloc(len + 1);
+        if (text == NULL) {
+            ob->error = true;
+            return false;
+        }
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(text, len + 1, fmt, ap);
+    va_end(ap);
+
+    outbuf_write(ob, text, len);
+
+    if (text != line) {
+        free(text);
+    }
+
+    return !ob->error;
+}
+
+/* exported method documented in outbuf.h */
+bool outbuf_close(struct outbuf *ob)
+{
+    bool ret;
+
+    if ((ob->len > 0) && !ob->error) {
+        outbuf_flush(ob);
+    }
+
+    ret = !ob->error;
+
+    munmap(ob->buf[0], ob->size);
+    if (ob->buf[1] != NULL) {
+        munmap(ob->buf[1], ob->size);
+    }
+    free(ob);
+
+    return ret;
+}
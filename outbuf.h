@@ -0,0 +1,48 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * buffered output header.
+ */
+
+#ifndef PNG23D_OUTBUF_H
+#define PNG23D_OUTBUF_H 1
+
+/** size of each output buffer when writing to a file */
+#define OUTBUF_SIZE (256 * 1024)
+
+struct outbuf;
+
+/** create a buffered writer on a file descriptor
+ *
+ * When the descriptor is a pipe full buffers are handed to the kernel with
+ * vmsplice instead of being copied by write.
+ *
+ * @param fd The file descriptor to write to, it is not closed.
+ * @return The new writer or NULL on error.
+ */
+struct outbuf *outbuf_open(int fd);
+
+/** add data to the output
+ *
+ * @return false if this or any earlier output failed.
+ */
+bool outbuf_write(struct outbuf *ob, const void *data, size_t len);
+
+/** add formatted text to the output
+ *
+ * @return false if this or any earlier output failed.
+ */
+bool outbuf_printf(struct outbuf *ob, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/** flush remaining output and free the writer
+ *
+ * @return false if any output failed.
+ */
+bool outbuf_close(struct outbuf *ob);
+
+#endif
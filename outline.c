@@ -0,0 +1,1092 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Bitmap outline tracing and curve fitting.
+ *
+ * The boundary between opaque and transparent pixels is traced as closed
+ * loops of pixel edges. Each loop may then be fitted with cubic bezier
+ * curves using the least squares method of Schneider ("An Algorithm for
+ * Automatically Fitting Digitized Curves", Graphics Gems 1990). The curves
+ * are fitted through the midpoints of the pixel edges, on which a
+ * staircase of single pixel steps is a straight line, and loops are split
+ * at sharp corners so those remain sharp.
+ *
+ * An offset outline is traced around the pixels whose distance field,
+ * grown by the offset, is positive. Each point on a pixel edge is then
+ * moved to where the field crosses zero between the pixel centres either
+ * side, so the outline lies between the pixel edges.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "bitmap.h"
+#include "distance.h"
+#include "outline.h"
+
+/** fewest unit edges either side of a vertex used to find corners, the
+ * span grows with the tolerance so larger steps are smoothed
+ */
+#define OUTLINE_CORNER_SPAN 3
+
+/** cosine of the smallest turn which is a corner (60 degrees) */
+#define OUTLINE_CORNER_COS 0.5f
+
+/** number of points used to estimate a tangent */
+#define OUTLINE_TANGENT_SPAN 3
+
+/** reparameterisation attempts before a curve is split */
+#define OUTLINE_FIT_ITERATIONS 4
+
+/** deepest subdivision when flattening a curve */
+#define OUTLINE_FLATTEN_DEPTH 16
+
+/* edge directions in image coordinates */
+enum {
+    DIR_RIGHT = 0, /* +x */
+    DIR_DOWN = 1, /* +y */
+    DIR_LEFT = 2, /* -x */
+    DIR_UP = 3, /* -y */
+};
+
+static const int dir_dx[4] = { 1, 0, -1, 0 };
+static const int dir_dy[4] = { 0, 1, 0, -1 };
+
+/** state while fitting one loop */
+struct outline_fit {
+    struct outline *ol;
+    struct opnt *p; /**< points being fitted */
+    float *u; /**< parameter of each point */
+    float *uprime; /**< reparameterised parameters */
+    float error; /**< squared error tolerance */
+};
+
+static inline struct opnt opnt_sub(struct opnt a, struct opnt b)
+{
+    struct opnt r = { a.x - b.x, a.y - b.y };
+    return r;
+}
+
+static inline struct opnt opnt_add(struct opnt a, struct opnt b)
+{
+    struct opnt r = { a.x + b.x, a.y + b.y };
+    return r;
+}
+
+static inline struct opnt opnt_scale(struct opnt a, float s)
+{
+    struct opnt r = { a.x * s, a.y * s };
+    return r;
+}
+
+static inline float opnt_dot(struct opnt a, struct opnt b)
+{
+    return (a.x * b.x) + (a.y * b.y);
+}
+
+static inline float opnt_len(struct opnt a)
+{
+    return sqrtf(opnt_dot(a, a));
+}
+
+static inline struct opnt opnt_unit(struct opnt a)
+{
+    float len = opnt_len(a);
+
+    if (len == 0.0f) {
+        return a;
+    }
+    return opnt_scale(a, 1.0f / len);
+}
+
+/* evaluate a cubic bezier */
+static struct opnt bezier_point(const struct opnt bez[4], float t)
+{
+    float mt = 1.0f - t;
+    struct opnt r;
+
+    r.x = (mt * mt * mt * bez[0].x) + (3 * mt * mt * t * bez[1].x) +
+          (3 * mt * t * t * bez[2].x) + (t * t * t * bez[3].x);
+    r.y = (mt * mt * mt * bez[0].y) + (3 * mt * mt * t * bez[1].y) +
+          (3 * mt * t * t * bez[2].y) + (t * t * t * bez[3].y);
+
+    return r;
+}
+
+static bool outline_add_loop(struct outline *ol, struct opnt start)
+{
+    struct outline_loop *nloop;
+
+    if (ol->lcount == ol->lalloc) {
+        nloop = realloc(ol->loop, (ol->lalloc + 64) * 2 * sizeof(struct outline_loop));
+        if (nloop == NULL) {
+            return false;
+        }
+        ol->loop = nloop;
+        ol->lalloc = (ol->lalloc + 64) * 2;
+    }
+
+    ol->loop[ol->lcount].start = start;
+    ol->loop[ol->lcount].first = ol->scount;
+    ol->loop[ol->lcount].count = 0;
+    ol->lcount++;
+
+    return true;
+}
+
+static bool
+outline_add_seg(struct outline *ol,
+                bool cubic,
+                struct opnt c1,
+                struct opnt c2,
+                struct opnt p)
+{
+    struct outline_loop *loop = &ol->loop[ol->lcount - 1];
+    struct outline_seg *nseg;
+    struct outline_seg *seg;
+    struct opnt from;
+    struct opnt a;
+    struct opnt b;
+
+    /* a line continuing the previous line in the same direction extends it */
+    if ((cubic == false) &&
+        (loop->count > 0) &&
+        (ol->seg[ol->scount - 1].cubic == false)) {
+        seg = &ol->seg[ol->scount - 1];
+        if (loop->count > 1) {
+            from = ol->seg[ol->scount - 2].p;
+        } else {
+            from = loop->start;
+        }
+        a = opnt_sub(seg->p, from);
+        b = opnt_sub(p, seg->p);
+        if ((fabsf((a.x * b.y) - (a.y * b.x)) < 0.0001f) &&
+            (opnt_dot(a, b) > 0.0f)) {
+            seg->c1 = p;
+            seg->c2 = p;
+            seg->p = p;
+            return true;
+        }
+    }
+
+    if (ol->scount == ol->salloc) {
+        nseg = realloc(ol->seg, (ol->salloc + 256) * 2 * sizeof(struct outline_seg));
+        if (nseg == NULL) {
+            return false;
+        }
+        ol->seg = nseg;
+        ol->salloc = (ol->salloc + 256) * 2;
+    }
+
+    seg = &ol->seg[ol->scount++];
+    seg->cubic = cubic;
+    seg->c1 = c1;
+    seg->c2 = c2;
+    seg->p = p;
+
+    loop->count++;
+
+    return true;
+}
+
+/* add a fitted curve, curves which are straight are added as lines */
+static bool outline_add_bezier(struct outline *ol, const struct opnt bez[4])
+{
+    struct opnt chord = opnt_sub(bez[3], bez[0]);
+    struct opnt d1 = opnt_sub(bez[1], bez[0]);
+    struct opnt d2 = opnt_sub(bez[2], bez[0]);
+    float len = opnt_len(chord);
+    float t1;
+    float t2;
+
+    if (len > 0.0f) {
+        chord = opnt_scale(chord, 1.0f / len);
+        t1 = opnt_dot(d1, chord);
+        t2 = opnt_dot(d2, chord);
+
+        /* control points on the chord between the ends */
+        if ((fabsf((d1.x * chord.y) - (d1.y * chord.x)) < 0.01f) &&
+            (fabsf((d2.x * chord.y) - (d2.y * chord.x)) < 0.01f) &&
+            (t1 >= 0.0f) && (t1 <= len) &&
+            (t2 >= 0.0f) && (t2 <= len)) {
+            return outline_add_seg(ol, false, bez[3], bez[3], bez[3]);
+        }
+    }
+
+    return outline_add_seg(ol, true, bez[1], bez[2], bez[3]);
+}
+
+/* unit tangent at the start of a run of points heading towards the end */
+static struct opnt
+outline_tangent(const struct opnt *p, unsigned int from, unsigned int toward)
+{
+    unsigned int span;
+    struct opnt t;
+
+    if (toward > from) {
+        span = toward - from;
+        if (span > OUTLINE_TANGENT_SPAN) {
+            span = OUTLINE_TANGENT_SPAN;
+        }
+        t = opnt_sub(p[from + span], p[from]);
+    } else {
+        span = from - toward;
+        if (span > OUTLINE_TANGENT_SPAN) {
+            span = OUTLINE_TANGENT_SPAN;
+        }
+        t = opnt_sub(p[from - span], p[from]);
+    }
+
+    return opnt_unit(t);
+}
+
+/* chord length parameterisation of points */
+static void
+fit_chord_param(struct outline_fit *fit, unsigned int first, unsigned int last)
+{
+    unsigned int loop;
+
+    fit->u[0] = 0.0f;
+    for (loop = first + 1; loop <= last; loop++) {
+        fit->u[loop - first] = fit->u[loop - first - 1] +
+                opnt_len(opnt_sub(fit->p[loop], fit->p[loop - 1]));
+    }
+
+    for (loop = first + 1; loop <= last; loop++) {
+        fit->u[loop - first] /= fit->u[last - first];
+    }
+}
+
+/* least squares fit of bezier control points for given end tangents */
+static void
+fit_generate(struct outline_fit *fit,
+             unsigned int first,
+             unsigned int last,
+             const float *u,
+             struct opnt that1,
+             struct opnt that2,
+             struct opnt bez[4])
+{
+    unsigned int loop;
+    float c[2][2] = { { 0, 0 }, { 0, 0 } };
+    float x[2] = { 0, 0 };
+    struct opnt a0;
+    struct opnt a1;
+    struct opnt tmp;
+    float t;
+    float mt;
+    float b0, b1, b2, b3;
+    float det_c0_c1;
+    float alpha_l = 0.0f;
+    float alpha_r = 0.0f;
+    float seg_len;
+
+    bez[0] = fit->p[first];
+    bez[3] = fit->p[last];
+
+    for (loop = first; loop <= last; loop++) {
+        t = u[loop - first];
+        mt = 1.0f - t;
+        b0 = mt * mt * mt;
+        b1 = 3 * t * mt * mt;
+        b2 = 3 * t * t * mt;
+        b3 = t * t * t;
+
+        a0 = opnt_scale(that1, b1);
+        a1 = opnt_scale(that2, b2);
+
+        c[0][0] += opnt_dot(a0, a0);
+        c[0][1] += opnt_dot(a0, a1);
+        c[1][1] += opnt_dot(a1, a1);
+
+        tmp = opnt_sub(fit->p[loop],
+                       opnt_add(opnt_scale(bez[0], b0 + b1),
+                                opnt_scale(bez[3], b2 + b3)));
+
+        x[0] += opnt_dot(a0, tmp);
+        x[1] += opnt_dot(a1, tmp);
+    }
+    c[1][0] = c[0][1];
+
+    det_c0_c1 = (c[0][0] * c[1][1]) - (c[1][0] * c[0][1]);
+    if (det_c0_c1 != 0.0f) {
+        alpha_l = ((x[0] * c[1][1]) - (x[1] * c[0][1])) / det_c0_c1;
+        alpha_r = ((c[0][0] * x[1]) - (c[1][0] * x[0])) / det_c0_c1;
+    }
+
+    /* fall back to the Wu/Barsky heuristic when the fit is degenerate */
+    seg_len = opnt_len(opnt_sub(bez[3], bez[0]));
+    if ((alpha_l < (seg_len * 1.0e-6f)) || (alpha_r < (seg_len * 1.0e-6f))) {
+        alpha_l = seg_len / 3.0f;
+        alpha_r = alpha_l;
+    }
+
+    bez[1] = opnt_add(bez[0], opnt_scale(that1, alpha_l));
+    bez[2] = opnt_add(bez[3], opnt_scale(that2, alpha_r));
+}
+
+/* largest squared distance between the points and the curve */
+static float
+fit_max_error(struct outline_fit *fit,
+              unsigned int first,
+              unsigned int last,
+              const struct opnt bez[4],
+              const float *u,
+              unsigned int *split)
+{
+    unsigned int loop;
+    float dist;
+    float max = 0.0f;
+    struct opnt v;
+
+    *split = (first + last + 1) / 2;
+
+    for (loop = first + 1; loop < last; loop++) {
+        v = opnt_sub(bezier_point(bez, u[loop - first]), fit->p[loop]);
+        dist = opnt_dot(v, v);
+        if (dist >= max) {
+            max = dist;
+            *split = loop;
+        }
+    }
+
+    return max;
+}
+
+/* improve parameters with a Newton-Raphson step towards the nearest point */
+static void
+fit_reparameterise(struct outline_fit *fit,
+                   unsigned int first,
+                   unsigned int last,
+                   const struct opnt bez[4])
+{
+    unsigned int loop;
+    struct opnt q1[3];
+    struct opnt q2[2];
+    struct opnt qu;
+    struct opnt q1u;
+    struct opnt q2u;
+    struct opnt d;
+    float t;
+    float mt;
+    float numerator;
+    float denominator;
+
+    for (loop = 0; loop < 3; loop++) {
+        q1[loop] = opnt_scale(opnt_sub(bez[loop + 1], bez[loop]), 3.0f);
+    }
+    for (loop = 0; loop < 2; loop++) {
+        q2[loop] = opnt_scale(opnt_sub(q1[loop + 1], q1[loop]), 2.0f);
+    }
+
+    for (loop = first; loop <= last; loop++) {
+        t = fit->u[loop - first];
+        mt = 1.0f - t;
+
+        qu = bezier_point(bez, t);
+        q1u = opnt_add(opnt_add(opnt_scale(q1[0], mt * mt),
+                                opnt_scale(q1[1], 2 * mt * t)),
+                       opnt_scale(q1[2], t * t));
+        q2u = opnt_add(opnt_scale(q2[0], mt), opnt_scale(q2[1], t));
+
+        d = opnt_sub(qu, fit->p[loop]);
+        numerator = opnt_dot(d, q1u);
+        denominator = opnt_dot(q1u, q1u) + opnt_dot(d, q2u);
+
+        if (denominator != 0.0f) {
+            t -= numerator / denominator;
+        }
+        fit->uprime[loop - first] = t;
+    }
+}
+
+/* fit a run of points with cubic curves, splitting until within error */
+static bool
+fit_cubic(struct outline_fit *fit,
+          unsigned int first,
+          unsigned int last,
+          struct opnt that1,
+          struct opnt that2)
+{
+    struct opnt bez[4];
+    struct opnt that_center;
+    float max_error;
+    float dist;
+    unsigned int split;
+    unsigned int iteration;
+    unsigned int span;
+    float *tmp;
+
+    if ((last - first) == 1) {
+        dist = opnt_len(opnt_sub(fit->p[last], fit->p[first])) / 3.0f;
+        bez[0] = fit->p[first];
+        bez[3] = fit->p[last];
+        bez[1] = opnt_add(bez[0], opnt_scale(that1, dist));
+        bez[2] = opnt_add(bez[3], opnt_scale(that2, dist));
+        return outline_add_bezier(fit->ol, bez);
+    }
+
+    fit_chord_param(fit, first, last);
+    fit_generate(fit, first, last, fit->u, that1, that2, bez);
+
+    max_error = fit_max_error(fit, first, last, bez, fit->u, &split);
+    if (max_error < fit->error) {
+        return outline_add_bezier(fit->ol, bez);
+    }
+
+    /* close fits may converge with better parameters */
+    if (max_error < (fit->error * 4.0f)) {
+        for (iteration = 0; iteration < OUTLINE_FIT_ITERATIONS; iteration++) {
+            fit_reparameterise(fit, first, last, bez);
+            fit_generate(fit, first, last, fit->uprime, that1, that2, bez);
+            max_error = fit_max_error(fit, first, last, bez, fit->uprime, &split);
+            if (max_error < fit->error) {
+                return outline_add_bezier(fit->ol, bez);
+            }
+            tmp = fit->u;
+            fit->u = fit->uprime;
+            fit->uprime = tmp;
+        }
+    }
+
+    /* split at the worst point with a tangent shared by both halves */
+    span = split - first;
+    if ((last - split) < span) {
+        span = last - split;
+    }
+    if (span > OUTLINE_TANGENT_SPAN) {
+        span = OUTLINE_TANGENT_SPAN;
+    }
+    that_center = opnt_unit(opnt_sub(fit->p[split - span], fit->p[split + span]));
+
+    if (fit_cubic(fit, first, split, that1, that_center) == false) {
+        return false;
+    }
+    return fit_cubic(fit, split, last, opnt_scale(that_center, -1.0f), that2);
+}
+
+/* point where the outline crosses a unit pixel edge
+ *
+ * The edge runs from a in direction d with the opaque pixel on its left.
+ * Without a distance field the point is the middle of the edge.
+ */
+static struct opnt
+outline_edge_point(struct distance *dist, float offset, struct opnt a, struct opnt d)
+{
+    struct opnt mid;
+    struct opnt n; /* toward the opaque pixel centre */
+    float fo;
+    float ft;
+    float t;
+
+    mid.x = a.x + (d.x * 0.5f);
+    mid.y = a.y + (d.y * 0.5f);
+    if (dist == NULL) {
+        return mid;
+    }
+
+    n.x = d.y;
+    n.y = -d.x;
+    fo = distance_offset_at(dist,
+                            floorf(mid.x + (n.x * 0.5f)),
+                            floorf(mid.y + (n.y * 0.5f)),
+                            offset);
+    ft = distance_offset_at(dist,
+                            floorf(mid.x - (n.x * 0.5f)),
+                            floorf(mid.y - (n.y * 0.5f)),
+                            offset);
+    t = fo / (fo - ft);
+
+    return opnt_add(mid, opnt_scale(n, 0.5f - t));
+}
+
+/* outline point at a pixel corner between two unit edges
+ *
+ * A turn is moved with both edges meeting there, a vertex along a
+ * straight edge by the average of them.
+ */
+static struct opnt
+outline_vertex_point(struct distance *dist,
+                     float offset,
+                     struct opnt prev,
+                     struct opnt v,
+                     struct opnt next)
+{
+    struct opnt d1 = opnt_sub(v, prev);
+    struct opnt d2 = opnt_sub(next, v);
+    struct opnt s1;
+    struct opnt s2;
+
+    if (dist == NULL) {
+        return v;
+    }
+
+    s1 = opnt_sub(outline_edge_point(dist, offset, prev, d1),
+                  outline_edge_point(NULL, 0, prev, d1));
+    s2 = opnt_sub(outline_edge_point(dist, offset, v, d2),
+                  outline_edge_point(NULL, 0, v, d2));
+
+    if ((d1.x == d2.x) && (d1.y == d2.y)) {
+        return opnt_add(v, opnt_scale(opnt_add(s1, s2), 0.5f));
+    }
+    return opnt_add(v, opnt_add(s1, s2));
+}
+
+/* add a loop of pixel edge vertices as a polygon */
+static bool
+outline_polygon(struct outline *ol, const struct opnt *vtx, unsigned int count)
+{
+    unsigned int loop;
+
+    if (outline_add_loop(ol, vtx[0]) == false) {
+        return false;
+    }
+
+    for (loop = 1; loop <= count; loop++) {
+        if (outline_add_seg(ol, false,
+                            vtx[loop % count],
+                            vtx[loop % count],
+                            vtx[loop % count]) == false) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* add a loop as a polygon through the outline crossing of every pixel edge
+ *
+ * This is the marching squares contour of the field, as the mesh
+ * generators produce, so a corner of the opaque area is cut across.
+ */
+static bool
+outline_field_polygon(struct outline *ol,
+                      const struct opnt *corner,
+                      unsigned int ccount,
+                      struct distance *dist,
+                      float offset)
+{
+    unsigned int cloop;
+    unsigned int span;
+    unsigned int steps;
+    struct opnt step;
+    struct opnt p;
+
+    for (cloop = 0; cloop < ccount; cloop++) {
+        step = opnt_sub(corner[(cloop + 1) % ccount], corner[cloop]);
+        steps = opnt_len(step);
+        step = opnt_scale(step, 1.0f / steps);
+
+        for (span = 0; span < steps; span++) {
+            p = outline_edge_point(dist, offset,
+                                   opnt_add(corner[cloop], opnt_scale(step, span)),
+                                   step);
+            if ((cloop == 0) && (span == 0)) {
+                if (outline_add_loop(ol, p) == false) {
+                    return false;
+                }
+            } else if (outline_add_seg(ol, false, p, p, p) == false) {
+                return false;
+            }
+        }
+    }
+
+    /* close the loop at its start */
+    p = ol->loop[ol->lcount - 1].start;
+    return outline_add_seg(ol, false, p, p, p);
+}
+
+/* fit curves to a loop given as its corner vertices */
+static bool
+outline_fit_loop(struct outline *ol,
+                 const struct opnt *corner,
+                 unsigned int ccount,
+                 float tolerance,
+                 struct distance *dist,
+                 float offset)
+{
+    struct opnt *vtx; /* vertex at every unit step */
+    float *turn; /* cosine of turn at each vertex */
+    bool *sharp; /* vertex is a corner */
+    struct outline_fit fit;
+    unsigned int n = 0;
+    unsigned int loop;
+    unsigned int cloop;
+    unsigned int steps;
+    unsigned int first_corner;
+    unsigned int start;
+    unsigned int end;
+    unsigned int pcount;
+    unsigned int span;
+    unsigned int cspan; /* corner span */
+    struct opnt step;
+    struct opnt a;
+    struct opnt b;
+    float len;
+    bool ret = false;
+
+    cspan = 4 * tolerance;
+    if (cspan < OUTLINE_CORNER_SPAN) {
+        cspan = OUTLINE_CORNER_SPAN;
+    }
+
+    /* perimeter of loop */
+    for (cloop = 0; cloop < ccount; cloop++) {
+        n += opnt_len(opnt_sub(corner[(cloop + 1) % ccount], corner[cloop]));
+    }
+
+    if (n < (4 * cspan)) {
+        /* too small to have curves */
+        if (dist != NULL) {
+            return outline_field_polygon(ol, corner, ccount, dist, offset);
+        }
+        return outline_polygon(ol, corner, ccount);
+    }
+
+    vtx = malloc(n * sizeof(struct opnt));
+    turn = malloc(n * sizeof(float));
+    sharp = calloc(n, sizeof(bool));
+    fit.p = malloc((n + 2) * sizeof(struct opnt));
+    fit.u = malloc((n + 2) * sizeof(float));
+    fit.uprime = malloc((n + 2) * sizeof(float));
+    fit.ol = ol;
+    fit.error = tolerance * tolerance;
+    if ((vtx == NULL) || (turn == NULL) || (sharp == NULL) ||
+        (fit.p == NULL) || (fit.u == NULL) || (fit.uprime == NULL)) {
+        goto fit_loop_done;
+    }
+
+    /* expand corners into unit steps */
+    loop = 0;
+    for (cloop = 0; cloop < ccount; cloop++) {
+        step = opnt_sub(corner[(cloop + 1) % ccount], corner[cloop]);
+        steps = opnt_len(step);
+        step = opnt_scale(step, 1.0f / steps);
+        for (span = 0; span < steps; span++) {
+            vtx[loop].x = corner[cloop].x + (step.x * span);
+            vtx[loop].y = corner[cloop].y + (step.y * span);
+            loop++;
+        }
+    }
+
+    /* outline point at a vertex */
+#define OUTLINE_VERTEX(idx)                                             \
+    outline_vertex_point(dist, offset, vtx[((idx) + n - 1) % n],        \
+                         vtx[(idx)], vtx[((idx) + 1) % n])
+
+    /* find the turn at each vertex over a few steps either side */
+    for (loop = 0; loop < n; loop++) {
+        a = opnt_sub(vtx[loop], vtx[(loop + n - cspan) % n]);
+        b = opnt_sub(vtx[(loop + cspan) % n], vtx[loop]);
+        len = opnt_len(a) * opnt_len(b);
+        turn[loop] = (len == 0.0f) ? -1.0f : opnt_dot(a, b) / len;
+    }
+
+    /* corners are the sharpest turn within their neighbourhood */
+    first_corner = n;
+    for (loop = 0; loop < n; loop++) {
+        if (turn[loop] >= OUTLINE_CORNER_COS) {
+            continue;
+        }
+        sharp[loop] = true;
+        for (span = 1; span <= cspan; span++) {
+            if ((turn[(loop + n - span) % n] <= turn[loop]) ||
+                (turn[(loop + span) % n] < turn[loop])) {
+                sharp[loop] = false;
+                break;
+            }
+        }
+        if (sharp[loop] && (first_corner == n)) {
+            first_corner = loop;
+        }
+    }
+
+    if (first_corner == n) {
+        /* a smooth loop is fitted through its edge midpoints from a seam
+         * whose tangent is shared by both ends
+         */
+        for (loop = 0; loop < n; loop++) {
+            fit.p[loop] = outline_edge_point(dist, offset, vtx[loop],
+                                             opnt_sub(vtx[(loop + 1) % n], vtx[loop]));
+        }
+        fit.p[n] = fit.p[0];
+
+        a = opnt_unit(opnt_sub(fit.p[OUTLINE_TANGENT_SPAN],
+                               fit.p[n - OUTLINE_TANGENT_SPAN]));
+
+        if (outline_add_loop(ol, fit.p[0]) == false) {
+            goto fit_loop_done;
+        }
+        ret = fit_cubic(&fit, 0, n, a, opnt_scale(a, -1.0f));
+        goto fit_loop_done;
+    }
+
+    if (outline_add_loop(ol, OUTLINE_VERTEX(first_corner)) == false) {
+        goto fit_loop_done;
+    }
+
+    /* fit each run between corners through the corners and the midpoints
+     * of the edges between them
+     */
+    start = first_corner;
+    do {
+        end = (start + 1) % n;
+        while (!sharp[end]) {
+            end = (end + 1) % n;
+        }
+
+        pcount = 0;
+        fit.p[pcount++] = OUTLINE_VERTEX(start);
+        loop = start;
+        do {
+            fit.p[pcount++] = outline_edge_point(dist, offset, vtx[loop],
+                                                 opnt_sub(vtx[(loop + 1) % n], vtx[loop]));
+            loop = (loop + 1) % n;
+        } while (loop != end);
+        fit.p[pcount++] = OUTLINE_VERTEX(end);
+
+        if (fit_cubic(&fit, 0, pcount - 1,
+                      outline_tangent(fit.p, 0, pcount - 1),
+                      outline_tangent(fit.p, pcount - 1, 0)) == false) {
+            goto fit_loop_done;
+        }
+
+        start = end;
+    } while (start != first_corner);
+
+    ret = true;
+
+#undef OUTLINE_VERTEX
+
+fit_loop_done:
+    free(vtx);
+    free(turn);
+    free(sharp);
+    free(fit.p);
+    free(fit.u);
+    free(fit.uprime);
+
+    return ret;
+}
+
+static inline bool
+outline_opaque(bitmap *bm, unsigned int transparent, int x, int y)
+{
+    if ((x < 0) || (y < 0) ||
+        ((uint32_t)x >= bm->width) || ((uint32_t)y >= bm->height)) {
+        return false;
+    }
+    return *bitmap_pixel(bm, x, y) != transparent;
+}
+
+/* trace outlines, placed by a distance field when one is given */
+static struct outline *
+outline_trace(bitmap *bm,
+              unsigned int transparent,
+              float tolerance,
+              struct distance *dist,
+              float offset)
+{
+    struct outline *ol;
+    uint8_t *edges; /* outgoing edge directions at each pixel corner */
+    uint32_t vwidth = bm->width + 1; /* vertices in each row */
+    size_t vidx;
+    size_t sidx;
+    int x;
+    int y;
+    int vx;
+    int vy;
+    unsigned int dir;
+    unsigned int sdir;
+    unsigned int ndir;
+    unsigned int avail;
+    struct opnt *corner = NULL;
+    unsigned int ccount;
+    unsigned int corner_alloc = 0;
+    struct opnt *ncorner;
+    bool ok = true;
+
+    ol = calloc(1, sizeof(struct outline));
+    if (ol == NULL) {
+        return NULL;
+    }
+    ol->width = bm->width;
+    ol->height = bm->height;
+
+    edges = calloc((size_t)vwidth * (bm->height + 1), 1);
+    if (edges == NULL) {
+        free(ol);
+        return NULL;
+    }
+
+    /* directed edges with the opaque pixel on their left */
+    for (y = 0; y < (int)bm->height; y++) {
+        for (x = 0; x < (int)bm->width; x++) {
+            if (!outline_opaque(bm, transparent, x, y)) {
+                continue;
+            }
+            vidx = ((size_t)y * vwidth) + x;
+            if (!outline_opaque(bm, transparent, x - 1, y)) {
+                edges[vidx] |= 1 << DIR_DOWN;
+            }
+            if (!outline_opaque(bm, transparent, x, y + 1)) {
+                edges[vidx + vwidth] |= 1 << DIR_RIGHT;
+            }
+            if (!outline_opaque(bm, transparent, x + 1, y)) {
+                edges[vidx + vwidth + 1] |= 1 << DIR_UP;
+            }
+            if (!outline_opaque(bm, transparent, x, y - 1)) {
+                edges[vidx + 1] |= 1 << DIR_LEFT;
+            }
+        }
+    }
+
+    /* follow edges into loops */
+    for (sidx = 0; ok && (sidx < ((size_t)vwidth * (bm->height + 1))); sidx++) {
+        while (ok && (edges[sidx] != 0)) {
+            vx = sidx % vwidth;
+            vy = sidx / vwidth;
+            vidx = sidx;
+            sdir = __builtin_ctz(edges[sidx]);
+            dir = sdir;
+            ccount = 0;
+
+            do {
+                edges[vidx] &= ~(1 << dir);
+                vx += dir_dx[dir];
+                vy += dir_dy[dir];
+                vidx = ((size_t)vy * vwidth) + vx;
+
+                /* the edge the loop started with is available to close it */
+                avail = edges[vidx];
+                if (vidx == sidx) {
+                    avail |= 1 << sdir;
+                }
+
+                /* turning left first keeps diagonal pixels apart */
+                if (avail & (1 << ((dir + 3) & 3))) {
+                    ndir = (dir + 3) & 3;
+                } else if (avail & (1 << dir)) {
+                    ndir = dir;
+                } else {
+                    ndir = (dir + 1) & 3;
+                }
+
+                if (ndir != dir) {
+                    if (ccount == corner_alloc) {
+                        ncorner = realloc(corner, (corner_alloc + 64) * 2 * sizeof(struct opnt));
+                        if (ncorner == NULL) {
+                            ok = false;
+                            break;
+                        }
+                        corner = ncorner;
+                        corner_alloc = (corner_alloc + 64) * 2;
+                    }
+                    corner[ccount].x = vx;
+                    corner[ccount].y = vy;
+                    ccount++;
+                }
+                dir = ndir;
+            } while ((vidx != sidx) || (dir != sdir));
+
+            if (!ok) {
+                break;
+            }
+
+            if (tolerance > 0.0f) {
+                ok = outline_fit_loop(ol, corner, ccount, tolerance,
+                                      dist, offset);
+            } else if (dist != NULL) {
+                ok = outline_field_polygon(ol, corner, ccount, dist, offset);
+            } else {
+                ok = outline_polygon(ol, corner, ccount);
+            }
+        }
+    }
+
+    free(corner);
+    free(edges);
+
+    if (!ok) {
+        free_outline(ol);
+        return NULL;
+    }
+
+    return ol;
+}
+
+/* exported method documented in outline.h */
+struct outline *
+outline_from_bitmap(bitmap *bm, unsigned int transparent, float tolerance)
+{
+    return outline_trace(bm, transparent, tolerance, NULL, 0);
+}
+
+/* exported method documented in outline.h */
+struct outline *
+outline_offset(bitmap *bm, unsigned int transparent, float offset, float tolerance)
+{
+    struct distance *dist;
+    struct outline *ol;
+    bitmap *mask;
+    uint8_t *pxl;
+    uint32_t x;
+    uint32_t y;
+
+    dist = distance_from_bitmap(bm, transparent);
+    if (dist == NULL) {
+        return NULL;
+    }
+
+    /* pixels whose centre is within the grown area */
+    mask = new_bitmap(bm->width, bm->height);
+    if (mask == NULL) {
+        free_distance(dist);
+        return NULL;
+    }
+    for (y = 0; y < bm->height; y++) {
+        pxl = bitmap_pixel(mask, 0, y);
+        for (x = 0; x < bm->width; x++) {
+            pxl[x] = (distance_offset_at(dist, x, y, offset) > 0) ? 1 : 0;
+        }
+    }
+
+    ol = outline_trace(mask, 0, tolerance, dist, offset);
+
+    free_bitmap(mask);
+    free_distance(dist);
+
+    return ol;
+}
+
+/* exported method documented in outline.h */
+void free_outline(struct outline *ol)
+{
+    free(ol->loop);
+    free(ol->seg);
+    free(ol);
+}
+
+/* add a point to a flattened outline */
+static bool
+flatten_add(struct opnt p, struct opnt **pnts, unsigned int *pcount, unsigned int *palloc)
+{
+    struct opnt *npnts;
+
+    if (*pcount == *palloc) {
+        npnts = realloc(*pnts, (*palloc + 256) * 2 * sizeof(struct opnt));
+        if (npnts == NULL) {
+            return false;
+        }
+        *pnts = npnts;
+        *palloc = (*palloc + 256) * 2;
+    }
+    (*pnts)[(*pcount)++] = p;
+
+    return true;
+}
+
+/* subdivide a cubic until it is flat, adding the end of each piece */
+static bool
+flatten_cubic(const struct opnt bez[4],
+              float flatness,
+              unsigned int depth,
+              struct opnt **pnts,
+              unsigned int *pcount,
+              unsigned int *palloc)
+{
+    struct opnt chord = opnt_sub(bez[3], bez[0]);
+    struct opnt d1 = opnt_sub(bez[1], bez[0]);
+    struct opnt d2 = opnt_sub(bez[2], bez[0]);
+    struct opnt l[4];
+    struct opnt r[4];
+    struct opnt mid;
+    float len = opnt_len(chord);
+    float dist1;
+    float dist2;
+
+    /* distance of the control points from the chord bounds the curve */
+    if (len > 0.0f) {
+        dist1 = fabsf((d1.x * chord.y) - (d1.y * chord.x)) / len;
+        dist2 = fabsf((d2.x * chord.y) - (d2.y * chord.x)) / len;
+    } else {
+        dist1 = opnt_len(d1);
+        dist2 = opnt_len(d2);
+    }
+
+    if ((depth == OUTLINE_FLATTEN_DEPTH) ||
+        ((dist1 <= flatness) && (dist2 <= flatness))) {
+        return flatten_add(bez[3], pnts, pcount, palloc);
+    }
+
+    /* de Casteljau split at the middle */
+    l[0] = bez[0];
+    l[1] = opnt_scale(opnt_add(bez[0], bez[1]), 0.5f);
+    mid = opnt_scale(opnt_add(bez[1], bez[2]), 0.5f);
+    r[2] = opnt_scale(opnt_add(bez[2], bez[3]), 0.5f);
+    r[3] = bez[3];
+    l[2] = opnt_scale(opnt_add(l[1], mid), 0.5f);
+    r[1] = opnt_scale(opnt_add(mid, r[2]), 0.5f);
+    l[3] = opnt_scale(opnt_add(l[2], r[1]), 0.5f);
+    r[0] = l[3];
+
+    if (flatten_cubic(l, flatness, depth + 1, pnts, pcount, palloc) == false) {
+        return false;
+    }
+    return flatten_cubic(r, flatness, depth + 1, pnts, pcount, palloc);
+}
+
+/* exported method documented in outline.h */
+bool
+outline_flatten(struct outline *ol,
+                unsigned int lidx,
+                float flatness,
+                struct opnt **pnts,
+                unsigned int *pcount,
+                unsigned int *palloc)
+{
+    struct outline_loop *loop = &ol->loop[lidx];
+    struct outline_seg *seg;
+    struct opnt bez[4];
+    struct opnt prev = loop->start;
+    unsigned int sloop;
+    unsigned int start = *pcount;
+
+    if (flatten_add(prev, pnts, pcount, palloc) == false) {
+        return false;
+    }
+
+    for (sloop = 0; sloop < loop->count; sloop++) {
+        seg = &ol->seg[loop->first + sloop];
+        if (seg->cubic) {
+            bez[0] = prev;
+            bez[1] = seg->c1;
+            bez[2] = seg->c2;
+            bez[3] = seg->p;
+            if (flatten_cubic(bez, flatness, 0, pnts, pcount, palloc) == false) {
+                return false;
+            }
+        } else {
+            if (flatten_add(seg->p, pnts, pcount, palloc) == false) {
+                return false;
+            }
+        }
+        prev = seg->p;
+    }
+
+    /* the final segment returns to the start */
+    if (*pcount > (start + 1)) {
+        (*pcount)--;
+    }
+
+    return true;
+}
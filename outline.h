@@ -0,0 +1,106 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * bitmap outline tracing and curve fitting header.
+ */
+
+#ifndef PNG23D_OUTLINE_H
+#define PNG23D_OUTLINE_H 1
+
+/** point on an outline in pixel units, y increases down the image */
+struct opnt {
+    float x;
+    float y;
+};
+
+/** outline segment running from the end of the previous segment */
+struct outline_seg {
+    bool cubic; /**< segment is a cubic bezier rather than a line */
+    struct opnt c1; /**< first control point of a cubic */
+    struct opnt c2; /**< second control point of a cubic */
+    struct opnt p; /**< end point */
+};
+
+/** closed outline loop, the last segment ends at the start point */
+struct outline_loop {
+    struct opnt start; /**< start point */
+    unsigned int first; /**< index of first segment */
+    unsigned int count; /**< number of segments */
+};
+
+/** outlines of the opaque areas of a bitmap
+ *
+ * Loops around holes run in the opposite direction to those around the
+ * areas containing them so either the even-odd or non-zero fill rule
+ * gives the opaque area.
+ */
+struct outline {
+    uint32_t width; /**< width of the traced bitmap */
+    uint32_t height; /**< height of the traced bitmap */
+
+    struct outline_loop *loop; /**< loops */
+    unsigned int lcount; /**< number of loops */
+    unsigned int lalloc; /**< number of loops allocated */
+
+    struct outline_seg *seg; /**< segments of all loops */
+    unsigned int scount; /**< number of segments */
+    unsigned int salloc; /**< number of segments allocated */
+};
+
+/** trace the outlines of the opaque areas of a bitmap
+ *
+ * Outlines follow pixel edges. Diagonally adjacent opaque pixels are
+ * traced as separate areas.
+ *
+ * @param bm The bitmap to trace.
+ * @param transparent The transparent pixel value, 256 for none.
+ * @param tolerance The maximum distance in pixels between a fitted curve
+ *                  and the pixel outline. When zero no fitting is
+ *                  performed and the outlines are polygons of the pixel
+ *                  edges.
+ * @return The outlines or NULL on error.
+ */
+struct outline *outline_from_bitmap(bitmap *bm, unsigned int transparent, float tolerance);
+
+/** trace the outlines of the opaque areas of a bitmap grown by an offset
+ *
+ * The outlines are at a euclidean distance from the pixel outline, so
+ * grown corners are rounded, and pass between the pixel edges where the
+ * distance field crosses the offset. The image must have room around the
+ * opaque area for it to grow into.
+ *
+ * @param bm The bitmap to trace.
+ * @param transparent The transparent pixel value.
+ * @param offset The distance in pixels to grow by, negative to shrink.
+ * @param tolerance The maximum distance in pixels between a fitted curve
+ *                  and the offset outline, zero for a polygon through
+ *                  every pixel edge.
+ * @return The outlines or NULL on error.
+ */
+struct outline *outline_offset(bitmap *bm, unsigned int transparent, float offset, float tolerance);
+
+/** free outlines */
+void free_outline(struct outline *ol);
+
+/** flatten a loop into points
+ *
+ * Cubic segments are subdivided adaptively until they are within the
+ * flatness of a straight line. The points are appended to an array which
+ * is extended as required, the start point is not repeated at the end.
+ *
+ * @param ol The outlines.
+ * @param lidx The index of the loop to flatten.
+ * @param flatness The maximum distance in pixels from the curve.
+ * @param pnts The array of points to extend.
+ * @param pcount The number of points in the array, updated.
+ * @param palloc The number of points allocated, updated.
+ * @return true on success or false on memory exhaustion.
+ */
+bool outline_flatten(struct outline *ol, unsigned int lidx, float flatness, struct opnt **pnts, unsigned int *pcount, unsigned int *palloc);
+
+#endif
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "option.h"
 #include "bitmap.h"
@@ -26,6 +27,10 @@
 #include "out_rscad.h"
 #include "out_pscad.h"
 #include "out_stl.h"
+#include "out_svg.h"
+#include "out_oscad.h"
+#include "out_3mf.h"
+#include "trace.h"
 
 
 int main(int argc, char **argv)
@@ -34,18 +39,33 @@ int main(int argc, char **argv)
     bitmap *bm;
     options *options;
     int fd = STDOUT_FILENO;
+    uint32_t margin;
 
     options = read_options(argc, argv);
     if (options == NULL) {
         return EXIT_FAILURE;        
     }
 
+    if (trace_init(options->tracefile) == false) {
+        fprintf(stderr, "Error opening trace output\n");
+        return EXIT_FAILURE;
+    }
+
     /* read input */
-    INFO("Reading from png file \"%s\"\n", options->infile);
-    bm = create_bitmap(options->infile);
+    INFO("Reading from file \"%s\"\n", options->infile);
+    trace_begin("decode");
+    if (options->raw_width != 0) {
+        bm = create_bitmap_raw(options->infile,
+                               options->raw_width, options->raw_height);
+    } else if (options->palette) {
+        bm = create_bitmap_indexed(options->infile);
+    } else {
+        bm = create_bitmap(options->infile);
+    }
+    trace_end();
     if (bm == NULL) {
         fprintf(stderr, "Error creating bitmap\n");
-        return EXIT_FAILURE;
+        goto main_error;
     }
 
     /* open output */
@@ -59,7 +79,7 @@ int main(int argc, char **argv)
     if (fd < 0) {
         fprintf(stderr, "Error opening output\n");
         free_bitmap(bm);
-        return EXIT_FAILURE;
+        goto main_error;
     }
 
     /* if user did not specify output dimensions assume those from the bitmap */
@@ -71,13 +91,43 @@ int main(int argc, char **argv)
         options->height = bm->height;
     }
 
+    /* a grown outline needs transparent space around the image */
+    if (options->offset > 0) {
+        margin = ceilf(options->offset * bm->width / options->width) + 1;
+        options->width += 2 * margin * options->width / bm->width;
+        options->height += 2 * margin * options->height / bm->height;
+        bm = bitmap_pad(bm, margin, options->transparent);
+        if (bm == NULL) {
+            fprintf(stderr, "Error padding bitmap\n");
+            close(fd);
+            goto main_error;
+        }
+        INFO("Padded bitmap by %u pixels\n", margin);
+    }
+
+    /* slices are as deep as a pixel is wide unless told otherwise */
+    if (options->depth == 0) {
+        options->depth = options->slice_count * options->width / bm->width;
+    }
+
     /* generate output */
+    trace_begin("convert");
     switch (options->type) {
     case OUTPUT_PGM:
         INFO("Generating PGM\n");
         ret = output_pgm(bm, fd, options);
         break;
 
+    case OUTPUT_BPGM:
+        INFO("Generating binary PGM\n");
+        ret = output_pgm_binary(bm, fd, options);
+        break;
+
+    case OUTPUT_PNG:
+        INFO("Generating PNG\n");
+        ret = output_png(bm, fd, options);
+        break;
+
     case OUTPUT_RSCAD:
         INFO("Generating Rectangular Cuboid OpenSCAD\n");
         ret = output_flat_scad_cubes(bm, fd, options);
@@ -98,16 +148,35 @@ int main(int argc, char **argv)
         ret = output_flat_astl(bm, fd, options);
         break;
 
+    case OUTPUT_SVG:
+        INFO("Generating SVG outline\n");
+        ret = output_svg(bm, fd, options);
+        break;
+
+    case OUTPUT_OSCAD:
+        INFO("Generating extruded outline OpenSCAD\n");
+        ret = output_outline_scad(bm, fd, options);
+        break;
+
+    case OUTPUT_3MF:
+        INFO("Generating 3MF\n");
+        ret = output_3mf(bm, fd, options);
+        break;
+
     default:
         ret = false;
         break;
 
     }
 
+    trace_end();
+
     free_bitmap(bm);
 
     close(fd);
 
+    trace_fini();
+
     if (ret != true) {
         fprintf(stderr, "Error generating output\n");
         return EXIT_FAILURE;
@@ -117,4 +186,9 @@ int main(int argc, char **argv)
          (long long)(time(NULL) - options->start_time));
 
     return 0;
+
+main_error:
+    trace_fini();
+
+    return EXIT_FAILURE;
 }
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * Routines to generate an execution trace.
+ *
+ * The trace is written in the Chrome trace event JSON format as nested
+ * begin/end duration events so it can be loaded into a trace viewer such as
+ * chrome://tracing or Perfetto. Each event carries the process and thread
+ * identifier of the caller so spans begun on worker threads show as tracks
+ * of their own, and is written whole under a lock so threads may trace at
+ * the same time.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "trace.h"
+
+/** longest span name, longer names are truncated */
+#define TRACE_NAME_SIZE 256
+
+/** longest formatted event */
+#define TRACE_EVENT_SIZE (TRACE_NAME_SIZE + 128)
+
+static FILE *tracefile;
+static bool trace_first; /* no event has been written yet */
+static pid_t trace_pid;
+
+/* events from worker threads are each written whole under the lock */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* thread identifier of caller */
+static long trace_tid(void)
+{
+#ifdef __linux__
+    return syscall(SYS_gettid);
+#else
+    return trace_pid;
+#endif
+}
+
+/* timestamp in microseconds */
+static double trace_ts(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000000.0) + (ts.tv_nsec / 1000.0);
+}
+
+/* format an event and write it with a single call
+ *
+ * @param phase The event phase.
+ * @param name The span name for a begin event or NULL.
+ */
+static void trace_event(char phase, const char *name)
+{
+    char event[TRACE_EVENT_SIZE];
+    int len;
+
+    len = snprintf(event, sizeof(event),
+                   "\n{\"ph\":\"%c\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f",
+                   phase, (long)trace_pid, trace_tid(), trace_ts());
+    if (name != NULL) {
+        len += snprintf(event + len, sizeof(event) - len,
+                        ",\"cat\":\"png23d\",\"name\":\"%s\"", name);
+    }
+    snprintf(event + len, sizeof(event) - len, "}");
+
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_first) {
+        fputc(',', tracefile);
+    }
+    fputs(event, tracefile);
+    trace_first = false;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* exported interface documented in trace.h */
+bool trace_init(const char *filename)
+{
+    if (filename == NULL) {
+        return true;
+    }
+
+    tracefile = fopen(filename, "w");
+    if (tracefile == NULL) {
+        return false;
+    }
+
+    trace_pid = getpid();
+    trace_first = true;
+
+    fprintf(tracefile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    return true;
+}
+
+/* exported interface documented in trace.h */
+void trace_fini(void)
+{
+    if (tracefile == NULL) {
+        return;
+    }
+
+    fprintf(tracefile, "\n]}\n");
+    fclose(tracefile);
+    tracefile = NULL;
+}
+
+/* exported interface documented in trace.h */
+bool trace_enabled(void)
+{
+    return (tracefile != NULL);
+}
+
+/* exported interface documented in trace.h */
+void trace_begin(const char *fmt, ...)
+{
+    char name[TRACE_NAME_SIZE];
+    va_list ap;
+
+    if (tracefile == NULL) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(name, sizeof(name), fmt, ap);
+    va_end(ap);
+
+    trace_event('B', name);
+}
+
+/* exported interface documented in trace.h */
+void trace_end(void)
+{
+    if (tracefile == NULL) {
+        return;
+    }
+
+    trace_event('E', NULL);
+}
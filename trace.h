@@ -0,0 +1,36 @@
+/*
+ * Copyright 2011 Vincent Sanders <vince@kyllikki.org>
+ *
+ * Licenced under the MIT License,
+ *                http://www.opensource.org/licenses/mit-license.php
+ *
+ * This file is part of png23d.
+ *
+ * execution trace output header.
+ */
+
+#ifndef PNG23D_TRACE_H
+#define PNG23D_TRACE_H 1
+
+/** number of rows of the source image in each traced generation band */
+#define TRACE_GEN_BAND 64
+
+/** number of facets in each traced output chunk */
+#define TRACE_OUT_CHUNK 65536
+
+/** open trace output, no tracing is performed if filename is NULL */
+bool trace_init(const char *filename);
+
+/** complete and close trace output */
+void trace_fini(void);
+
+/** is trace output being generated */
+bool trace_enabled(void);
+
+/** begin a span, the name is formatted printf style */
+void trace_begin(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/** end the most recently begun span on the calling thread */
+void trace_end(void);
+
+#endif